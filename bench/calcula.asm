@@ -0,0 +1,34 @@
+; bench/calcula.asm
+; processo criado por bench/misto
+; bastante CPU, de vez em quando escreve um caractere
+
+N_EXT    define 1500  ; número de caracteres escritos
+N_INT    define 2000  ; voltas de cálculo antes de cada caractere
+
+SO_ESCR        define 2
+SO_MATA_PROC   define 8
+
+         cargi N_EXT
+         armm ext
+lacoext  cargi N_INT
+lacoint  sub um
+         desvnz lacoint
+         cargi '.'
+         trax
+         cargi SO_ESCR
+         chamas
+         cargm ext
+         sub um
+         armm ext
+         ; os dois processos calcula de bench/misto são carregados no mesmo
+         ;   lugar e compartilham 'ext'; com desvp, quem encontra o contador
+         ;   já zerado pelo outro termina, em vez de continuar do -1
+         desvp lacoext
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um       valor 1
+ext      espaco 1
@@ -0,0 +1,31 @@
+; bench/cpu.asm
+; programa para medir o desempenho do simulador
+; só CPU: laços aninhados, sem chamadas de sistema (a não ser para morrer)
+
+N_EXT    define 5000  ; voltas do laço externo
+N_INT    define 1000  ; voltas do laço interno, para cada volta do externo
+
+SO_MATA_PROC   define 8
+
+         cargi N_EXT
+         armm ext
+lacoext  cargi N_INT
+         armm int
+lacoint  cargm int
+         sub um
+         armm int
+         desvnz lacoint
+         cargm ext
+         sub um
+         armm ext
+         desvnz lacoext
+         ; morre
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um       valor 1
+ext      espaco 1
+int      espaco 1
@@ -0,0 +1,18 @@
+; bench/curto.asm
+; processo de vida curta, criado por bench/processos
+; conta um pouco e morre
+
+N        define 20
+
+SO_MATA_PROC   define 8
+
+         cargi N
+laco     sub um
+         desvnz laco
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um       valor 1
@@ -0,0 +1,27 @@
+; bench/escreve.asm
+; processo criado por bench/misto
+; pouca CPU, muita saída (fica bloqueado esperando o terminal)
+
+N        define 60000  ; número de caracteres escritos
+
+SO_ESCR        define 2
+SO_MATA_PROC   define 8
+
+         cargi N
+         armm n
+laco     cargi '#'
+         trax
+         cargi SO_ESCR
+         chamas
+         cargm n
+         sub um
+         armm n
+         desvnz laco
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um       valor 1
+n        espaco 1
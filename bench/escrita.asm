@@ -0,0 +1,33 @@
+; bench/escrita.asm
+; programa para medir o desempenho do simulador
+; muitas chamadas de sistema: escreve caracteres no terminal, um por chamada
+
+N        define 100000  ; número de caracteres escritos
+
+SO_ESCR        define 2
+SO_MATA_PROC   define 8
+
+         cargi N
+         armm n
+laco     ; escreve 'a'+(n%26)
+         cargm n
+         resto vinteseis
+         soma ch_a
+         trax
+         cargi SO_ESCR
+         chamas
+         cargm n
+         sub um
+         armm n
+         desvnz laco
+         ; morre
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um        valor 1
+vinteseis valor 26
+ch_a      valor 'a'
+n         espaco 1
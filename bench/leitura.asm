@@ -0,0 +1,28 @@
+; bench/leitura.asm
+; programa para medir o desempenho do simulador
+; muitas leituras do terminal, um caractere por chamada; a entrada vem do
+;   roteiro bench/leitura.rot, num ritmo fixo, e o processo fica bloqueado
+;   esperando cada caractere
+
+N        define 3050    ; número de caracteres lidos (todos os do roteiro)
+
+SO_LE          define 1
+SO_MATA_PROC   define 8
+
+         cargi N
+         armm n
+laco     cargi SO_LE
+         chamas
+         cargm n
+         sub um
+         armm n
+         desvnz laco
+         ; morre
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um        valor 1
+n         espaco 1
@@ -0,0 +1,49 @@
+; bench/misto.asm
+; programa para medir o desempenho do simulador
+; mistura: cria processos que calculam e processos que escrevem (e bloqueiam
+;   esperando o terminal), e espera todos morrerem
+
+SO_CRIA_PROC   define 7
+SO_MATA_PROC   define 8
+SO_ESPERA_PROC define 9
+
+         cargi calcula
+         trax
+         cargi SO_CRIA_PROC
+         chamas
+         armm pid1
+         cargi escreve
+         trax
+         cargi SO_CRIA_PROC
+         chamas
+         armm pid2
+         cargi calcula
+         trax
+         cargi SO_CRIA_PROC
+         chamas
+         armm pid3
+         ; espera os processos terminarem
+         cargm pid1
+         trax
+         cargi SO_ESPERA_PROC
+         chamas
+         cargm pid2
+         trax
+         cargi SO_ESPERA_PROC
+         chamas
+         cargm pid3
+         trax
+         cargi SO_ESPERA_PROC
+         chamas
+         ; morre
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+calcula  string 'bench/calcula.maq'
+escreve  string 'bench/escreve.maq'
+pid1     espaco 1
+pid2     espaco 1
+pid3     espaco 1
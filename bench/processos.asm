@@ -0,0 +1,33 @@
+; bench/processos.asm
+; programa para medir o desempenho do simulador
+; muitos processos de vida curta: cria um processo, espera ele morrer, repete
+
+N        define 5000  ; número de processos criados
+
+SO_CRIA_PROC   define 7
+SO_MATA_PROC   define 8
+SO_ESPERA_PROC define 9
+
+         cargi N
+         armm n
+laco     cargi prog
+         trax
+         cargi SO_CRIA_PROC
+         chamas
+         trax
+         cargi SO_ESPERA_PROC
+         chamas
+         cargm n
+         sub um
+         armm n
+         desvnz laco
+         ; morre
+         cargi 0
+         trax
+         cargi SO_MATA_PROC
+         chamas
+         para
+
+um       valor 1
+n        espaco 1
+prog     string 'bench/curto.maq'
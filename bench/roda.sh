@@ -0,0 +1,95 @@
+#!/bin/bash
+# bench/roda.sh
+# mede o desempenho do simulador com os programas de bench/
+# simulador de computador
+# so24b
+#
+# Executa cada programa como programa inicial, sem tela, até a máquina
+#   desligar (quando não sobra nenhum processo), com o simulador como foi
+#   compilado (chamado pelo "make bench", no diretório principal).
+# Junta as estatísticas de cada execução em bench/resultado.json, e compara
+#   com bench/referencia.json, se existir ("make bench-referencia" guarda o
+#   resultado atual como referência).
+# Se existir um bench/programa.rot, ele é usado como roteiro da entrada dos
+#   terminais (opção -r).
+# Os programas são executados só com as mensagens de erro e de aviso
+#   (comando L1); as de informação (uma por programa carregado, por exemplo)
+#   e as de depuração ficariam no log, e a medida seria também a da escrita
+#   dele. O teste do nível das mensagens desligadas continua sendo feito, a
+#   não ser que o simulador seja compilado com um LOG_NIVEL menor (ver
+#   console.h).
+# O código nativo gerado antes pelo tradutor (bench/*.so) não é usado: o
+#   simulador só o carrega com a opção -a, e a medida é a do interpretador.
+
+PROGRAMAS="cpu escrita processos misto leitura"
+RESULTADO=bench/resultado.json
+REFERENCIA=bench/referencia.json
+# variação (em %) a partir da qual uma diferença é destacada
+TOLERANCIA=10
+
+set -e
+
+comandos=$(mktemp)
+trap 'rm -f $comandos' EXIT
+printf 'L1\nC\nS\nF\n' > $comandos
+
+# executa os programas, juntando as estatísticas num objeto JSON por programa
+{
+  echo "{"
+  sep=""
+  for prog in $PROGRAMAS; do
+    roteiro=""
+    [ -f bench/$prog.rot ] && roteiro="-r bench/$prog.rot"
+    ./main -n $comandos -i bench/$prog.maq -e bench/$prog.json $roteiro > /dev/null
+    printf '%s  "%s": %s' "$sep" $prog "$(sed -e '1!s/^/  /' bench/$prog.json)"
+    rm -f bench/$prog.json
+    sep=$',\n'
+  done
+  echo
+  echo "}"
+} > $RESULTADO
+
+# mostra o resultado, comparando com a referência se tiver uma
+# as linhas dos arquivos são do tipo '    "chave": valor,' dentro de
+#   '  "programa": {'
+awk -v tol=$TOLERANCIA -v ref=$REFERENCIA '
+  function le(arq, vetor,    linha, prog, campos) {
+    while ((getline linha < arq) > 0) {
+      if (linha ~ /^  "[a-z_]+": \{/) {
+        split(linha, campos, "\"")
+        prog = campos[2]
+      } else if (linha ~ /^    "[a-z_]+": /) {
+        split(linha, campos, "\"")
+        sub(/^[^:]*: /, "", linha)
+        sub(/,$/, "", linha)
+        vetor[prog, campos[2]] = linha + 0
+      }
+    }
+    close(arq)
+  }
+  BEGIN {
+    tem_ref = (getline linha < ref) > 0
+    close(ref)
+    if (tem_ref) le(ref, r)
+  }
+  /^  "[a-z_]+": \{/ {
+    split($0, campos, "\"")
+    prog = campos[2]
+    printf "%s\n", prog
+  }
+  /^    "(mips|interrupcoes_por_s|fracao_no_so|rss_max_kb)": / {
+    split($0, campos, "\"")
+    chave = campos[2]
+    valor = $0
+    sub(/^[^:]*: /, "", valor)
+    sub(/,$/, "", valor)
+    valor += 0
+    printf "  %-20s %12.4g", chave, valor
+    if (tem_ref && (prog, chave) in r && r[prog, chave] != 0) {
+      var = 100 * (valor - r[prog, chave]) / r[prog, chave]
+      printf "   referência %12.4g  %+6.1f%%", r[prog, chave], var
+      if (var > tol || var < -tol) printf "  <--"
+    }
+    printf "\n"
+  }
+' $RESULTADO
@@ -8,12 +8,16 @@
 #include "console.h"
 #include "terminal.h"
 #include "tela.h"
+#include "escritor.h"
 
 #include <string.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 
 // CONSTANTES {{{1
@@ -39,30 +43,172 @@
 // números de comandos para o controlador que podem ser guardados na console
 #define N_CMD_EXT 10
 
+// número de vezes por segundo que a tela é redesenhada, se o operador não
+//   mudar (comando R)
+#define DESENHOS_POR_SEG 30
+
+// tempo máximo de espera pelo operador quando não tem nada a simular (ms)
+#define ESPERA_MAX_MS 5
+
+// intervalo entre leituras do teclado pela thread de desenho (ms)
+#define INTERVALO_TECLADO_MS 1
+
+// número de teclas que podem ficar esperando a simulação ler
+#define N_TECLAS 64
+
+// marca no índice do retrato do meio, se ele ainda não foi desenhado
+#define RETRATO_NOVO 4
+
+// tamanho máximo do nome de um arquivo da console (com o diretório)
+#define TAM_NOME 1024
+
+// tamanho máximo de uma linha do roteiro de entrada
+#define TAM_LINHA_ROTEIRO 1024
+
 // DECLARAÇÃO {{{1
 
+// Com tela, o desenho é feito por uma thread separada, para a simulação não
+//   parar esperando o curses. A simulação publica periodicamente um retrato
+//   do que deve aparecer na tela, usando 3 retratos: um em que a simulação
+//   escreve, um que a thread de desenho está desenhando, e um no meio, o
+//   último publicado. Publicar é trocar o retrato escrito pelo do meio, e a
+//   thread de desenho troca o seu pelo do meio quando ele é novo; as trocas
+//   são atômicas, e ninguém espera ninguém.
+// A thread de desenho também lê o teclado, e coloca as teclas numa fila
+//   circular com um produtor e um consumidor, sem trava, de onde a simulação
+//   as tira.
+
+// o que aparece na tela
+typedef struct {
+  char txt_terminal[N_TERM][2][N_COL+1]; // entrada e saída de cada terminal
+  char txt_status[N_COL+1];
+  char txt_console[N_LIN_CONSOLE][N_COL+1];
+  char txt_entrada[N_COL+1];
+  bool fim;                              // mostra o aviso de fim
+  unsigned versao_linha[N_LIN];          // ver console_t
+} retrato_t;
+
 struct console_t {
   terminal_t *term[N_TERM];
   int cor_txt[N_TERM];
   int cor_cursor[N_TERM];
   char txt_status[N_COL+1];
+  // as linhas da console formam um buffer circular; 'primeira_console' é o
+  //   índice da mais antiga, que é a de cima na tela, e a próxima a ser
+  //   substituída
   char txt_console[N_LIN_CONSOLE][N_COL+1];
+  int primeira_console;
   char txt_entrada[N_COL+1];
   char fila_de_comandos_externos[N_CMD_EXT];
-  FILE *arquivo_de_log;
+  // nível máximo das mensagens impressas, por categoria (comando L)
+  int nivel_log[N_LOG_CATEGORIAS];
+  // número de alterações de cada linha da tela; a thread de desenho só
+  //   redesenha as linhas cuja versão mudou desde o último desenho
+  unsigned versao_linha[N_LIN];
+  // o log_da_console, escrito em segundo plano
+  escritor_t *log;
+  eventos_t *eventos;
+  // false quando executa sem tela
+  bool com_tela;
+  // diretório dos arquivos da console (NULL para o corrente)
+  char *dir;
+  // sem tela, os comandos do operador vêm deste arquivo, e o que aparece na
+  //   console é copiado na saída padrão se 'ecoa'
+  FILE *comandos;
+  bool ecoa;
+  // cópia da saída de cada terminal, quando executa sem tela
+  FILE *copia_terminal[N_TERM];
+  // a entrada só é lida a partir desta hora (comando T)
+  int espera_ate;
+  // a entrada só é lida depois que a máquina desligar (comando S)
+  bool espera_desligar;
+  bool desligada;
+  // intervalo entre desenhos da tela, e hora do próximo (em ms de relógio
+  //   real); com intervalo 0, desenha a cada chamada a console_tictac
+  int intervalo_desenho;
+  long long proximo_desenho;
+  // os retratos para a thread de desenho; 'meio' tem o índice do último
+  //   publicado (com RETRATO_NOVO se a thread ainda não pegou), 'escrita' o
+  //   do que a simulação usa para publicar o próximo
+  retrato_t retratos[3];
+  atomic_uint meio;
+  int escrita;
+  // fila de teclas lidas pela thread de desenho
+  char teclas[N_TECLAS];
+  atomic_uint teclas_ini;
+  atomic_uint teclas_fim;
+  // tempo de espera do teclado (comando D), aplicado pela thread de desenho
+  atomic_int espera_teclado;
+  // para pedir para a thread de desenho terminar
+  atomic_bool termina_desenho;
+  pthread_t thread_desenho;
+  // roteiro de entrada dos terminais (ver console_define_roteiro); só a
+  //   próxima linha fica na memória, com um evento agendado para a sua hora
+  FILE *roteiro;
+  int num_linha_roteiro;
+  int intervalo_roteiro;
+  int quando_roteiro;
+  char terminal_roteiro;
+  char txt_roteiro[TAM_LINHA_ROTEIRO];
+  int evento_roteiro;
 };
 
 // CRIAÇÃO {{{1
 
-static console_t *console_global; // gambiarra para simplificar o uso de prints na console
-console_t *console_cria(void)
+static void console_inicia_desenho(console_t *self);
+static void console_termina_desenho(console_t *self);
+static void console_publica_retrato(console_t *self, bool fim);
+static char remove_tecla(console_t *self);
+static void dorme_ms(long long ms);
+
+// a console usada por console_printf e console_log: a última criada na
+//   thread (gambiarra para simplificar o uso de prints na console); cada
+//   thread que executa uma máquina tem a sua
+static _Thread_local console_t *console_global;
+
+// coloca em 'nome' o nome do arquivo 'arq' no diretório da console
+static void nome_no_dir(console_t *self, char *arq, int tam, char nome[tam])
+{
+  if (self->dir == NULL) {
+    snprintf(nome, tam, "%s", arq);
+  } else {
+    snprintf(nome, tam, "%s/%s", self->dir, arq);
+  }
+}
+
+console_t *console_cria(eventos_t *eventos, char *comandos, long tam_log,
+                        char *dir)
 {
   console_t *self = malloc(sizeof(*self));
   assert(self != NULL);
   console_global = self;
+  self->eventos = eventos;
+  self->com_tela = (comandos == NULL);
+  self->dir = (dir == NULL) ? NULL : strdup(dir);
+  self->comandos = NULL;
+  self->ecoa = (!self->com_tela && dir == NULL);
+  if (!self->com_tela) {
+    self->comandos = fopen(comandos, "r");
+    if (self->comandos == NULL) {
+      fprintf(stderr, "ERRO: não foi possível abrir '%s'\n", comandos);
+    }
+  }
+  self->espera_ate = 0;
+  self->espera_desligar = false;
+  self->desligada = false;
+  self->intervalo_desenho = 1000 / DESENHOS_POR_SEG;
+  self->proximo_desenho = 0;
+  atomic_init(&self->meio, 1);
+  self->escrita = 0;
+  atomic_init(&self->teclas_ini, 0);
+  atomic_init(&self->teclas_fim, 0);
+  atomic_init(&self->espera_teclado, 0);
+  atomic_init(&self->termina_desenho, false);
+  self->roteiro = NULL;
+  self->evento_roteiro = -1;
 
   for (int t = 0; t < N_TERM; t++) {
-    self->term[t] = terminal_cria(N_COL);
+    self->term[t] = terminal_cria(N_COL, eventos);
     if ((t % 2) == 0) {
       self->cor_txt[t] = COR_TXT_PAR;
       self->cor_cursor[t] = COR_CURSOR_PAR;
@@ -70,39 +216,72 @@ console_t *console_cria(void)
       self->cor_txt[t] = COR_TXT_IMPAR;
       self->cor_cursor[t] = COR_CURSOR_IMPAR;
     }
+    self->copia_terminal[t] = NULL;
+    if (!self->com_tela) {
+      char arq[] = "saida_do_terminal_?";
+      arq[strlen(arq) - 1] = 'A' + t;
+      char nome[TAM_NOME];
+      nome_no_dir(self, arq, sizeof(nome), nome);
+      self->copia_terminal[t] = fopen(nome, "w");
+      terminal_define_copia(self->term[t], self->copia_terminal[t]);
+    }
   }
   for (int l = 0; l < N_LIN_CONSOLE; l++) {
     strcpy(self->txt_console[l], "");
   }
+  self->primeira_console = 0;
+  for (int c = 0; c < N_LOG_CATEGORIAS; c++) {
+    self->nivel_log[c] = LOG_DEPURA;
+  }
   strcpy(self->txt_entrada, "");
+  strcpy(self->txt_status, "");
   self->fila_de_comandos_externos[0] = '\0';
-  self->arquivo_de_log = fopen("log_da_console", "w");
-
-  tela_init();
+  memset(self->versao_linha, 0, sizeof(self->versao_linha));
+  char nome[TAM_NOME];
+  nome_no_dir(self, "log_da_console", sizeof(nome), nome);
+  self->log = escritor_cria(nome, tam_log);
+
+  if (self->com_tela) {
+    tela_init();
+    console_inicia_desenho(self);
+  }
 
   return self;
 }
 
-static void console_desenha(console_t *self);
-
 void console_destroi(console_t *self)
 {
-  console_desenha(self);
-  if (self->arquivo_de_log != NULL) fclose(self->arquivo_de_log);
-  tela_puts(COR_OCUPADO, "  digite ENTER para sair  ");
-  tela_atualiza();
-  while (tela_tecla() != '\n') {
-    ;
+  if (self->evento_roteiro != -1) {
+    eventos_cancela(self->eventos, self->evento_roteiro);
+  }
+  if (self->roteiro != NULL) fclose(self->roteiro);
+  if (self->log != NULL) escritor_destroi(self->log);
+  if (self->com_tela) {
+    // mostra como ficou, com o aviso de fim, e espera o operador
+    console_publica_retrato(self, true);
+    while (remove_tecla(self) != '\n') {
+      dorme_ms(ESPERA_MAX_MS);
+    }
+    console_termina_desenho(self);
+    tela_fim();
   }
-  tela_fim();
+  if (self->comandos != NULL) fclose(self->comandos);
 
   for (int t = 0; t < N_TERM; t++) {
     terminal_destroi(self->term[t]);
+    if (self->copia_terminal[t] != NULL) fclose(self->copia_terminal[t]);
   }
+  if (console_global == self) console_global = NULL;
+  free(self->dir);
   free(self);
   return;
 }
 
+void console_usa_na_thread(console_t *self)
+{
+  console_global = self;
+}
+
 // TERMINAIS {{{1
 
 terminal_t *console_terminal(console_t *self, char id_terminal)
@@ -112,27 +291,124 @@ terminal_t *console_terminal(console_t *self, char id_terminal)
   return self->term[num_terminal];
 }
 
-static void atualiza_terminais(console_t *self)
-{
-  for (int t = 0; t < N_TERM; t++) {
-    terminal_tictac(self->term[t]);
-  }
-}
-
 static void insere_string_no_terminal(console_t *self, char id_terminal, char *str)
 {
-  // insere caracteres no terminal (e espaço no final)
+  // insere caracteres no terminal (e espaço no final), chegando agora
   terminal_t *terminal = console_terminal(self, id_terminal);
   if (terminal == NULL) {
     console_printf("Terminal '%c' inválido\n", id_terminal);
     return;
   }
+  int agora = eventos_agora(self->eventos);
   char *p = str;
   while (*p != '\0') {
-    terminal_insere_char(terminal, *p);
+    terminal_agenda_char(terminal, agora, *p);
     p++;
   }
-  terminal_insere_char(terminal, ' ');
+  terminal_agenda_char(terminal, agora, ' ');
+}
+
+// ROTEIRO {{{1
+
+// lê a próxima linha com texto do roteiro, e guarda em self a hora, o
+//   terminal e o texto; trata as linhas de intervalo
+// retorna false no final do arquivo
+static bool roteiro_le_linha(console_t *self)
+{
+  char linha[TAM_LINHA_ROTEIRO];
+  while (fgets(linha, sizeof(linha), self->roteiro) != NULL) {
+    self->num_linha_roteiro++;
+    char *fim = strchr(linha, '\n');
+    if (fim != NULL) {
+      *fim = '\0';
+    } else if (!feof(self->roteiro)) {
+      console_printf("Roteiro: linha %d muito longa", self->num_linha_roteiro);
+      int ch;
+      while ((ch = fgetc(self->roteiro)) != EOF && ch != '\n') continue;
+      continue;
+    }
+    char *p = linha;
+    while (isspace(*p)) p++;
+    if (*p == '\0' || *p == '#') continue;
+    int intervalo;
+    if (sscanf(p, "intervalo %d", &intervalo) == 1 && intervalo >= 0) {
+      self->intervalo_roteiro = intervalo;
+      continue;
+    }
+    // hora ('+' é relativa à linha anterior), terminal, texto
+    bool relativa = (*p == '+');
+    if (relativa) p++;
+    char *depois;
+    long quando = strtol(p, &depois, 10);
+    if (depois == p || *depois != ' ' || console_terminal(self, depois[1]) == NULL
+        || (depois[2] != ' ' && depois[2] != '\0')) {
+      console_printf("Roteiro: linha %d inválida", self->num_linha_roteiro);
+      continue;
+    }
+    if (relativa) quando += self->quando_roteiro;
+    self->quando_roteiro = quando;
+    self->terminal_roteiro = depois[1];
+    strcpy(self->txt_roteiro, depois[2] == '\0' ? "" : &depois[3]);
+    return true;
+  }
+  return false;
+}
+
+// coloca o texto da linha lida do roteiro no terminal, como o comando E
+//   (com espaço no final); com intervalo, os caracteres seguintes chegam
+//   espaçados no tempo
+static void roteiro_insere(console_t *self)
+{
+  terminal_t *terminal = console_terminal(self, self->terminal_roteiro);
+  int tam = strlen(self->txt_roteiro);
+  for (int i = 0; i <= tam; i++) {
+    char ch = (i < tam) ? self->txt_roteiro[i] : ' ';
+    if (i == 0 || self->intervalo_roteiro == 0) {
+      terminal_insere_char(terminal, ch);
+    } else {
+      int quando = eventos_agora(self->eventos) + i * self->intervalo_roteiro;
+      terminal_agenda_char(terminal, quando, ch);
+    }
+  }
+}
+
+static void roteiro_chegou_linha(void *arg, int dado);
+
+// insere as linhas do roteiro cuja hora já chegou, e agenda a próxima
+static void roteiro_avanca(console_t *self)
+{
+  int agora = eventos_agora(self->eventos);
+  while (roteiro_le_linha(self)) {
+    if (self->quando_roteiro > agora) {
+      self->evento_roteiro = eventos_agenda(self->eventos, self->quando_roteiro,
+                                            roteiro_chegou_linha, self, 0);
+      return;
+    }
+    roteiro_insere(self);
+  }
+  fclose(self->roteiro);
+  self->roteiro = NULL;
+}
+
+// evento da hora de uma linha do roteiro
+static void roteiro_chegou_linha(void *arg, int dado)
+{
+  console_t *self = arg;
+  self->evento_roteiro = -1;
+  roteiro_insere(self);
+  roteiro_avanca(self);
+}
+
+bool console_define_roteiro(console_t *self, char *nome)
+{
+  assert(self->roteiro == NULL);
+  self->roteiro = fopen(nome, "r");
+  if (self->roteiro == NULL) return false;
+  self->num_linha_roteiro = 0;
+  self->intervalo_roteiro = 0;
+  self->quando_roteiro = 0;
+  roteiro_avanca(self);
+  return true;
 }
 
 static void limpa_saida_do_terminal(console_t *self, char id_terminal)
@@ -147,16 +423,28 @@ static void limpa_saida_do_terminal(console_t *self, char id_terminal)
 
 // SAÍDA {{{1
 
+// registra que a linha 'lin' da tela foi alterada
+static void marca_linha(console_t *self, int lin)
+{
+  self->versao_linha[lin]++;
+}
+
 static void insere_string_na_console(console_t *self, char *s)
 {
-  for(int l=0; l<N_LIN_CONSOLE-1; l++) {
-    strncpy(self->txt_console[l], self->txt_console[l+1], N_COL);
-    self->txt_console[l][N_COL] = '\0'; // quem definiu strncpy é estúpido!
+  // a nova linha substitui a mais antiga, que passa a ser a última
+  char *linha = self->txt_console[self->primeira_console];
+  strncpy(linha, s, N_COL);
+  linha[N_COL] = '\0'; // quem definiu strncpy é estúpido!
+  self->primeira_console = (self->primeira_console + 1) % N_LIN_CONSOLE;
+  // todas as linhas da console andaram
+  for (int l = 0; l < N_LIN_CONSOLE; l++) {
+    marca_linha(self, LINHA_CONSOLE + l);
+  }
+  if (self->log != NULL) {
+    escritor_linha(self->log, s);
   }
-  strncpy(self->txt_console[N_LIN_CONSOLE-1], s, N_COL);
-  self->txt_console[N_LIN_CONSOLE-1][N_COL] = '\0'; // grrrr
-  if (self->arquivo_de_log != NULL) {
-    fprintf(self->arquivo_de_log, "%s\n", s);
+  if (self->ecoa) {
+    printf("%s\n", s);
   }
 }
 
@@ -178,7 +466,19 @@ static void insere_strings_na_console(console_t *self, char *s)
 void console_print_status(console_t *self, char *txt)
 {
   // imprime alinhado a esquerda ("-"), max N_COL chars ("*")
-  sprintf(self->txt_status, "%-*s", N_COL, txt);
+  char status[N_COL+1];
+  snprintf(status, sizeof(status), "%-*s", N_COL, txt);
+  if (strcmp(status, self->txt_status) == 0) return;
+  strcpy(self->txt_status, status);
+  marca_linha(self, LINHA_STATUS);
+}
+
+static int console_vprintf(console_t *self, char *formato, va_list arg)
+{
+  char s[sizeof(self->txt_console)];
+  int r = vsnprintf(s, sizeof(s), formato, arg);
+  insere_strings_na_console(self, s);
+  return r;
 }
 
 int console_printf(char *formato, ...)
@@ -187,14 +487,35 @@ int console_printf(char *formato, ...)
   // Se não sabe como é isso, dá uma olhada em:
   // https://www.geeksforgeeks.org/variadic-functions-in-c/
   console_t *self = console_global; // gambiarra para simplificar o uso de prints na console
-  char s[sizeof(self->txt_console)];
   va_list arg;
   va_start(arg, formato);
-  int r = vsnprintf(s, sizeof(s), formato, arg);
-  insere_strings_na_console(self, s);
+  int r = console_vprintf(self, formato, arg);
+  va_end(arg);
   return r;
 }
 
+int console_log(int nivel, log_categoria_t cat, char *formato, ...)
+{
+  console_t *self = console_global;
+  // o filtro vem antes da formatação, que é a parte cara
+  if (nivel > self->nivel_log[cat]) return 0;
+  va_list arg;
+  va_start(arg, formato);
+  int r = console_vprintf(self, formato, arg);
+  va_end(arg);
+  return r;
+}
+
+bool console_log_ativo(int nivel, log_categoria_t cat)
+{
+  return nivel <= console_global->nivel_log[cat];
+}
+
+void console_define_nivel(console_t *self, log_categoria_t cat, int nivel)
+{
+  self->nivel_log[cat] = nivel;
+}
+
 // ENTRADA {{{1
 
 static void insere_comando_externo(console_t *self, char c)
@@ -216,6 +537,28 @@ static char remove_comando_externo(console_t *self)
   return cmd;
 }
 
+// altera o nível das mensagens, conforme o comando L ("n" ou "cn")
+static void altera_nivel_log(console_t *self, char *arg)
+{
+  static const struct { char letra; log_categoria_t cat; } categorias[] = {
+    { 'S', LOG_SO },
+    { 'C', LOG_CPU },
+  };
+  if (isdigit(arg[0])) {
+    for (int c = 0; c < N_LOG_CATEGORIAS; c++) {
+      console_define_nivel(self, c, atoi(arg));
+    }
+    return;
+  }
+  for (int i = 0; i < sizeof(categorias) / sizeof(categorias[0]); i++) {
+    if (toupper(arg[0]) == categorias[i].letra) {
+      console_define_nivel(self, categorias[i].cat, atoi(&arg[1]));
+      return;
+    }
+  }
+  console_printf("Categoria '%c' não reconhecida", arg[0]);
+}
+
 static void interpreta_linha_entrada(console_t *self)
 {
   // interpreta uma linha digitada pelo operador
@@ -223,6 +566,11 @@ static void interpreta_linha_entrada(console_t *self)
   // Etstr entra a string 'str' no terminal 't'  ex: eb30
   // Zt    esvazia a saída do terminal 't'  ex: za
   // Dn    altera o tempo de espera do teclado  ex: d0  -> modo turbo
+  // Tn    só lê o próximo comando quando o relógio chegar em n  ex: t50000
+  // S     só lê o próximo comando quando a máquina desligar
+  // Rn    redesenha a tela n vezes por segundo  ex: r10 (r0 -> sempre)
+  // Ln    só imprime mensagens até o nível n  ex: l1 -> só erros e avisos
+  // Lcn   idem, só para a categoria 'c' (S: SO, C: CPU)  ex: ls3
   // P     para a execução
   // 1     executa uma instrução
   // C     continua a execução
@@ -241,7 +589,21 @@ static void interpreta_linha_entrada(console_t *self)
       break;
     case 'D':
       val = atoi(&linha[1]);
-      tela_espera(val);
+      atomic_store(&self->espera_teclado, val);
+      break;
+    case 'T':
+      self->espera_ate = atoi(&linha[1]);
+      break;
+    case 'S':
+      self->espera_desligar = true;
+      break;
+    case 'R':
+      val = atoi(&linha[1]);
+      self->intervalo_desenho = (val > 0) ? 1000 / val : 0;
+      self->proximo_desenho = 0;
+      break;
+    case 'L':
+      altera_nivel_log(self, &linha[1]);
       break;
     case 'P':
     case '1':
@@ -253,24 +615,65 @@ static void interpreta_linha_entrada(console_t *self)
       console_printf("Comando '%c' não reconhecido", cmd);
   }
   strcpy(self->txt_entrada, "");
+  marca_linha(self, LINHA_ENTRADA);
+}
+
+// coloca uma tecla na fila (chamada pela thread de desenho)
+// se a fila estiver cheia, a tecla é perdida
+static void insere_tecla(console_t *self, char ch)
+{
+  unsigned fim = atomic_load_explicit(&self->teclas_fim, memory_order_relaxed);
+  unsigned ini = atomic_load_explicit(&self->teclas_ini, memory_order_acquire);
+  if (fim - ini >= N_TECLAS) return;
+  self->teclas[fim % N_TECLAS] = ch;
+  atomic_store_explicit(&self->teclas_fim, fim + 1, memory_order_release);
+}
+
+// tira uma tecla da fila (chamada pela simulação); retorna 0 se não tem
+static char remove_tecla(console_t *self)
+{
+  unsigned ini = atomic_load_explicit(&self->teclas_ini, memory_order_relaxed);
+  unsigned fim = atomic_load_explicit(&self->teclas_fim, memory_order_acquire);
+  if (ini == fim) return 0;
+  char ch = self->teclas[ini % N_TECLAS];
+  atomic_store_explicit(&self->teclas_ini, ini + 1, memory_order_release);
+  return ch;
+}
+
+// retorna o próximo caractere do arquivo de comandos, ou 0 se acabou
+static char le_comando(console_t *self)
+{
+  if (self->comandos == NULL) return 0;
+  int ch = getc(self->comandos);
+  if (ch == EOF) return 0;
+  return ch;
 }
 
 // lê e guarda um caractere do teclado; interpreta linha se for 'enter'
+// com tela, o caractere vem da fila preenchida pela thread de desenho; sem
+//   tela, é lido diretamente (do arquivo de comandos)
 static void verifica_entrada(console_t *self)
 {
-  char ch = tela_tecla();
+  // esperando o relógio (comando T), deixa a tecla para depois
+  if (eventos_agora(self->eventos) < self->espera_ate) return;
+  // esperando a máquina desligar (comando S), idem
+  if (self->espera_desligar && !self->desligada) return;
+  self->espera_desligar = false;
+  char ch = self->com_tela ? remove_tecla(self) : le_comando(self);
 
   int l = strlen(self->txt_entrada);
 
   if (ch == '\b' || ch == 127) {   // backspace ou del
     if (l > 0) {
       self->txt_entrada[l - 1] = '\0';
+      marca_linha(self, LINHA_ENTRADA);
     }
   } else if (ch == '\n') {
     interpreta_linha_entrada(self);
   } else if (ch >= ' ' && ch < 127 && l < N_COL) {
     self->txt_entrada[l] = ch;
     self->txt_entrada[l+1] = '\0';
+    marca_linha(self, LINHA_ENTRADA);
   } // senão, ignora o caractere digitado
 }
 
@@ -290,35 +693,29 @@ static void desenha_linha_terminal(char *txt, int linha, int cor_txt, int cor_cu
   tela_puts(cor_cursor, " ");
 }
 
-static void desenha_terminais(console_t *self)
+static void desenha_terminal(console_t *self, retrato_t *r, int lin)
 {
-  for (int t = 0; t < N_TERM; t++) {
-    terminal_t *terminal = self->term[t];
-    int cor_txt = self->cor_txt[t];
-    int cor_cursor = self->cor_cursor[t];
-    int linha = LINHA_TERM + t * 2;
-    desenha_linha_terminal(terminal_txt_entrada(terminal), linha, cor_txt, cor_cursor);
-    desenha_linha_terminal(terminal_txt_saida(terminal), linha+1, cor_txt, cor_cursor);
-  }
+  int t = (lin - LINHA_TERM) / 2;
+  int es = (lin - LINHA_TERM) % 2;  // 0 entrada, 1 saída
+  desenha_linha_terminal(r->txt_terminal[t][es], lin,
+                         self->cor_txt[t], self->cor_cursor[t]);
 }
 
-static void desenha_status(console_t *self)
+static void desenha_status(retrato_t *r)
 {
   tela_posiciona(LINHA_STATUS, 0);
-  tela_puts(COR_STATUS, self->txt_status);
+  tela_puts(COR_STATUS, r->txt_status);
   tela_limpa_linha();
 }
 
-static void desenha_console(console_t *self)
+static void desenha_console(retrato_t *r, int lin)
 {
-  for (int l=0; l<N_LIN_CONSOLE; l++) {
-    tela_posiciona(LINHA_CONSOLE + l, 0);
-    tela_puts(COR_CONSOLE, self->txt_console[l]);
-    tela_limpa_linha();
-  }
+  tela_posiciona(lin, 0);
+  tela_puts(COR_CONSOLE, r->txt_console[lin - LINHA_CONSOLE]);
+  tela_limpa_linha();
 }
 
-static void desenha_entrada(console_t *self)
+static void desenha_entrada(retrato_t *r)
 {
   char txt_fixo[] = "P=para C=continua 1=passo F=fim  Ets=entra Zt=zera";
   tela_posiciona(LINHA_ENTRADA, 0);
@@ -327,26 +724,164 @@ static void desenha_entrada(console_t *self)
   tela_posiciona(LINHA_ENTRADA, N_COL - sizeof(txt_fixo));
   tela_puts(COR_ENTRADA, txt_fixo);
   tela_posiciona(LINHA_ENTRADA, 0);
-  tela_puts(COR_ENTRADA, self->txt_entrada);
+  tela_puts(COR_ENTRADA, r->txt_entrada);
+  if (r->fim) tela_puts(COR_OCUPADO, "  digite ENTER para sair  ");
 }
 
-static void console_desenha(console_t *self)
+// desenha as linhas do retrato que mudaram desde o último desenho, cujas
+//   versões estão em 'desenhada'
+static void console_desenha(console_t *self, retrato_t *r, unsigned desenhada[N_LIN])
 {
-  desenha_terminais(self);
-  desenha_status(self);
-  desenha_console(self);
-  desenha_entrada(self);
+  bool desenhou = false;
+  for (int lin = 0; lin < N_LIN; lin++) {
+    if (r->versao_linha[lin] == desenhada[lin]) continue;
+    desenhada[lin] = r->versao_linha[lin];
+    desenhou = true;
+    if (lin < LINHA_STATUS) {
+      desenha_terminal(self, r, lin);
+    } else if (lin == LINHA_STATUS) {
+      desenha_status(r);
+    } else if (lin < LINHA_ENTRADA) {
+      desenha_console(r, lin);
+    } else {
+      desenha_entrada(r);
+    }
+  }
 
   // faz aparecer tudo que foi desenhado
-  tela_atualiza();
+  if (desenhou) tela_atualiza();
+}
+
+// THREAD DE DESENHO {{{1
+
+// copia o estado atual da console para um retrato, e o publica (chamada
+//   pela simulação)
+static void console_publica_retrato(console_t *self, bool fim)
+{
+  retrato_t *r = &self->retratos[self->escrita];
+  for (int t = 0; t < N_TERM; t++) {
+    if (terminal_alterado(self->term[t])) {
+      marca_linha(self, LINHA_TERM + t * 2);
+      marca_linha(self, LINHA_TERM + t * 2 + 1);
+    }
+    strcpy(r->txt_terminal[t][0], terminal_txt_entrada(self->term[t]));
+    strcpy(r->txt_terminal[t][1], terminal_txt_saida(self->term[t]));
+  }
+  memcpy(r->txt_status, self->txt_status, sizeof(r->txt_status));
+  // no retrato, as linhas da console ficam na ordem da tela
+  for (int l = 0; l < N_LIN_CONSOLE; l++) {
+    int i = (self->primeira_console + l) % N_LIN_CONSOLE;
+    memcpy(r->txt_console[l], self->txt_console[i], N_COL+1);
+  }
+  memcpy(r->txt_entrada, self->txt_entrada, sizeof(r->txt_entrada));
+  if (fim) marca_linha(self, LINHA_ENTRADA);
+  r->fim = fim;
+  memcpy(r->versao_linha, self->versao_linha, sizeof(r->versao_linha));
+  unsigned antigo = atomic_exchange_explicit(&self->meio,
+                                             self->escrita | RETRATO_NOVO,
+                                             memory_order_acq_rel);
+  self->escrita = antigo & ~RETRATO_NOVO;
+}
+
+// troca o retrato '*pleitura' da thread de desenho pelo último publicado, se
+//   tiver um novo
+// retorna false se não tem retrato novo
+static bool console_pega_retrato(console_t *self, int *pleitura)
+{
+  if ((atomic_load_explicit(&self->meio, memory_order_relaxed) & RETRATO_NOVO) == 0) {
+    return false;
+  }
+  unsigned novo = atomic_exchange_explicit(&self->meio, *pleitura,
+                                           memory_order_acq_rel);
+  *pleitura = novo & ~RETRATO_NOVO;
+  return true;
+}
+
+static void *console_laco_desenho(void *arg)
+{
+  console_t *self = arg;
+  int leitura = 2;  // o retrato com a thread de desenho
+  int espera = 0;
+  // versão de cada linha que está na tela; começa diferente de todas
+  unsigned desenhada[N_LIN];
+  for (int lin = 0; lin < N_LIN; lin++) desenhada[lin] = ~0u;
+  while (!atomic_load(&self->termina_desenho)) {
+    int nova_espera = atomic_load(&self->espera_teclado);
+    if (nova_espera != espera) {
+      espera = nova_espera;
+      tela_espera(espera);
+    }
+    char ch;
+    while ((ch = tela_tecla()) != 0) {
+      insere_tecla(self, ch);
+    }
+    if (console_pega_retrato(self, &leitura)) {
+      console_desenha(self, &self->retratos[leitura], desenhada);
+    }
+    // com espera no teclado, tela_tecla já esperou
+    if (espera == 0) dorme_ms(INTERVALO_TECLADO_MS);
+  }
+  return NULL;
+}
+
+static void console_inicia_desenho(console_t *self)
+{
+  console_publica_retrato(self, false);
+  int err = pthread_create(&self->thread_desenho, NULL, console_laco_desenho, self);
+  assert(err == 0);
+}
+
+static void console_termina_desenho(console_t *self)
+{
+  atomic_store(&self->termina_desenho, true);
+  pthread_join(self->thread_desenho, NULL);
 }
 
 // TICTAC {{{1
+
+static void dorme_ms(long long ms)
+{
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+  nanosleep(&ts, NULL);
+}
+
+// retorna a hora do relógio real, em ms
+static long long agora_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+void console_informa_desligada(console_t *self, bool desligada)
+{
+  self->desligada = desligada;
+}
+
+bool console_hora_de_desenhar(console_t *self)
+{
+  if (!self->com_tela) return false;
+  return agora_ms() >= self->proximo_desenho;
+}
+
 void console_tictac(console_t *self)
 {
   verifica_entrada(self);
-  atualiza_terminais(self);
-  console_desenha(self);
+  if (console_hora_de_desenhar(self)) {
+    console_publica_retrato(self, false);
+    self->proximo_desenho = agora_ms() + self->intervalo_desenho;
+  }
+}
+
+void console_espera(console_t *self)
+{
+  long long espera = ESPERA_MAX_MS;
+  if (self->com_tela) {
+    long long ate_desenho = self->proximo_desenho - agora_ms();
+    if (ate_desenho < espera) espera = ate_desenho;
+  }
+  if (espera <= 0) return;
+  dorme_ms(espera);
 }
 
 // vim: foldmethod=marker
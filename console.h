@@ -8,18 +8,122 @@
 
 #include <stdbool.h>
 #include "terminal.h"
+#include "eventos.h"
 
 typedef struct console_t console_t;
 
 // cria e inicializa a console
-console_t *console_cria(void);
+// os terminais usam a fila de eventos para saber a hora
+// se 'comandos' não for NULL, a console funciona sem tela: não desenha nada,
+//   lê o que o operador digitaria do arquivo 'comandos', escreve o que
+//   aparece na console na saída padrão, e copia a saída de cada terminal
+//   para um arquivo ("saida_do_terminal_A", etc)
+// o que aparece na console é também copiado para o arquivo "log_da_console",
+//   que é rodado (ver escritor.h) a cada 'tam_log' bytes, se não for 0
+// se 'dir' não for NULL, os arquivos da console são criados nesse diretório
+//   (que já deve existir), e a console sem tela não é copiada na saída
+//   padrão (só no log)
+// console_printf e console_log usam a última console criada pela thread
+//   que as chama; para executar várias máquinas ao mesmo tempo, cada uma
+//   deve estar na sua thread, e só uma pode ter tela
+console_t *console_cria(eventos_t *eventos, char *comandos, long tam_log,
+                        char *dir);
 
 // destrói a console
 void console_destroi(console_t *self);
 
+// faz console_printf e console_log usarem esta console na thread que chama
+//   (para as threads auxiliares de uma máquina)
+void console_usa_na_thread(console_t *self);
+
+// faz a entrada dos terminais seguir o roteiro no arquivo 'nome', na hora
+//   do relógio simulado (sem depender do ritmo do tempo real)
+// cada linha do roteiro é do tipo "hora terminal texto", e coloca o texto
+//   (com um espaço no final, como o comando E) na entrada do terminal
+//   ('A', 'B', etc) quando o relógio chegar na hora; se a hora começar com
+//   '+', é contada a partir da hora da linha anterior. As horas devem ser
+//   crescentes (uma hora que já passou vale como agora).
+// uma linha "intervalo n" faz os caracteres das linhas seguintes chegarem
+//   um a cada 'n' instantes, em vez de todos juntos (intervalo 0)
+// linhas vazias ou começando com '#' são ignoradas
+// o arquivo é lido aos poucos, durante a execução
+// retorna false se não conseguir abrir o arquivo
+bool console_define_roteiro(console_t *self, char *nome);
+
 // imprime na área geral do console
 int console_printf(char *fmt, ...);
 
+// MENSAGENS COM NÍVEL {{{1
+// As mensagens de depuração dos subsistemas têm um nível de importância e
+//   uma categoria. Os níveis acima de LOG_NIVEL_MAX são eliminados na
+//   compilação (nem os argumentos são avaliados); os outros podem ser
+//   filtrados durante a execução, por categoria, com o comando L da console.
+// LOG_NIVEL_MAX pode ser escolhido na compilação ("make LOG_NIVEL=LOG_INFO",
+//   depois de um "make clean").
+
+// níveis das mensagens, do mais para o menos importante (LOG_NENHUM, como
+//   nível escolhido, desliga todas)
+#define LOG_NENHUM (-1)
+#define LOG_ERRO   0
+#define LOG_AVISO  1
+#define LOG_INFO   2
+#define LOG_DEPURA 3
+
+#ifndef LOG_NIVEL_MAX
+#define LOG_NIVEL_MAX LOG_DEPURA
+#endif
+
+// categorias das mensagens (o subsistema que gera)
+typedef enum {
+  LOG_SO,
+  LOG_CPU,
+  N_LOG_CATEGORIAS
+} log_categoria_t;
+
+// imprime na área geral do console, se o nível da mensagem não for maior que
+//   o nível escolhido para a categoria (não formata a mensagem se não for
+//   imprimir)
+// em geral, é melhor usar as macros abaixo
+int console_log(int nivel, log_categoria_t cat, char *fmt, ...);
+
+// altera o nível máximo das mensagens da categoria que são impressas
+//   (inicialmente LOG_DEPURA, todas)
+void console_define_nivel(console_t *self, log_categoria_t cat, int nivel);
+
+// retorna true se as mensagens do nível e categoria estão sendo impressas,
+//   para quem precisa de trabalho extra para produzi-las
+// em geral, é melhor usar a macro log_ativo, que é sempre false para os
+//   níveis eliminados na compilação
+bool console_log_ativo(int nivel, log_categoria_t cat);
+#define log_ativo(nivel, cat) \
+  ((nivel) <= LOG_NIVEL_MAX && console_log_ativo(nivel, cat))
+
+// uma mensagem eliminada não é compilada, mas os argumentos continuam sendo
+//   usados (não geram avisos de variável não usada)
+#define LOG_ELIMINADO(cat, ...) \
+  do { if (0) console_log(LOG_NENHUM, cat, __VA_ARGS__); } while (0)
+
+#if LOG_NIVEL_MAX >= LOG_ERRO
+#define log_erro(cat, ...) console_log(LOG_ERRO, cat, __VA_ARGS__)
+#else
+#define log_erro(cat, ...) LOG_ELIMINADO(cat, __VA_ARGS__)
+#endif
+#if LOG_NIVEL_MAX >= LOG_AVISO
+#define log_aviso(cat, ...) console_log(LOG_AVISO, cat, __VA_ARGS__)
+#else
+#define log_aviso(cat, ...) LOG_ELIMINADO(cat, __VA_ARGS__)
+#endif
+#if LOG_NIVEL_MAX >= LOG_INFO
+#define log_info(cat, ...) console_log(LOG_INFO, cat, __VA_ARGS__)
+#else
+#define log_info(cat, ...) LOG_ELIMINADO(cat, __VA_ARGS__)
+#endif
+#if LOG_NIVEL_MAX >= LOG_DEPURA
+#define log_depura(cat, ...) console_log(LOG_DEPURA, cat, __VA_ARGS__)
+#else
+#define log_depura(cat, ...) LOG_ELIMINADO(cat, __VA_ARGS__)
+#endif
+
 // imprime na linha de status
 void console_print_status(console_t *self, char *txt);
 
@@ -31,13 +135,37 @@ void console_print_status(console_t *self, char *txt);
 //   '1': executa uma instrução,
 //   'C': continua a execução,
 //   'F': finaliza a simulação.
+// com o comando L, o operador escolhe o nível das mensagens que são impressas
+//   ("L2" para todas as categorias, "LS1" só para o SO, "LC3" só para a CPU)
+// com o comando T, o operador pode fazer a console esperar o relógio chegar
+//   numa hora antes de ler o próximo comando (útil num arquivo de comandos),
+//   e com o comando S, esperar a máquina desligar (ver abaixo)
 // retorna '\0' caso não tenha comando externo digitado
 char console_comando_externo(console_t *self);
 
+// o controlador informa se a máquina está desligada: a CPU está parada e não
+//   tem mais nenhum evento que possa interrompê-la (o SO não tem mais o que
+//   executar)
+void console_informa_desligada(console_t *self, bool desligada);
+
 // retorna o terminal identificado ('A', 'B', etc)
 terminal_t *console_terminal(console_t *self, char id_terminal);
 
 // esta função deve ser chamada periodicamente para que tela funcione
+//   (trata o que foi digitado e atualiza o que deve aparecer na tela)
+// o desenho da tela e a leitura do teclado são feitos por uma thread da
+//   console; esta função atualiza o que a thread desenha num ritmo fixo de
+//   relógio real (30 vezes por segundo, ou o que o operador escolher com o
+//   comando R), não a cada chamada
 void console_tictac(console_t *self);
 
+// retorna true se a próxima chamada a console_tictac vai redesenhar a tela
+//   (para quem fornece o texto da linha de status só fazer isso quando ele
+//   vai aparecer)
+bool console_hora_de_desenhar(console_t *self);
+
+// espera um pouco (até 5ms, ou o próximo desenho da tela); para ser chamada
+//   quando não há nada a simular, em vez de ocupar a CPU esperando o operador
+void console_espera(console_t *self);
+
 #endif // CONSOLE_H
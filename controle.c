@@ -8,66 +8,356 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 
-struct controle_t {
+// número máximo de instruções em um lote, quando não há evento programado
+//   para antes (limita o tempo sem atender a console)
+#define MAX_INSTR_LOTE 1000
+
+// uma das CPUs controladas
+typedef struct {
+  controle_t *controle;
   cpu_t *cpu;
+  // true enquanto o timer da CPU está pedindo interrupção
+  bool irq_relogio;
+  // true quando outra CPU pediu interrupção e esta ainda não aceitou
+  atomic_bool irq_ipi;
+  // número de instruções executadas pela CPU
+  long long n_instrucoes;
+  pthread_t thread;
+} controle_cpu_t;
+
+struct controle_t {
+  controle_cpu_t cpus[MAX_CPUS];
+  int n_cpus;
   relogio_t *relogio;
   console_t *console;
+  eventos_t *eventos;
   enum { executando, passo, parado, fim } estado;
+  // em modo paralelo, as CPUs 1 em diante executam cada uma na sua thread;
+  //   todas (com a 0, na thread do controle) se encontram na barreira no
+  //   início e no fim de cada janela
+  bool paralelo;
+  bool tem_threads;
+  pthread_barrier_t barreira;
+  // tamanho da janela atual; diminui se durante a janela for agendado um
+  //   evento para antes do fim dela
+  atomic_int fim_janela;
+  // se as threads devem terminar (só é alterado com as threads das CPUs
+  //   esperando na barreira)
+  bool termina;
 };
 
 // funções auxiliares
+static int controle_executa_lote(controle_t *self);
+static void controle_executa_janela(controle_t *self);
+static void controle_termina_threads(controle_t *self);
 static void controle_processa_comandos_da_console(controle_t *self);
 static void controle_atualiza_estado_na_console(controle_t *self);
+static void controle_muda_irq_relogio(void *arg, int cpu, bool pedindo);
+static void controle_evento_agendado(void *arg, int quando);
 
 
-controle_t *controle_cria(cpu_t *cpu, console_t *console, relogio_t *relogio)
+controle_t *controle_cria(cpu_t *cpu, console_t *console, relogio_t *relogio,
+                          eventos_t *eventos)
 {
   controle_t *self = malloc(sizeof(*self));
   assert(self != NULL);
 
-  self->cpu = cpu;
+  self->n_cpus = 0;
   self->console = console;
   self->relogio = relogio;
+  self->eventos = eventos;
   self->estado = parado;
+  self->paralelo = false;
+  self->tem_threads = false;
+  atomic_init(&self->fim_janela, 0);
+  controle_adiciona_cpu(self, cpu);
+  relogio_define_interrupcao(relogio, controle_muda_irq_relogio, self);
 
   return self;
 }
 
 void controle_destroi(controle_t *self)
 {
+  controle_termina_threads(self);
   free(self);
 }
 
+int controle_adiciona_cpu(controle_t *self, cpu_t *cpu)
+{
+  assert(self->n_cpus < MAX_CPUS);
+  controle_cpu_t *c = &self->cpus[self->n_cpus];
+  c->controle = self;
+  c->cpu = cpu;
+  c->irq_relogio = false;
+  atomic_init(&c->irq_ipi, false);
+  c->n_instrucoes = 0;
+  // com mais de uma CPU, a simulação é em janelas (ver controle.h)
+  if (self->n_cpus == 1) {
+    eventos_define_aviso(self->eventos, controle_evento_agendado, self);
+  }
+  return self->n_cpus++;
+}
+
+void controle_define_paralelo(controle_t *self, bool paralelo)
+{
+  self->paralelo = paralelo;
+}
+
 void controle_laco(controle_t *self)
 {
-  // executa uma instrução por vez até a console dizer que chega
+  // executa um lote de instruções por vez até a console dizer que chega
+  // com a execução parada pelo operador, o tempo simulado não passa
   do {
     if (self->estado == passo || self->estado == executando) {
-      cpu_executa_1(self->cpu);
-      relogio_tictac(self->relogio);
-
-      if (self->estado == passo) self->estado = parado;
+      if (self->n_cpus == 1) {
+        controle_executa_lote(self);
 
-      // enquanto não tem controlador de interrupção, fala direto com o relógio
-      // o dispositivo 3 do relógio contém 1 se o timer expirou
-      int tem_int;
-      relogio_leitura(self->relogio, 3, &tem_int);
-      if (tem_int != 0) {
-        cpu_interrompe(self->cpu, IRQ_RELOGIO);
+        // enquanto o relógio pede interrupção, tenta interromper a CPU
+        if (self->cpus[0].irq_relogio) {
+          cpu_interrompe(self->cpus[0].cpu, IRQ_RELOGIO);
+        }
+      } else {
+        // com várias CPUs, as interrupções são entregues durante a janela
+        controle_executa_janela(self);
       }
+
+      if (self->estado == passo) self->estado = parado;
+    }
+    controle_processa_comandos_da_console(self);
+    // a descrição do estado só é montada quando a tela vai ser redesenhada
+    if (console_hora_de_desenhar(self->console)) {
+      controle_atualiza_estado_na_console(self);
     }
     console_tictac(self->console);
 
-    controle_processa_comandos_da_console(self);
-    controle_atualiza_estado_na_console(self);
+    // parado, não tem o que simular; não fica girando esperando o operador
+    if (self->estado == parado) console_espera(self->console);
   } while (self->estado != fim);
+  controle_atualiza_estado_na_console(self);
 
   console_printf("Fim da execução.");
   console_printf("relógio: %d\n", relogio_agora(self->relogio));
 }
- 
+
+// o relógio avisa quando muda o pedido de interrupção do timer de uma CPU
+static void controle_muda_irq_relogio(void *arg, int cpu, bool pedindo)
+{
+  controle_t *self = arg;
+  if (cpu >= self->n_cpus) return;
+  self->cpus[cpu].irq_relogio = pedindo;
+}
+
+err_t controle_escrita_ipi(void *disp, int id, int valor)
+{
+  controle_t *self = disp;
+  if (valor < 0 || valor >= self->n_cpus) return ERR_OP_INV;
+  atomic_store(&self->cpus[valor].irq_ipi, true);
+  return ERR_OK;
+}
+
+// calcula quantas instruções podem ser executadas no próximo lote: as que
+//   faltam para o próximo evento dos dispositivos, para que ele aconteça
+//   (e a interrupção do timer, se for o caso) exatamente depois da mesma
+//   instrução que aconteceria executando uma instrução por vez
+static int controle_instrucoes_ate_evento(controle_t *self)
+{
+  if (self->estado == passo) return 1;
+  // se tem interrupção pendente que a CPU ainda não aceitou, tenta de novo
+  //   depois de cada instrução
+  if (self->cpus[0].irq_relogio) return 1;
+  int t_ate_evento = eventos_tempo_ate_proximo(self->eventos);
+  if (t_ate_evento == 0 || t_ate_evento > MAX_INSTR_LOTE) return MAX_INSTR_LOTE;
+  return t_ate_evento;
+}
+
+// calcula quanto tempo pode passar de uma vez com a CPU parada esperando
+//   interrupção: até o próximo evento dos dispositivos. Antes disso nada
+//   muda no estado da CPU nem dos dispositivos.
+static int controle_tempo_ocioso(controle_t *self)
+{
+  if (self->cpus[0].irq_relogio) return 1;
+  int t_ate_evento = eventos_tempo_ate_proximo(self->eventos);
+  if (t_ate_evento > 0) return t_ate_evento;
+  // não tem evento previsto; só o operador pode mudar algo
+  return 1;
+}
+
+// executa um lote de instruções e faz o tempo avançar de acordo, executando
+//   os eventos dos dispositivos que acontecem nesse período
+// retorna quanto tempo passou
+static int controle_executa_lote(controle_t *self)
+{
+  controle_cpu_t *c = &self->cpus[0];
+  int n = controle_instrucoes_ate_evento(self);
+  int tempo = cpu_executa_n(c->cpu, n);
+  c->n_instrucoes += tempo;
+  bool desligada = false;
+  if (tempo == 0) {
+    // com a CPU parada esperando uma interrupção o tempo passa do mesmo
+    //   jeito, direto até o próximo evento; em outro erro, um tic por vez
+    tempo = cpu_parada(c->cpu) ? controle_tempo_ocioso(self) : 1;
+    // se não tem evento nem interrupção para acordar a CPU, nada mais vai
+    //   acontecer
+    desligada = cpu_parada(c->cpu) && !c->irq_relogio
+                && eventos_tempo_ate_proximo(self->eventos) == 0;
+  }
+  console_informa_desligada(self->console, desligada);
+  eventos_avanca(self->eventos, tempo);
+  return tempo;
+}
+
+long long controle_instrucoes(controle_t *self)
+{
+  long long n = 0;
+  for (int i = 0; i < self->n_cpus; i++) {
+    n += self->cpus[i].n_instrucoes;
+  }
+  return n;
+}
+
+// várias CPUs
+
+// executa a CPU 'c' até o fim da janela, entregando as interrupções pedidas
+//   para ela
+static void controle_executa_cpu(controle_cpu_t *c)
+{
+  controle_t *self = c->controle;
+  int feitas = 0;
+  for (;;) {
+    int n = atomic_load_explicit(&self->fim_janela, memory_order_relaxed);
+    if (feitas >= n) break;
+    // se tem interrupção pendente que a CPU ainda não aceitou, tenta de novo
+    //   depois de cada instrução
+    bool pendente = false;
+    if (c->irq_relogio) {
+      cpu_interrompe(c->cpu, IRQ_RELOGIO);
+      pendente = true;
+    } else if (atomic_load(&c->irq_ipi)) {
+      if (cpu_interrompe(c->cpu, IRQ_IPI)) {
+        atomic_store(&c->irq_ipi, false);
+      } else {
+        pendente = true;
+      }
+    }
+    int k = cpu_executa_n(c->cpu, pendente ? 1 : n - feitas);
+    c->n_instrucoes += k;
+    if (k == 0) {
+      // parada esperando interrupção, fica assim até o fim da janela (a não
+      //   ser que outra CPU peça interrupção antes); em outro erro, um tic
+      //   por vez
+      if (cpu_parada(c->cpu) && !atomic_load(&c->irq_ipi)) break;
+      k = 1;
+    }
+    feitas += k;
+  }
+}
+
+static void *controle_laco_cpu(void *arg)
+{
+  controle_cpu_t *c = arg;
+  controle_t *self = c->controle;
+  console_usa_na_thread(self->console);
+  for (;;) {
+    // espera o início de uma janela
+    pthread_barrier_wait(&self->barreira);
+    if (self->termina) break;
+    controle_executa_cpu(c);
+    // avisa o fim da janela
+    pthread_barrier_wait(&self->barreira);
+  }
+  return NULL;
+}
+
+static void controle_inicia_threads(controle_t *self)
+{
+  if (self->tem_threads) return;
+  int err = pthread_barrier_init(&self->barreira, NULL, self->n_cpus);
+  assert(err == 0);
+  self->termina = false;
+  for (int i = 1; i < self->n_cpus; i++) {
+    err = pthread_create(&self->cpus[i].thread, NULL, controle_laco_cpu,
+                         &self->cpus[i]);
+    assert(err == 0);
+  }
+  self->tem_threads = true;
+}
+
+static void controle_termina_threads(controle_t *self)
+{
+  if (!self->tem_threads) return;
+  self->termina = true;
+  pthread_barrier_wait(&self->barreira);
+  for (int i = 1; i < self->n_cpus; i++) {
+    pthread_join(self->cpus[i].thread, NULL);
+  }
+  pthread_barrier_destroy(&self->barreira);
+  self->tem_threads = false;
+}
+
+// a fila de eventos avisa quando um evento é agendado; se for antes do fim
+//   da janela atual, a janela termina mais cedo, para ele acontecer na hora
+// durante a janela, só o SO agenda eventos, com a trava do núcleo
+static void controle_evento_agendado(void *arg, int quando)
+{
+  controle_t *self = arg;
+  int t = quando - eventos_agora(self->eventos);
+  if (t < atomic_load(&self->fim_janela)) atomic_store(&self->fim_janela, t);
+}
+
+// true se nenhuma CPU tem o que executar: todas paradas, sem interrupção
+//   pendente
+static bool controle_cpus_ociosas(controle_t *self)
+{
+  for (int i = 0; i < self->n_cpus; i++) {
+    controle_cpu_t *c = &self->cpus[i];
+    if (!cpu_parada(c->cpu) || c->irq_relogio || atomic_load(&c->irq_ipi)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// executa uma janela em todas as CPUs (até o próximo evento), e faz o
+//   tempo avançar de acordo
+static void controle_executa_janela(controle_t *self)
+{
+  int t_ate_evento = eventos_tempo_ate_proximo(self->eventos);
+  bool desligada = false;
+  int n;
+  if (controle_cpus_ociosas(self)) {
+    // o tempo passa direto até o próximo evento; se não tem evento, nada
+    //   mais vai acontecer
+    n = (t_ate_evento > 0) ? t_ate_evento : 1;
+    desligada = (t_ate_evento == 0);
+  } else {
+    n = t_ate_evento;
+    if (n == 0 || n > MAX_INSTR_LOTE) n = MAX_INSTR_LOTE;
+    if (self->estado == passo) n = 1;
+    atomic_store(&self->fim_janela, n);
+    if (self->paralelo) {
+      controle_inicia_threads(self);
+      pthread_barrier_wait(&self->barreira);
+      controle_executa_cpu(&self->cpus[0]);
+      pthread_barrier_wait(&self->barreira);
+      // com as CPUs paradas, descarta o código decodificado que foi alterado
+      //   por outra CPU sem aviso (ver cpu_revalida_decodificacao)
+      for (int i = 0; i < self->n_cpus; i++) {
+        cpu_revalida_decodificacao(self->cpus[i].cpu);
+      }
+    } else {
+      for (int i = 0; i < self->n_cpus; i++) {
+        controle_executa_cpu(&self->cpus[i]);
+      }
+    }
+    n = atomic_load(&self->fim_janela);
+  }
+  console_informa_desligada(self->console, desligada);
+  eventos_avanca(self->eventos, n);
+}
 
 static void controle_processa_comandos_da_console(controle_t *self)
 {
@@ -97,6 +387,6 @@ static void controle_atualiza_estado_na_console(controle_t *self)
     case executando: strcpy(status, "EXEC   | "); break;
     case passo:      strcpy(status, "PASSO  | "); break;
   }
-  cpu_concatena_descricao(self->cpu, status);
+  cpu_concatena_descricao(self->cpus[0].cpu, status);
   console_print_status(self->console, status);
 }
@@ -11,11 +11,61 @@ typedef struct controle_t controle_t;
 #include "cpu.h"
 #include "console.h"
 #include "relogio.h"
+#include "eventos.h"
+#include "err.h"
 
-controle_t *controle_cria(cpu_t *cpu, console_t *console, relogio_t *relogio);
+// o controle faz o tempo da fila de eventos passar de acordo com as
+//   instruções executadas pela CPU
+// ele também faz o papel de controlador de interrupções: recebe os pedidos
+//   dos timers do relógio e os pedidos de interrupção entre CPUs (D_IPI), e
+//   interrompe a CPU correspondente
+controle_t *controle_cria(cpu_t *cpu, console_t *console, relogio_t *relogio,
+                          eventos_t *eventos);
 void controle_destroi(controle_t *self);
 
+// multiprocessamento
+// Com mais de uma CPU (todas compartilhando a memória), a simulação anda
+//   em janelas: o tempo até o próximo evento dos dispositivos (no máximo
+//   algumas centenas de instruções). Em cada janela, cada CPU executa até o
+//   número de instruções da janela (ou até parar esperando interrupção), e
+//   o tempo simulado avança o tamanho da janela.
+// As CPUs podem executar uma depois da outra na thread do controle
+//   (determinístico), ou cada uma na sua thread (paralelo), que se
+//   sincronizam no início e no fim de cada janela.
+// Regras de ordem que o programa simulado vê:
+// - as interrupções do timer e as pedidas por D_IPI são entregues a uma
+//   CPU no máximo uma janela depois do pedido (no início da janela
+//   seguinte, ou na mesma janela se a CPU ainda não passou do ponto);
+//   uma CPU parada só acorda no início de uma janela
+// - os eventos dos dispositivos (timers, terminais) acontecem entre as
+//   janelas; dentro de uma janela, o relógio não anda
+// - cada leitura ou escrita de uma posição de memória é atômica, mas não
+//   há ordem garantida entre os acessos de CPUs diferentes numa mesma
+//   janela (em modo determinístico, a CPU 0 executa a janela inteira antes
+//   da CPU 1, etc); o fim de cada janela é uma barreira: tudo o que foi
+//   escrito antes é visto por todas as CPUs depois
+// - os dispositivos de E/S só devem ser acessados pelo SO, com a trava do
+//   núcleo (ver so_adiciona_cpu)
+// - o resultado de alterar código que outra CPU está executando ao mesmo
+//   tempo é indefinido
+
+// acrescenta mais uma CPU, que compartilha a memória da primeira
+// retorna o número da CPU (a primeira, de controle_cria, é a 0)
+int controle_adiciona_cpu(controle_t *self, cpu_t *cpu);
+
+// escolhe se cada CPU executa na sua thread (true) ou se todas executam
+//   na thread do controle, uma depois da outra (false, o padrão)
+void controle_define_paralelo(controle_t *self, bool paralelo);
+
+// o controle como dispositivo de E/S, para pedir interrupção a outra CPU
+//   (escrever o número da CPU)
+// deve seguir o protocolo f_escrita_t declarado em es.h
+err_t controle_escrita_ipi(void *disp, int id, int valor);
+
 // o laço principal da simulação
 void controle_laco(controle_t *self);
 
+// retorna o número de instruções executadas pelas CPUs até agora
+long long controle_instrucoes(controle_t *self);
+
 #endif // CONTROLE_H
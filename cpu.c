@@ -7,6 +7,8 @@
 #include "cpu.h"
 #include "err.h"
 #include "instrucao.h"
+#include "jit.h"
+#include "console.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -15,6 +17,60 @@
 #include <assert.h>
 
 // DECLARAÇÃO {{{1
+typedef void (*tratador_t)(cpu_t *self);
+
+// superinstruções: sequências frequentes de instruções, que são executadas de
+//   uma vez quando a primeira delas está na cache de decodificação
+typedef enum {
+  SUPER_NENHUMA,
+  SUPER_CARGI_TRAX,        // preparação de argumento de chamada de sistema
+  SUPER_CARGX_DESVZ,       // percurso de string
+  SUPER_CPXA_RESTO_DESVNZ, // teste de contador
+  SUPER_TRAX_ARMM,         // entrada de subrotina que salva X
+  SUPER_TRAX_RET,          // saída de subrotina que restaura X
+  N_SUPER
+} super_t;
+
+// número máximo de palavras ocupadas por uma superinstrução
+#define MAX_PALAVRAS_SUPER 5
+
+// número de instruções decodificadas anotadas para a revalidação (mais que
+//   as executadas numa janela do controle)
+#define MAX_DECODIFICADAS 1024
+
+// endereços das instruções do tratador de interrupção em assembly
+//   (trata_int.asm), que o tratamento direto reproduz
+#define TRATADOR_CHAMAC (IRQ_END_TRATADOR + 0)
+#define TRATADOR_DESVNZ (IRQ_END_TRATADOR + 1)
+#define TRATADOR_RETI   (IRQ_END_TRATADOR + 3)
+#define TRATADOR_PARA   (IRQ_END_TRATADOR + 4)
+
+// executa uma superinstrução, retorna o número de instruções executadas
+//   (menos que todas se uma delas causar erro)
+typedef int (*tratador_super_t)(cpu_t *self);
+
+// instrução pré-decodificada
+// a CPU mantém uma cache com uma dessas por endereço de memória, preenchida
+//   quando a instrução naquele endereço é executada pela primeira vez, e
+//   invalidada quando a memória que ela ocupa é alterada
+// com várias CPUs, a invalidação pode vir da thread de outra CPU (a que
+//   alterou a memória); por isso 'valida' é acessado atomicamente
+// uma alteração feita por outra CPU enquanto a instrução é decodificada pode
+//   não ser avisada; as instruções decodificadas durante uma janela são
+//   conferidas no fim dela (ver cpu_revalida_decodificacao)
+typedef struct {
+  bool valida;
+  int opcode;
+  int A1;              // argumento, se a instrução tiver
+  int tam;             // número de palavras ocupadas pela instrução
+  tratador_t tratador; // função que executa a instrução
+  // superinstrução que começa nesta instrução (SUPER_NENHUMA se não tem)
+  super_t super;
+  int n_super;         // número de instruções da superinstrução
+  int A2;              // argumento da 2ª instrução da superinstrução
+  int A3;              // argumento da 3ª instrução da superinstrução
+} instr_decod_t;
+
 // uma CPU tem estado, memória, controlador de ES
 struct cpu_t {
   // registradores
@@ -33,10 +89,50 @@ struct cpu_t {
   // função e argumento para implementar instrução CHAMAC
   func_chamaC_t funcaoC;
   void *argC;
+  // tratamento direto das interrupções (tratador NULL se desligado); se
+  //   'direto', a interrupção sendo tratada está nele, com o estado em 'salvo'
+  func_tratador_t tratador;
+  void *arg_tratador;
+  bool direto;
+  cpu_estado_t salvo;
+  // motor de execução de instruções
+  cpu_motor_t motor;
+  // cache de instruções decodificadas, uma entrada por endereço de memória
+  instr_decod_t *decod;
+  int tam_decod;
+  // identificação da CPU como observadora de alterações na memória
+  int obs_decod;
+  // endereços das instruções decodificadas desde a última revalidação; se
+  //   não couberem, 'n_decodificadas' passa de MAX_DECODIFICADAS e todas as
+  //   instruções da cache são conferidas
+  int decodificadas[MAX_DECODIFICADAS];
+  int n_decodificadas;
+  // endereço da área onde o estado é salvo nas interrupções (ver irq_area)
+  int area;
+  // instrução decodificada sendo executada (NULL se não está na cache)
+  instr_decod_t *instr;
+  // tradutor para código nativo (NULL se desligado)
+  jit_t *jit;
+  // comparação dos blocos nativos com o interpretador
+  bool jit_compara;
+  int *mem_antes;       // cópia da memória antes do bloco
+  int *mem_nativo;      // cópia da memória depois do bloco nativo
+  int jit_divergencias;
+  // modo perfil: contagem das sequências de 2 e 3 opcodes executadas
+  //   (NULL se desligado), e os 2 últimos opcodes executados (-1 se não tem)
+  unsigned long *contagem_pares;
+  unsigned long *contagem_trios;
+  int anteriores[2];
 };
 
+static instr_decod_t *decodifica(cpu_t *self, int endereco);
+static void detecta_super(cpu_t *self, instr_decod_t *instr, int endereco);
+static void invalida_decodificacao(void *arg, int endereco);
+static void conta_sequencia(cpu_t *self, int opcode);
+static void esquece_sequencia(cpu_t *self);
+
 // CRIAÇÃO {{{1
-cpu_t *cpu_cria(mem_t *mem, es_t *es)
+cpu_t *cpu_cria(mem_t *mem, es_t *es, int id)
 {
   cpu_t *self;
   self = malloc(sizeof(*self));
@@ -52,6 +148,25 @@ cpu_t *cpu_cria(mem_t *mem, es_t *es)
   self->complemento = 0;
   self->modo = usuario;
   self->funcaoC = NULL;
+  self->tratador = NULL;
+  self->direto = false;
+  self->motor = CPU_MOTOR_SWITCH;
+  self->area = irq_area(id);
+  // inicializa a cache de instruções decodificadas
+  self->tam_decod = mem_tam(mem);
+  self->decod = calloc(self->tam_decod, sizeof(*self->decod));
+  assert(self->decod != NULL);
+  self->obs_decod = mem_registra_observador(mem, invalida_decodificacao, self);
+  assert(self->obs_decod >= 0);
+  self->n_decodificadas = 0;
+  self->instr = NULL;
+  self->jit = NULL;
+  self->jit_compara = false;
+  self->mem_antes = NULL;
+  self->mem_nativo = NULL;
+  self->jit_divergencias = 0;
+  self->contagem_pares = NULL;
+  self->contagem_trios = NULL;
   // inicializa instruções privilegiadas
   memset(self->privilegiadas, 0, sizeof(self->privilegiadas));
   self->privilegiadas[PARA] = true;
@@ -68,6 +183,10 @@ cpu_t *cpu_cria(mem_t *mem, es_t *es)
 void cpu_destroi(cpu_t *self)
 {
   // eu nao criei memória nem es; quem criou que destrua!
+  cpu_define_jit(self, false, false);
+  cpu_define_perfil(self, false);
+  mem_remove_observador(self->mem, self->obs_decod);
+  free(self->decod);
   free(self);
 }
 
@@ -77,6 +196,164 @@ void cpu_define_chamaC(cpu_t *self, func_chamaC_t funcaoC, void *argC)
   self->argC = argC;
 }
 
+static void salva_estado_na_memoria(cpu_t *self);
+
+void cpu_define_tratador(cpu_t *self, func_tratador_t func, void *arg)
+{
+  // uma interrupção no meio do tratamento direto continua no tratador em
+  //   assembly, que encontra o estado na memória
+  if (func == NULL && self->direto) {
+    salva_estado_na_memoria(self);
+    self->direto = false;
+  }
+  self->tratador = func;
+  self->arg_tratador = arg;
+}
+
+void cpu_define_motor(cpu_t *self, cpu_motor_t motor)
+{
+  self->motor = motor;
+}
+
+bool cpu_define_jit(cpu_t *self, bool ativo, bool compara)
+{
+  free(self->mem_antes);
+  free(self->mem_nativo);
+  self->mem_antes = NULL;
+  self->mem_nativo = NULL;
+  self->jit_compara = false;
+  if (!ativo) {
+    if (self->jit != NULL) {
+      jit_destroi(self->jit);
+      self->jit = NULL;
+    }
+    return true;
+  }
+
+  // o JIT pode já existir, com código nativo carregado
+  if (self->jit == NULL) {
+    self->jit = jit_cria(self->mem);
+    if (self->jit == NULL) return false;
+  }
+  jit_define_traducao(self->jit, true);
+  if (compara) {
+    self->jit_compara = true;
+    self->mem_antes = malloc(self->tam_decod * sizeof(int));
+    self->mem_nativo = malloc(self->tam_decod * sizeof(int));
+    assert(self->mem_antes != NULL && self->mem_nativo != NULL);
+  }
+  return true;
+}
+
+bool cpu_carrega_nativo(cpu_t *self, char *nome)
+{
+  if (self->jit != NULL) return jit_carrega_aot(self->jit, nome);
+
+  // sem JIT ligado, cria um só para executar o código carregado
+  jit_t *jit = jit_cria(self->mem);
+  if (jit == NULL) return false;
+  jit_define_traducao(jit, false);
+  if (!jit_carrega_aot(jit, nome)) {
+    jit_destroi(jit);
+    return false;
+  }
+  self->jit = jit;
+  return true;
+}
+
+void cpu_define_perfil(cpu_t *self, bool ativo)
+{
+  free(self->contagem_pares);
+  free(self->contagem_trios);
+  self->contagem_pares = NULL;
+  self->contagem_trios = NULL;
+  if (ativo) {
+    self->contagem_pares = calloc(N_OPCODE * N_OPCODE, sizeof(unsigned long));
+    self->contagem_trios = calloc(N_OPCODE * N_OPCODE * N_OPCODE, sizeof(unsigned long));
+    assert(self->contagem_pares != NULL && self->contagem_trios != NULL);
+    esquece_sequencia(self);
+  }
+  // as superinstruções dependem do modo; a cache é refeita
+  for (int end = 0; end < self->tam_decod; end++) {
+    self->decod[end].valida = false;
+  }
+}
+
+// PERFIL {{{1
+
+// anota a execução de mais um opcode na sequência
+static void conta_sequencia(cpu_t *self, int opcode)
+{
+  int a1 = self->anteriores[1];
+  int a0 = self->anteriores[0];
+  if (a1 >= 0) {
+    self->contagem_pares[a1 * N_OPCODE + opcode]++;
+    if (a0 >= 0) {
+      self->contagem_trios[(a0 * N_OPCODE + a1) * N_OPCODE + opcode]++;
+    }
+  }
+  self->anteriores[0] = a1;
+  self->anteriores[1] = opcode;
+}
+
+// a execução vai continuar em outro contexto (interrupção ou retorno dela);
+//   a próxima instrução não forma sequência com as anteriores
+static void esquece_sequencia(cpu_t *self)
+{
+  self->anteriores[0] = -1;
+  self->anteriores[1] = -1;
+}
+
+// informa as 'n' sequências mais frequentes de 'tam' opcodes, cuja contagem
+//   está em 'contagem' (com N_OPCODE^tam posições)
+static void relata_sequencias(unsigned long *contagem, int tam, int n)
+{
+  int n_seq = tam == 2 ? N_OPCODE * N_OPCODE : N_OPCODE * N_OPCODE * N_OPCODE;
+  unsigned long total = 0;
+  for (int i = 0; i < n_seq; i++) {
+    total += contagem[i];
+  }
+  console_printf("PERFIL: sequências de %d instruções mais executadas (%lu no total)",
+                 tam, total);
+  if (total == 0) return;
+  // seleção das n maiores, sem alterar a contagem
+  int escolhidas[n];
+  for (int k = 0; k < n; k++) {
+    escolhidas[k] = -1;
+    for (int i = 0; i < n_seq; i++) {
+      if (contagem[i] == 0) continue;
+      bool ja_escolhida = false;
+      for (int j = 0; j < k; j++) {
+        if (escolhidas[j] == i) ja_escolhida = true;
+      }
+      if (ja_escolhida) continue;
+      if (escolhidas[k] < 0 || contagem[i] > contagem[escolhidas[k]]) {
+        escolhidas[k] = i;
+      }
+    }
+    if (escolhidas[k] < 0) break;
+    int i = escolhidas[k];
+    int op3 = i % N_OPCODE;
+    int op2 = (i / N_OPCODE) % N_OPCODE;
+    int op1 = i / (N_OPCODE * N_OPCODE);
+    if (tam == 2) {
+      console_printf("PERFIL: %5.2f%% %10lu  %s %s", 100.0 * contagem[i] / total,
+                     contagem[i], instrucao_nome(op2), instrucao_nome(op3));
+    } else {
+      console_printf("PERFIL: %5.2f%% %10lu  %s %s %s", 100.0 * contagem[i] / total,
+                     contagem[i], instrucao_nome(op1), instrucao_nome(op2),
+                     instrucao_nome(op3));
+    }
+  }
+}
+
+void cpu_relata_perfil(cpu_t *self)
+{
+  if (self->contagem_pares == NULL) return;
+  relata_sequencias(self->contagem_pares, 2, 15);
+  relata_sequencias(self->contagem_trios, 3, 15);
+}
+
 // IMPRESSÃO {{{1
 static void imprime_registradores(cpu_t *self, char *str)
 {
@@ -112,6 +389,11 @@ static void imprime_erro(cpu_t *self, char *str)
   }
 }
 
+bool cpu_parada(cpu_t *self)
+{
+  return self->erro == ERR_CPU_PARADA;
+}
+
 void cpu_concatena_descricao(cpu_t *self, char *str)
 {
   char aux[40];
@@ -150,8 +432,16 @@ static bool pega_opcode(cpu_t *self, int *popc)
     self->erro = ERR_END_INV;
     return false;
   }
+  // usa a instrução decodificada, se possível
+  self->instr = decodifica(self, self->PC);
+  if (self->instr != NULL) {
+    *popc = self->instr->opcode;
   // não pode executar se houver erro na leitura da memória
-  if (!pega_mem(self, self->PC, popc)) return false;
+  } else if (!pega_mem(self, self->PC, popc)) {
+    return false;
+  }
+  // opcode desconhecido não é privilegiado (a execução vai dar erro de instrução)
+  if (*popc < 0 || *popc >= N_OPCODE) return true;
   // pode executar se tiver privilégio para isso
   if (self->modo == supervisor || !self->privilegiadas[*popc]) return true;
   // não pode executar instrução privilegiada em modo usuário
@@ -162,6 +452,10 @@ static bool pega_opcode(cpu_t *self, int *popc)
 // lê o argumento 1 da instrução no PC
 static bool pega_A1(cpu_t *self, int *pA1)
 {
+  if (self->instr != NULL) {
+    *pA1 = self->instr->A1;
+    return true;
+  }
   return pega_mem(self, self->PC + 1, pA1);
 }
 
@@ -426,10 +720,257 @@ static void op_CHAMAS(cpu_t *self) // chamada de sistema
 
 }
 
+// SUPERINSTRUÇÕES {{{1
+// ---------------------------------------------------------------------
+// cada uma tem o mesmo efeito das instruções que a compõem executadas em
+//   sequência (inclusive se uma delas causar erro)
+// os argumentos vêm da instrução decodificada em self->instr
+
+static int super_CARGI_TRAX(cpu_t *self)
+{
+  self->A = self->X;
+  self->X = self->instr->A1;
+  self->PC += 3;
+  return 2;
+}
+
+static int super_CARGX_DESVZ(cpu_t *self)
+{
+  int val;
+  int fim = self->instr->A2;
+  if (!pega_mem(self, self->instr->A1 + self->X, &val)) return 1;
+  self->A = val;
+  self->PC = val == 0 ? fim : self->PC + 4;
+  return 2;
+}
+
+static int super_CPXA_RESTO_DESVNZ(cpu_t *self)
+{
+  int val;
+  int destino = self->instr->A3;
+  self->A = self->X;
+  self->PC += 1;
+  if (!pega_mem(self, self->instr->A2, &val)) return 2;
+  self->A %= val;
+  self->PC = self->A != 0 ? destino : self->PC + 4;
+  return 3;
+}
+
+static int super_TRAX_ARMM(cpu_t *self)
+{
+  int end = self->instr->A2;
+  int A = self->A;
+  self->A = self->X;
+  self->X = A;
+  self->PC += 1;
+  if (!poe_mem(self, end, self->A)) return 2;
+  self->PC += 2;
+  return 2;
+}
+
+static int super_TRAX_RET(cpu_t *self)
+{
+  int val;
+  int A = self->A;
+  self->A = self->X;
+  self->X = A;
+  self->PC += 1;
+  if (!pega_mem(self, self->instr->A2, &val)) return 2;
+  self->PC = val;
+  return 2;
+}
+
+// as instruções que compõem cada superinstrução, e quem a executa
+static const struct {
+  int n;
+  opcode_t opcodes[3];
+  tratador_super_t tratador;
+} supers[N_SUPER] = {
+  [SUPER_CARGI_TRAX]        = { 2, { CARGI, TRAX },          super_CARGI_TRAX },
+  [SUPER_CARGX_DESVZ]       = { 2, { CARGX, DESVZ },         super_CARGX_DESVZ },
+  [SUPER_CPXA_RESTO_DESVNZ] = { 3, { CPXA, RESTO, DESVNZ },  super_CPXA_RESTO_DESVNZ },
+  [SUPER_TRAX_ARMM]         = { 2, { TRAX, ARMM },           super_TRAX_ARMM },
+  [SUPER_TRAX_RET]          = { 2, { TRAX, RET },            super_TRAX_RET },
+};
+
+// DECODIFICAÇÃO {{{1
+
+// função que executa cada instrução (NULL para os opcodes inválidos)
+static const tratador_t tratadores[N_OPCODE] = {
+  [NOP]    = op_NOP,    [PARA]   = op_PARA,   [CARGI]  = op_CARGI,
+  [CARGM]  = op_CARGM,  [CARGX]  = op_CARGX,  [ARMM]   = op_ARMM,
+  [ARMX]   = op_ARMX,   [TRAX]   = op_TRAX,   [CPXA]   = op_CPXA,
+  [INCX]   = op_INCX,   [SOMA]   = op_SOMA,   [SUB]    = op_SUB,
+  [MULT]   = op_MULT,   [DIV]    = op_DIV,    [RESTO]  = op_RESTO,
+  [NEG]    = op_NEG,    [DESV]   = op_DESV,   [DESVZ]  = op_DESVZ,
+  [DESVNZ] = op_DESVNZ, [DESVN]  = op_DESVN,  [DESVP]  = op_DESVP,
+  [CHAMA]  = op_CHAMA,  [RET]    = op_RET,    [LE]     = op_LE,
+  [ESCR]   = op_ESCR,   [RETI]   = op_RETI,   [CHAMAC] = op_CHAMAC,
+  [CHAMAS] = op_CHAMAS,
+};
+
+// instruções que acessam algo fora da CPU (dispositivos ou o SO); elas só são
+//   executadas como primeira instrução de um lote, para que encontrem o
+//   relógio e os dispositivos atualizados até o momento da execução
+static const bool acessa_dispositivo[N_OPCODE] = {
+  [LE] = true, [ESCR] = true, [CHAMAC] = true,
+};
+
+// instruções que terminam um lote: as que acessam dispositivos (podem ter
+//   alterado quando deve acontecer o próximo evento), as que mudam o modo da
+//   CPU (interrupção e retorno) e a que para a CPU
+static const bool termina_lote[N_OPCODE] = {
+  [PARA] = true, [LE] = true, [ESCR] = true, [RETI] = true, [CHAMAC] = true,
+  [CHAMAS] = true,
+};
+
+// lê a instrução em 'endereco' diretamente da memória
+// retorna false se não é uma instrução que possa ser decodificada
+static bool le_instrucao(cpu_t *self, int endereco, int *popcode, int *pA1)
+{
+  *pA1 = 0;
+  if (mem_le(self->mem, endereco, popcode) != ERR_OK) return false;
+  if (*popcode < 0 || *popcode >= N_OPCODE || tratadores[*popcode] == NULL) {
+    return false;
+  }
+  if (instrucao_num_args(*popcode) > 0
+      && mem_le(self->mem, endereco + 1, pA1) != ERR_OK) {
+    return false;
+  }
+  return true;
+}
+
+// verifica se a instrução decodificada em 'endereco' e as seguintes formam
+//   uma superinstrução, e anota na instrução se formarem
+static void detecta_super(cpu_t *self, instr_decod_t *instr, int endereco)
+{
+  for (super_t s = SUPER_NENHUMA + 1; s < N_SUPER; s++) {
+    if (supers[s].opcodes[0] != instr->opcode) continue;
+    int args[3] = { instr->A1, 0, 0 };
+    int end = endereco + instr->tam;
+    int i;
+    for (i = 1; i < supers[s].n; i++) {
+      int opcode;
+      if (!le_instrucao(self, end, &opcode, &args[i])) break;
+      if (opcode != supers[s].opcodes[i]) break;
+      end += 1 + instrucao_num_args(opcode);
+    }
+    if (i < supers[s].n) continue;
+    instr->super = s;
+    instr->n_super = supers[s].n;
+    instr->A2 = args[1];
+    instr->A3 = args[2];
+    // a superinstrução também depende das palavras das outras instruções
+    for (int e = endereco + instr->tam; e < end; e++) {
+      mem_observa(self->mem, self->obs_decod, e);
+    }
+    return;
+  }
+}
+
+// preenche 'instr' com a instrução em 'endereco', lida da memória
+// retorna false se a instrução não pode ser decodificada
+static bool preenche_decodificacao(cpu_t *self, instr_decod_t *instr,
+                                   int endereco)
+{
+  int opcode, A1 = 0;
+  if (mem_le(self->mem, endereco, &opcode) != ERR_OK) return false;
+  if (opcode < 0 || opcode >= N_OPCODE || tratadores[opcode] == NULL) return false;
+  int tam = 1 + instrucao_num_args(opcode);
+  if (tam > 1 && mem_le(self->mem, endereco + 1, &A1) != ERR_OK) return false;
+
+  instr->opcode = opcode;
+  instr->A1 = A1;
+  instr->tam = tam;
+  instr->tratador = tratadores[opcode];
+  instr->super = SUPER_NENHUMA;
+  // pede para ser avisado se alguma palavra da instrução for alterada
+  for (int i = 0; i < tam; i++) {
+    mem_observa(self->mem, self->obs_decod, endereco + i);
+  }
+  // o modo perfil conta as instruções que realmente estão no código
+  if (self->contagem_pares == NULL) {
+    detecta_super(self, instr, endereco);
+  }
+  return true;
+}
+
+// retorna a instrução decodificada no endereço, decodificando se necessário
+// retorna NULL se a instrução não pode ser decodificada (endereço ou opcode
+//   inválido, argumento fora da memória) -- nesse caso ela deve ser executada
+//   lendo a memória, para que o erro correspondente aconteça
+// a verificação de modo e de privilégio não é feita aqui, porque depende do
+//   estado da CPU no momento da execução
+static instr_decod_t *decodifica(cpu_t *self, int endereco)
+{
+  if (endereco < 0 || endereco >= self->tam_decod) return NULL;
+  instr_decod_t *instr = &self->decod[endereco];
+  if (__atomic_load_n(&instr->valida, __ATOMIC_RELAXED)) return instr;
+
+  if (!preenche_decodificacao(self, instr, endereco)) return NULL;
+  __atomic_store_n(&instr->valida, true, __ATOMIC_RELAXED);
+  // anota para a revalidação
+  if (self->n_decodificadas < MAX_DECODIFICADAS) {
+    self->decodificadas[self->n_decodificadas] = endereco;
+  }
+  if (self->n_decodificadas <= MAX_DECODIFICADAS) self->n_decodificadas++;
+  return instr;
+}
+
+// descarta a instrução decodificada em 'endereco' se ela não corresponde
+//   mais ao que está na memória
+static void revalida_instrucao(cpu_t *self, int endereco)
+{
+  instr_decod_t *instr = &self->decod[endereco];
+  if (!instr->valida) return;
+  instr_decod_t atual;
+  if (!preenche_decodificacao(self, &atual, endereco)
+      || atual.opcode != instr->opcode || atual.A1 != instr->A1
+      || atual.super != instr->super
+      || (atual.super != SUPER_NENHUMA
+          && (atual.A2 != instr->A2 || atual.A3 != instr->A3))) {
+    instr->valida = false;
+  }
+}
+
+void cpu_revalida_decodificacao(cpu_t *self)
+{
+  if (self->n_decodificadas > MAX_DECODIFICADAS) {
+    // foram decodificadas mais do que cabem na lista, confere todas
+    for (int end = 0; end < self->tam_decod; end++) {
+      revalida_instrucao(self, end);
+    }
+  } else {
+    for (int i = 0; i < self->n_decodificadas; i++) {
+      revalida_instrucao(self, self->decodificadas[i]);
+    }
+  }
+  self->n_decodificadas = 0;
+}
+
+// chamada pela memória quando um endereço usado por uma instrução
+//   decodificada é alterado. Invalida as instruções que podem usar esse
+//   endereço: a que começa nele e as que começam antes, a uma distância de
+//   até o tamanho de uma superinstrução
+static void invalida_decodificacao(void *arg, int endereco)
+{
+  cpu_t *self = arg;
+  int primeiro = endereco - (MAX_PALAVRAS_SUPER - 1);
+  if (primeiro < 0) primeiro = 0;
+  for (int end = primeiro; end <= endereco; end++) {
+    __atomic_store_n(&self->decod[end].valida, false, __ATOMIC_RELAXED);
+  }
+}
+
 // EXECUTA UMA INSTRUÇÃO {{{1
 
 static void executa_a_instrucao(cpu_t *self, int opcode)
 {
+  // se a instrução está decodificada, já se sabe quem executa
+  if (self->instr != NULL) {
+    self->instr->tratador(self);
+    return;
+  }
   switch (opcode) {
     case NOP:    op_NOP(self);    break;
     case PARA:   op_PARA(self);   break;
@@ -463,14 +1004,509 @@ static void executa_a_instrucao(cpu_t *self, int opcode)
   }
 }
 
-void cpu_executa_1(cpu_t *self)
+// executa até n instruções com o motor switch
+// para antes de n se a CPU entrar em erro ou se chegar ao fim de um lote (ver
+//   cpu_executa_n); o erro fica em self->erro, para ser tratado por quem chamou
+// retorna o número de instruções executadas (contando a que causou erro)
+static int executa_switch(cpu_t *self, int n)
 {
-  // não executa se CPU já estiver em erro
-  if (self->erro != ERR_OK) return;
+  int executadas = 0;
+  while (executadas < n && self->erro == ERR_OK) {
+    int opcode;
+    bool ok = pega_opcode(self, &opcode);
+    // superinstrução, se couber inteira no lote
+    if (ok && self->instr != NULL && self->instr->super != SUPER_NENHUMA
+        && n - executadas >= self->instr->n_super) {
+      executadas += supers[self->instr->super].tratador(self);
+      self->instr = NULL;
+      continue;
+    }
+    bool conhecido = ok && opcode >= 0 && opcode < N_OPCODE;
+    if (conhecido && acessa_dispositivo[opcode] && executadas > 0) {
+      self->instr = NULL;
+      break;
+    }
+    executadas++;
+    if (ok) {
+      executa_a_instrucao(self, opcode);
+      if (conhecido && self->contagem_pares != NULL) {
+        conta_sequencia(self, opcode);
+      }
+    }
+    self->instr = NULL;
+    if (conhecido && termina_lote[opcode]) break;
+  }
+  return executadas;
+}
 
-  int opcode;
-  if (pega_opcode(self, &opcode)) {
-    executa_a_instrucao(self, opcode);
+// MOTOR ENCADEADO {{{1
+
+// executa até n instruções com despacho encadeado: cada tratador termina
+//   buscando a próxima instrução e desviando direto (goto computado) para o
+//   tratador dela, sem passar por um switch central. PC, A e X ficam em
+//   variáveis locais, e só são copiados para self antes de operações que
+//   precisam do estado completo da CPU (RETI, CHAMAC, CHAMAS) e no final.
+// as instruções vêm da cache de decodificação quando possível; as que não
+//   podem ser decodificadas são lidas da memória (e vão causar erro).
+// a semântica de cada instrução (inclusive em caso de erro) é a mesma das
+//   funções op_* acima.
+// para antes de n se a CPU entrar em erro ou se chegar ao fim de um lote (ver
+//   cpu_executa_n); o erro fica em self->erro, para ser tratado por quem chamou
+// retorna o número de instruções executadas (contando a que causou erro)
+static int executa_encadeado(cpu_t *self, int n)
+{
+  static void *tratadores[N_OPCODE] = {
+    [NOP]    = &&op_NOP,    [PARA]   = &&op_PARA,   [CARGI]  = &&op_CARGI,
+    [CARGM]  = &&op_CARGM,  [CARGX]  = &&op_CARGX,  [ARMM]   = &&op_ARMM,
+    [ARMX]   = &&op_ARMX,   [TRAX]   = &&op_TRAX,   [CPXA]   = &&op_CPXA,
+    [INCX]   = &&op_INCX,   [SOMA]   = &&op_SOMA,   [SUB]    = &&op_SUB,
+    [MULT]   = &&op_MULT,   [DIV]    = &&op_DIV,    [RESTO]  = &&op_RESTO,
+    [NEG]    = &&op_NEG,    [DESV]   = &&op_DESV,   [DESVZ]  = &&op_DESVZ,
+    [DESVNZ] = &&op_DESVNZ, [DESVN]  = &&op_DESVN,  [DESVP]  = &&op_DESVP,
+    [CHAMA]  = &&op_CHAMA,  [RET]    = &&op_RET,    [LE]     = &&op_LE,
+    [ESCR]   = &&op_ESCR,   [RETI]   = &&op_RETI,   [CHAMAC] = &&op_CHAMAC,
+    [CHAMAS] = &&op_CHAMAS,
+    [VALOR]  = &&op_inv,    [STRING] = &&op_inv,    [ESPACO] = &&op_inv,
+    [DEFINE] = &&op_inv,
+  };
+  static void *tratadores_super[N_SUPER] = {
+    [SUPER_CARGI_TRAX]        = &&super_CARGI_TRAX,
+    [SUPER_CARGX_DESVZ]       = &&super_CARGX_DESVZ,
+    [SUPER_CPXA_RESTO_DESVNZ] = &&super_CPXA_RESTO_DESVNZ,
+    [SUPER_TRAX_ARMM]         = &&super_TRAX_ARMM,
+    [SUPER_TRAX_RET]          = &&super_TRAX_RET,
+  };
+  int PC = self->PC;
+  int A = self->A;
+  int X = self->X;
+  mem_t *mem = self->mem;
+  int executadas = 0;
+  instr_decod_t *instr;
+  int opcode, A1, val, end;
+
+// copia os registradores locais para a CPU, e de volta
+#define SALVA_REGS() (self->PC = PC, self->A = A, self->X = X)
+#define PEGA_REGS()  (PC = self->PC, A = self->A, X = self->X)
+// lê a memória em 'e' para 'v', ou termina com erro de endereço
+#define LE_MEM(e, v) \
+  do { \
+    end = (e); \
+    if (mem_le(mem, end, &(v)) != ERR_OK) goto erro_mem; \
+  } while (0)
+// escreve 'v' na memória em 'e', ou termina com erro de endereço
+#define ESCREVE_MEM(e, v) \
+  do { \
+    end = (e); \
+    if (mem_escreve(mem, end, (v)) != ERR_OK) goto erro_mem; \
+  } while (0)
+// pega o argumento da instrução (já está em A1 se ela está decodificada)
+#define PEGA_A1() \
+  do { \
+    if (instr == NULL) LE_MEM(PC + 1, A1); \
+  } while (0)
+// busca a próxima instrução e desvia para o tratador dela (ou da
+//   superinstrução que começa nela, se couber inteira no lote)
+// é igual a pega_opcode, com os registradores locais
+#define DESPACHA() \
+  do { \
+    if (executadas >= n) goto fim; \
+    executadas++; \
+    if (self->modo == usuario && PC < 100) { \
+      self->erro = ERR_END_INV; \
+      goto erro; \
+    } \
+    if (PC >= 0 && PC < self->tam_decod \
+        && __atomic_load_n(&self->decod[PC].valida, __ATOMIC_RELAXED)) { \
+      instr = &self->decod[PC]; \
+    } else { \
+      instr = decodifica(self, PC); \
+    } \
+    if (instr != NULL) { \
+      if (instr->super != SUPER_NENHUMA && n - executadas >= instr->n_super - 1) { \
+        goto *tratadores_super[instr->super]; \
+      } \
+      opcode = instr->opcode; \
+      A1 = instr->A1; \
+    } else { \
+      LE_MEM(PC, opcode); \
+      if (opcode < 0 || opcode >= N_OPCODE) goto op_inv; \
+    } \
+    if (self->modo == usuario && self->privilegiadas[opcode]) { \
+      self->erro = ERR_INSTR_PRIV; \
+      goto erro; \
+    } \
+    if (acessa_dispositivo[opcode] && executadas > 1) { \
+      executadas--; \
+      goto fim; \
+    } \
+    goto *tratadores[opcode]; \
+  } while (0)
+
+  DESPACHA();
+
+op_NOP:
+  PC += 1;
+  DESPACHA();
+op_PARA:
+  self->erro = ERR_CPU_PARADA;
+  goto fim;
+op_CARGI:
+  PEGA_A1();
+  A = A1;
+  PC += 2;
+  DESPACHA();
+op_CARGM:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A = val;
+  PC += 2;
+  DESPACHA();
+op_CARGX:
+  PEGA_A1();
+  LE_MEM(A1 + X, val);
+  A = val;
+  PC += 2;
+  DESPACHA();
+op_ARMM:
+  PEGA_A1();
+  ESCREVE_MEM(A1, A);
+  PC += 2;
+  DESPACHA();
+op_ARMX:
+  PEGA_A1();
+  ESCREVE_MEM(A1 + X, A);
+  PC += 2;
+  DESPACHA();
+op_TRAX:
+  val = A;
+  A = X;
+  X = val;
+  PC += 1;
+  DESPACHA();
+op_CPXA:
+  A = X;
+  PC += 1;
+  DESPACHA();
+op_INCX:
+  X += 1;
+  PC += 1;
+  DESPACHA();
+op_SOMA:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A += val;
+  PC += 2;
+  DESPACHA();
+op_SUB:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A -= val;
+  PC += 2;
+  DESPACHA();
+op_MULT:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A *= val;
+  PC += 2;
+  DESPACHA();
+op_DIV:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A /= val;
+  PC += 2;
+  DESPACHA();
+op_RESTO:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  A %= val;
+  PC += 2;
+  DESPACHA();
+op_NEG:
+  A = -A;
+  PC += 1;
+  DESPACHA();
+op_DESV:
+  PEGA_A1();
+  PC = A1;
+  DESPACHA();
+op_DESVZ:
+  if (A == 0) goto op_DESV;
+  PC += 2;
+  DESPACHA();
+op_DESVNZ:
+  if (A != 0) goto op_DESV;
+  PC += 2;
+  DESPACHA();
+op_DESVN:
+  if (A < 0) goto op_DESV;
+  PC += 2;
+  DESPACHA();
+op_DESVP:
+  if (A > 0) goto op_DESV;
+  PC += 2;
+  DESPACHA();
+op_CHAMA:
+  PEGA_A1();
+  ESCREVE_MEM(A1, PC + 2);
+  PC = A1 + 1;
+  DESPACHA();
+op_RET:
+  PEGA_A1();
+  LE_MEM(A1, val);
+  PC = val;
+  DESPACHA();
+op_LE:
+  PEGA_A1();
+  self->erro = es_le(self->es, A1, &val);
+  if (self->erro != ERR_OK) {
+    self->complemento = A1;
+    goto erro;
+  }
+  A = val;
+  PC += 2;
+  goto fim;
+op_ESCR:
+  PEGA_A1();
+  self->erro = es_escreve(self->es, A1, A);
+  if (self->erro != ERR_OK) {
+    self->complemento = A1;
+    goto erro;
+  }
+  PC += 2;
+  goto fim;
+op_RETI:
+  SALVA_REGS();
+  cpu_desinterrompe(self);
+  return executadas;
+op_CHAMAC:
+  if (self->funcaoC == NULL) {
+    self->erro = ERR_OP_INV;
+    goto erro;
+  }
+  SALVA_REGS();
+  A = self->funcaoC(self->argC, A);
+  PC += 1;
+  goto fim;
+op_CHAMAS:
+  PC += 1;
+  SALVA_REGS();
+  cpu_interrompe(self, IRQ_SISTEMA);
+  return executadas;
+op_inv:
+  self->erro = ERR_INSTR_INV;
+  goto erro;
+
+// superinstruções: a primeira instrução já foi contada em DESPACHA
+super_CARGI_TRAX:
+  A = X;
+  X = instr->A1;
+  PC += 3;
+  executadas += 1;
+  DESPACHA();
+super_CARGX_DESVZ:
+  LE_MEM(instr->A1 + X, val);
+  A = val;
+  PC = val == 0 ? instr->A2 : PC + 4;
+  executadas += 1;
+  DESPACHA();
+super_CPXA_RESTO_DESVNZ:
+  A = X;
+  PC += 1;
+  executadas += 1;
+  LE_MEM(instr->A2, val);
+  A %= val;
+  PC = A != 0 ? instr->A3 : PC + 4;
+  executadas += 1;
+  DESPACHA();
+super_TRAX_ARMM:
+  val = A;
+  A = X;
+  X = val;
+  PC += 1;
+  executadas += 1;
+  ESCREVE_MEM(instr->A2, A);
+  PC += 2;
+  DESPACHA();
+super_TRAX_RET:
+  val = A;
+  A = X;
+  X = val;
+  PC += 1;
+  executadas += 1;
+  LE_MEM(instr->A2, val);
+  PC = val;
+  DESPACHA();
+
+erro_mem:
+  self->erro = ERR_END_INV;
+  self->complemento = end;
+erro:
+fim:
+  SALVA_REGS();
+  return executadas;
+
+#undef SALVA_REGS
+#undef PEGA_REGS
+#undef LE_MEM
+#undef ESCREVE_MEM
+#undef PEGA_A1
+#undef DESPACHA
+}
+
+// JIT {{{1
+
+// executa até n instruções com o motor escolhido
+static int executa_motor(cpu_t *self, int n)
+{
+  if (self->motor == CPU_MOTOR_ENCADEADO) {
+    return executa_encadeado(self, n);
+  } else {
+    return executa_switch(self, n);
+  }
+}
+
+// executa o bloco nativo que começa no PC, se houver um com até 'max'
+//   instruções; retorna o número de instruções executadas
+static int executa_nativo(cpu_t *self, int max)
+{
+  jit_regs_t regs = { .PC = self->PC, .A = self->A, .X = self->X };
+  int executadas = jit_executa(self->jit, &regs, max);
+  self->PC = regs.PC;
+  self->A = regs.A;
+  self->X = regs.X;
+  return executadas;
+}
+
+// executa o bloco nativo que começa no PC e interpreta as mesmas instruções a
+//   partir do mesmo estado, comparando os resultados
+// fica valendo o resultado do interpretador
+static int executa_nativo_comparando(cpu_t *self, int max)
+{
+  int *conteudo = mem_conteudo(self->mem);
+  int tam_bytes = self->tam_decod * sizeof(int);
+  int PC = self->PC, A = self->A, X = self->X;
+
+  memcpy(self->mem_antes, conteudo, tam_bytes);
+  int executadas = executa_nativo(self, max);
+  if (executadas == 0) return 0;
+
+  // guarda o resultado do bloco nativo, e volta ao estado anterior a ele
+  // (o bloco nativo não altera endereços observados, então a memória pode
+  //   ser restaurada diretamente)
+  memcpy(self->mem_nativo, conteudo, tam_bytes);
+  memcpy(conteudo, self->mem_antes, tam_bytes);
+  int nPC = self->PC, nA = self->A, nX = self->X;
+  self->PC = PC;
+  self->A = A;
+  self->X = X;
+
+  int interpretadas = executa_motor(self, executadas);
+  if (interpretadas != executadas || self->erro != ERR_OK
+      || self->PC != nPC || self->A != nA || self->X != nX
+      || memcmp(conteudo, self->mem_nativo, tam_bytes) != 0) {
+    self->jit_divergencias++;
+    log_aviso(LOG_CPU, "JIT: divergência no bloco em %d (%d instr): "
+              "PC=%d/%d A=%d/%d X=%d/%d", PC, executadas,
+              nPC, self->PC, nA, self->A, nX, self->X);
+  }
+  return interpretadas;
+}
+
+// verifica se o opcode é de uma instrução que pode mudar o fluxo de execução
+static bool desvia(int opcode)
+{
+  return opcode >= DESV && opcode <= RET;
+}
+
+// executa até n instruções, usando blocos nativos do JIT quando possível
+// o JIT só é consultado no início de blocos básicos (depois de um desvio ou do
+//   início do lote) em modo usuário; o resto do código de usuário é executado
+//   uma instrução por vez pelo motor escolhido, respeitando as regras de fim
+//   de lote
+static int executa_com_jit(cpu_t *self, int n)
+{
+  int executadas = 0;
+  bool inicio_bloco = true;
+  while (executadas < n && self->erro == ERR_OK) {
+    // o código do SO é todo interpretado; o lote termina junto com a
+    //   execução dele (só sai do modo supervisor com RETI, que termina lote)
+    if (self->modo == supervisor) {
+      executadas += executa_motor(self, n - executadas);
+      break;
+    }
+    if (inicio_bloco && self->PC >= 100) {
+      int k;
+      if (self->jit_compara) {
+        k = executa_nativo_comparando(self, n - executadas);
+      } else {
+        k = executa_nativo(self, n - executadas);
+      }
+      executadas += k;
+      if (k > 0) continue;
+    }
+    int PC = self->PC;
+    instr_decod_t *instr = decodifica(self, PC);
+    // em modo usuário nenhuma instrução precisa iniciar lote: as que acessam
+    //   dispositivos são privilegiadas, e causam erro
+    executadas += executa_motor(self, 1);
+    if (instr == NULL) {
+      inicio_bloco = true;
+    } else {
+      if (termina_lote[instr->opcode]) break;
+      inicio_bloco = desvia(instr->opcode) || self->PC != PC + instr->tam;
+    }
+  }
+  return executadas;
+}
+
+// executa até n instruções do tratador de interrupção no tratamento direto
+// cada passo corresponde a uma instrução do tratador em assembly, com as
+//   mesmas regras de lote: CHAMAC (a chamada ao tratador em C) é a primeira do
+//   seu lote, e CHAMAC, RETI e PARA terminam o lote
+static int executa_tratador_direto(cpu_t *self, int n)
+{
+  int executadas = 0;
+  while (executadas < n) {
+    executadas++;
+    switch (self->PC) {
+      case TRATADOR_CHAMAC:
+        self->A = self->tratador(self->arg_tratador, self->A, &self->salvo);
+        self->PC = TRATADOR_DESVNZ;
+        return executadas;
+      case TRATADOR_DESVNZ:
+        self->PC = self->A != 0 ? TRATADOR_PARA : TRATADOR_RETI;
+        break;
+      case TRATADOR_RETI:
+        cpu_desinterrompe(self);
+        return executadas;
+      case TRATADOR_PARA:
+        self->erro = ERR_CPU_PARADA;
+        return executadas;
+      default:
+        // não tem como chegar aqui
+        assert(false);
+    }
+  }
+  return executadas;
+}
+
+// EXECUTA {{{1
+
+int cpu_executa_n(cpu_t *self, int n)
+{
+  // não executa se CPU já estiver em erro
+  if (self->erro != ERR_OK) return 0;
+
+  int executadas;
+  if (self->direto) {
+    executadas = executa_tratador_direto(self, n);
+  } else if (self->contagem_pares != NULL) {
+    // o modo perfil conta as instruções no motor switch
+    executadas = executa_switch(self, n);
+  } else if (self->jit != NULL) {
+    executadas = executa_com_jit(self, n);
+  } else {
+    executadas = executa_motor(self, n);
   }
 
   // se a CPU entrou em erro, causa uma interrupção
@@ -482,6 +1518,13 @@ void cpu_executa_1(cpu_t *self)
     // se a interrupção não é aceita nesse ponto, temos um problema grave...
     assert(cpu_interrompe(self, IRQ_ERR_CPU));
   }
+
+  return executadas;
+}
+
+void cpu_executa_1(cpu_t *self)
+{
+  cpu_executa_n(self, 1);
 }
 
 // INTERRUPÇÃO {{{1
@@ -497,41 +1540,73 @@ bool cpu_interrompe(cpu_t *self, irq_t irq)
   //   acesso (para quando existir proteção de memória)
   self->modo = supervisor;
 
-  // esta é uma CPU boazinha, salva todo o estado interno da CPU no início da memória
-  poe_mem(self, IRQ_END_PC,          self->PC);
-  poe_mem(self, IRQ_END_A,           self->A);
-  poe_mem(self, IRQ_END_X,           self->X);
-  poe_mem(self, IRQ_END_erro,        self->erro);
-  poe_mem(self, IRQ_END_complemento, self->complemento);
-  poe_mem(self, IRQ_END_modo,        usuario);
+  // esta é uma CPU boazinha, salva todo o estado interno da CPU na sua área
+  //   de salvamento (no início da memória), ou, no tratamento direto, onde
+  //   o tratador em C vai encontrar
+  self->salvo = (cpu_estado_t){
+    .PC = self->PC,
+    .A = self->A,
+    .X = self->X,
+    .erro = self->erro,
+    .complemento = self->complemento,
+    .modo = usuario,
+  };
+  self->direto = (self->tratador != NULL);
+  if (!self->direto) salva_estado_na_memoria(self);
 
   // altera o estado da CPU para ela poder executar o tratador de interrupção
   // vai iniciar o tratamento da interrupção no endereço IRQ_END_TRATADOR,
   //   com o A contendo o valor da requisição de interrupção e sem erro
   // se o tratador da interrupção precisar do estado da CPU de antes da
-  //   interrupção, deve acessar o início da memória, onde esse estado foi salvo
+  //   interrupção, deve acessar a área de salvamento, onde esse estado foi salvo
   self->PC = IRQ_END_TRATADOR;
   self->A = irq;
   self->erro = ERR_OK;
+  esquece_sequencia(self);
 
   return true;
 }
 
+static void salva_estado_na_memoria(cpu_t *self)
+{
+  poe_mem(self, self->area + IRQ_END_PC,          self->salvo.PC);
+  poe_mem(self, self->area + IRQ_END_A,           self->salvo.A);
+  poe_mem(self, self->area + IRQ_END_X,           self->salvo.X);
+  poe_mem(self, self->area + IRQ_END_erro,        self->salvo.erro);
+  poe_mem(self, self->area + IRQ_END_complemento, self->salvo.complemento);
+  poe_mem(self, self->area + IRQ_END_modo,        self->salvo.modo);
+}
+
 static void cpu_desinterrompe(cpu_t *self)
 {
   // a interrupção retornou
   // recupera o estado da CPU, para que volte a executar o que foi interrompido
   //   quando a interrupção foi atendida
-  pega_mem(self, IRQ_END_PC,          &self->PC);
-  pega_mem(self, IRQ_END_A,           &self->A);
-  pega_mem(self, IRQ_END_X,           &self->X);
+  if (self->direto) {
+    self->PC = self->salvo.PC;
+    self->A = self->salvo.A;
+    self->X = self->salvo.X;
+    // como no retorno pela memória, em que a leitura do último campo deixa o
+    //   erro em ERR_OK, a CPU volta sem erro (o erro salvo é para o SO saber
+    //   o motivo da interrupção)
+    self->erro = ERR_OK;
+    self->complemento = self->salvo.complemento;
+    self->modo = self->salvo.modo;
+    self->direto = false;
+    esquece_sequencia(self);
+    return;
+  }
+  pega_mem(self, self->area + IRQ_END_PC,          &self->PC);
+  pega_mem(self, self->area + IRQ_END_A,           &self->A);
+  pega_mem(self, self->area + IRQ_END_X,           &self->X);
   // não dá para pegar o erro nem o modo diretamente porque eles não são int
   int dado;
-  pega_mem(self, IRQ_END_erro,        &dado);
+  pega_mem(self, self->area + IRQ_END_erro,        &dado);
   self->erro = dado;
-  pega_mem(self, IRQ_END_complemento, &self->complemento);
-  pega_mem(self, IRQ_END_modo,        &dado);
+  pega_mem(self, self->area + IRQ_END_complemento, &self->complemento);
+  pega_mem(self, self->area + IRQ_END_modo,        &dado);
   self->modo = dado;
+  esquece_sequencia(self);
 }
 
 // vim: foldmethod=marker
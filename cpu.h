@@ -19,10 +19,40 @@ typedef enum { supervisor, usuario } cpu_modo_t;
 // tipo da função a ser chamada quando executar a instrução CHAMAC
 typedef int (*func_chamaC_t)(void *argC, int reg_A);
 
+// estado da CPU salvo numa interrupção, no tratamento direto (ver
+//   cpu_define_tratador); os campos correspondem aos endereços IRQ_END_* da
+//   área de salvamento
+typedef struct {
+  int PC;
+  int A;
+  int X;
+  int erro;
+  int complemento;
+  int modo;
+} cpu_estado_t;
+
+// tipo da função chamada no tratamento direto de uma interrupção
+// recebe a interrupção e o estado salvo, que pode alterar; retorna o que o
+//   CHAMAC do tratador em assembly colocaria em A (0 para retornar da
+//   interrupção, outro valor para a CPU parar)
+typedef int (*func_tratador_t)(void *arg, irq_t irq, cpu_estado_t *estado);
+
+// os motores de execução de instruções
+//   CPU_MOTOR_SWITCH: busca, decodifica e executa cada instrução com um switch
+//     (é o motor de referência)
+//   CPU_MOTOR_ENCADEADO: despacho encadeado (computed goto), com PC, A e X em
+//     variáveis locais; o estado resultante é idêntico ao do motor switch
+// os dois motores executam algumas sequências frequentes de instruções como
+//   uma superinstrução, quando a sequência cabe inteira no lote
+typedef enum { CPU_MOTOR_SWITCH, CPU_MOTOR_ENCADEADO } cpu_motor_t;
+
 
 // cria uma unidade de execução com acesso à memória e ao
 //   controlador de E/S fornecidos
-cpu_t *cpu_cria(mem_t *mem, es_t *es);
+// 'id' é o número da CPU na máquina (0 se só tem uma), que define a área de
+//   memória onde ela salva o estado nas interrupções (ver irq_area); várias
+//   CPUs podem compartilhar a mesma memória
+cpu_t *cpu_cria(mem_t *mem, es_t *es, int id);
 
 // destrói a unidade de execução
 void cpu_destroi(cpu_t *self);
@@ -33,6 +63,19 @@ void cpu_destroi(cpu_t *self);
 //     e causa uma interrupção
 void cpu_executa_1(cpu_t *self);
 
+// executa até 'n' instruções, em sequência (um lote)
+// o lote termina antes de 'n' instruções se:
+//   - a CPU entrar em erro (causa uma interrupção, como em cpu_executa_1)
+//     ou parar (instrução PARA);
+//   - uma interrupção for aceita (CHAMAS) ou a CPU retornar de uma (RETI);
+//   - uma instrução acessar dispositivos ou o SO (LE, ESCR, CHAMAC). Essas
+//     instruções só são executadas como primeira do lote, e o terminam.
+// assim, quem controla a CPU pode fazer o tempo passar de uma vez para todo
+//   o lote: durante o lote, nada fora da CPU observa o tempo.
+// retorna o número de instruções executadas (contando a que causou erro);
+//   se a CPU estiver em erro ou parada, não executa nada e retorna 0
+int cpu_executa_n(cpu_t *self, int n);
+
 // implementa uma interrupção
 // passa para modo supervisor, salva o estado da CPU no início da memória,
 //   altera A para identificar a requisição de interrupção, altera PC para
@@ -44,6 +87,62 @@ bool cpu_interrompe(cpu_t *self, irq_t irq);
 // e o argumento a passar para ela (normalmente, um ponteiro para o SO)
 void cpu_define_chamaC(cpu_t *self, func_chamaC_t func, void *argC);
 
+// liga o tratamento direto das interrupções, com 'func' (NULL desliga)
+// no tratamento direto, a CPU não salva o estado na memória nem executa o
+//   tratador em assembly (trata_int.asm): ela guarda o estado num
+//   cpu_estado_t, chama 'func' no lugar do CHAMAC e faz o que o resto do
+//   tratador faria (RETI com o estado alterado por 'func', ou PARA)
+// o PC, o modo e o tempo (as 3 instruções do tratador, nos mesmos lotes)
+//   são os mesmos da execução do tratador; a diferença visível é que a área
+//   de salvamento na memória não é atualizada
+// uma interrupção aceita antes de ligar (como o reset) é tratada pelo
+//   tratador em assembly
+void cpu_define_tratador(cpu_t *self, func_tratador_t func, void *arg);
+
+// escolhe o motor de execução de instruções (o padrão é CPU_MOTOR_SWITCH)
+void cpu_define_motor(cpu_t *self, cpu_motor_t motor);
+
+// liga ou desliga o JIT: blocos de código muito executados em modo usuário
+//   passam a ser traduzidos para código nativo e executados diretamente
+//   (o resto continua com o motor escolhido)
+// se 'compara' for true, cada bloco nativo executado é também interpretado a
+//   partir do mesmo estado, e diferenças no resultado (registradores ou
+//   memória) são informadas na console; vale o resultado do interpretador
+// desligar o JIT descarta também o código carregado com cpu_carrega_nativo
+// retorna false se não é possível usar o JIT neste computador
+bool cpu_define_jit(cpu_t *self, bool ativo, bool compara);
+
+// carrega o código nativo de um programa, gerado antes da execução pelo
+//   tradutor na biblioteca 'nome', para ser usado na execução em modo
+//   usuário (mesmo com o JIT desligado)
+// só é usado se o programa traduzido for igual ao que está na memória (ele
+//   deve ser carregado antes); alterações posteriores no código invalidam a
+//   parte alterada, que volta a ser interpretada
+// retorna false se não foi possível carregar
+bool cpu_carrega_nativo(cpu_t *self, char *nome);
+
+// liga ou desliga o modo perfil, que conta quantas vezes cada sequência de 2
+//   e de 3 instruções é executada, para orientar a escolha de superinstruções
+// no modo perfil a CPU usa sempre o motor switch, sem JIT e sem
+//   superinstruções, para contar as instruções que estão no código
+void cpu_define_perfil(cpu_t *self, bool ativo);
+
+// informa na console as sequências de instruções mais executadas desde que o
+//   modo perfil foi ligado
+void cpu_relata_perfil(cpu_t *self);
+
+// confere com a memória as instruções decodificadas desde a última chamada,
+//   e descarta as que foram alteradas sem aviso
+// com as CPUs em threads, a escrita feita por uma CPU ao mesmo tempo que a
+//   outra decodifica o mesmo endereço pode não ser avisada (ver memoria.h);
+//   o controle chama esta função para cada CPU no fim de cada janela, com
+//   todas as CPUs paradas
+void cpu_revalida_decodificacao(cpu_t *self);
+
+// retorna true se a CPU está parada (executou PARA), esperando uma
+//   interrupção para continuar
+bool cpu_parada(cpu_t *self);
+
 // concatena a descrição do estado da CPU no final de str
 void cpu_concatena_descricao(cpu_t *self, char *str);
 
@@ -6,6 +6,8 @@
 #ifndef DISPOSITIVOS_H
 #define DISPOSITIVOS_H
 
+#include "irq.h"
+
 typedef enum {
   D_TERM_A_TECLADO        =  0,
   D_TERM_A_TECLADO_OK     =  1,
@@ -31,8 +33,20 @@ typedef enum {
   D_RELOGIO_REAL          = 17,
   D_RELOGIO_TIMER         = 18,
   D_RELOGIO_INTERRUPCAO   = 19,
-  N_DISPOSITIVOS
+
+  // escrever 'k' pede uma interrupção (IRQ_IPI) para a CPU k
+  D_IPI                   = 20,
+
+  // timer e pedido de interrupção das CPUs 1 em diante, dois para cada CPU
+  //   (os da CPU 0 são D_RELOGIO_TIMER e D_RELOGIO_INTERRUPCAO); ver D_TIMER
+  D_TIMERS                = 21,
+  N_DISPOSITIVOS          = D_TIMERS + 2 * (MAX_CPUS - 1)
 } dispositivo_id_t;
 
+// o timer e o pedido de interrupção do relógio da CPU 'k'
+#define D_TIMER(k) \
+  ((k) == 0 ? D_RELOGIO_TIMER : D_TIMERS + 2 * ((k) - 1))
+#define D_TIMER_INTERRUPCAO(k) (D_TIMER(k) + 1)
+
 #endif // DISPOSITIVOS_H
 
@@ -0,0 +1,51 @@
+// escalonador.h
+// operações de uma política de escalonamento de processos
+// simulador de computador
+// so24b
+
+#ifndef ESCALONADOR_H
+#define ESCALONADOR_H
+
+// cada política fornece uma tabela com as operações abaixo; o SO escolhe a
+//   política na inicialização e só chama o escalonador através da tabela
+// o escalonador guarda os processos prontos; o processo escolhido sai dele
+//   enquanto executa, e volta (insere) quando sai da CPU ainda pronto
+// as operações são chamadas pelo SO com a trava do núcleo, e usam os campos
+//   do processo reservados para o escalonador (QUANTUM, nivel, vruntime,
+//   peso e os encadeamentos)
+
+#include "processo.h"
+
+#include <stdbool.h>
+
+typedef struct {
+  char *nome;
+  // cria o estado da política, com o quantum (em interrupções do relógio)
+  void *(*cria)(int quantum);
+  void (*destroi)(void *esc);
+  // o processo ficou pronto: foi criado, desbloqueado (depois de acorda) ou
+  //   tirado da CPU
+  void (*insere)(void *esc, processo *p);
+  // o processo pronto não pode mais ser escolhido (morreu)
+  void (*remove)(void *esc, processo *p);
+  // retira e retorna o próximo processo a executar (NULL se não tem pronto)
+  processo *(*escolhe)(void *esc);
+  // houve uma interrupção do relógio na CPU que está executando 'p' (NULL se
+  //   está parada)
+  void (*tique)(void *esc, processo *p);
+  // retorna true se o processo que está executando deve sair da CPU agora
+  bool (*deve_trocar)(void *esc, processo *p);
+  // o processo que estava executando bloqueou
+  void (*bloqueia)(void *esc, processo *p, tipo_bloqueio_t tipo);
+  // o processo bloqueado vai ficar pronto (é inserido em seguida)
+  void (*acorda)(void *esc, processo *p);
+} escalonador_ops_t;
+
+// round-robin: uma fila, todos com o mesmo quantum
+extern escalonador_ops_t escalonador_rr;
+// filas multinível com realimentação (ver so.h)
+extern escalonador_ops_t escalonador_mlfq;
+// justo: executa o processo que executou menos, em tempo ponderado pelo peso
+extern escalonador_ops_t escalonador_cfs;
+
+#endif // ESCALONADOR_H
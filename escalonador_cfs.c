@@ -0,0 +1,238 @@
+// escalonador_cfs.c
+// escalonador justo, por tempo virtual de execução
+// simulador de computador
+// so24b
+
+// cada processo acumula um tempo virtual de execução (vruntime): a cada
+//   interrupção do relógio em que está executando, ele aumenta de
+//   VRUNTIME_TIQUE * PESO_NORMAL / peso, então quem tem mais peso tem uma
+//   parte maior da CPU (o processo escolhe o seu peso com SO_DEFINE_PESO)
+// os processos prontos ficam numa árvore AVL ordenada pelo vruntime (e pelo
+//   pid, para desempatar), e o escolhido é o de menor vruntime, o que está
+//   mais à esquerda
+// o processo escolhido executa pelo menos um quantum; depois disso, sai da
+//   CPU assim que tiver um pronto com vruntime menor que o dele; antes disso,
+//   só sai se ficar pronto um processo com vruntime menor por mais de um
+//   quantum (um processo que acordou, por exemplo)
+// min_vruntime acompanha o menor vruntime dos processos (só aumenta), e é
+//   usado para posicionar quem entra na árvore: um processo novo começa nele,
+//   e um processo que acorda fica no máximo meio quantum antes dele, para não
+//   ficar com a CPU pelo tempo todo em que esteve bloqueado
+
+#include "escalonador.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define VRUNTIME_TIQUE 1024
+
+typedef struct {
+  int quantum;
+  processo *raiz;
+  long long min_vruntime;
+} cfs_t;
+
+static void *cfs_cria(int quantum)
+{
+  cfs_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->quantum = quantum;
+  self->raiz = NULL;
+  self->min_vruntime = 0;
+  return self;
+}
+
+static void cfs_destroi(void *esc)
+{
+  free(esc);
+}
+
+// ÁRVORE {{{1
+
+static int altura(processo *p)
+{
+  return p == NULL ? 0 : p->altura;
+}
+
+static void recalcula_altura(processo *p)
+{
+  int ae = altura(p->esq);
+  int ad = altura(p->dir);
+  p->altura = 1 + (ae > ad ? ae : ad);
+}
+
+// true se 'a' vem antes de 'b' na árvore
+static bool antes(processo *a, processo *b)
+{
+  if (a->vruntime != b->vruntime) return a->vruntime < b->vruntime;
+  return getPID(a) < getPID(b);
+}
+
+static processo *gira_direita(processo *p)
+{
+  processo *e = p->esq;
+  p->esq = e->dir;
+  e->dir = p;
+  recalcula_altura(p);
+  recalcula_altura(e);
+  return e;
+}
+
+static processo *gira_esquerda(processo *p)
+{
+  processo *d = p->dir;
+  p->dir = d->esq;
+  d->esq = p;
+  recalcula_altura(p);
+  recalcula_altura(d);
+  return d;
+}
+
+// refaz o balanceamento de 'p', cujas subárvores estão balanceadas e têm
+//   alturas que diferem no máximo de 2; retorna a nova raiz
+static processo *balanceia(processo *p)
+{
+  recalcula_altura(p);
+  int fator = altura(p->esq) - altura(p->dir);
+  if (fator > 1) {
+    if (altura(p->esq->esq) < altura(p->esq->dir)) {
+      p->esq = gira_esquerda(p->esq);
+    }
+    return gira_direita(p);
+  }
+  if (fator < -1) {
+    if (altura(p->dir->dir) < altura(p->dir->esq)) {
+      p->dir = gira_direita(p->dir);
+    }
+    return gira_esquerda(p);
+  }
+  return p;
+}
+
+static processo *arvore_insere(processo *raiz, processo *p)
+{
+  if (raiz == NULL) {
+    p->esq = p->dir = NULL;
+    p->altura = 1;
+    return p;
+  }
+  if (antes(p, raiz)) raiz->esq = arvore_insere(raiz->esq, p);
+  else raiz->dir = arvore_insere(raiz->dir, p);
+  return balanceia(raiz);
+}
+
+// retira o primeiro da árvore 'raiz', que é colocado em *primeiro
+static processo *arvore_retira_primeiro(processo *raiz, processo **primeiro)
+{
+  if (raiz->esq == NULL) {
+    *primeiro = raiz;
+    return raiz->dir;
+  }
+  raiz->esq = arvore_retira_primeiro(raiz->esq, primeiro);
+  return balanceia(raiz);
+}
+
+static processo *arvore_remove(processo *raiz, processo *p)
+{
+  if (raiz == NULL) return NULL;
+  if (raiz != p) {
+    if (antes(p, raiz)) raiz->esq = arvore_remove(raiz->esq, p);
+    else raiz->dir = arvore_remove(raiz->dir, p);
+    return balanceia(raiz);
+  }
+  if (p->dir == NULL) return p->esq;
+  // o sucessor de 'p' fica no lugar dele
+  processo *sucessor;
+  processo *dir = arvore_retira_primeiro(p->dir, &sucessor);
+  sucessor->esq = p->esq;
+  sucessor->dir = dir;
+  return balanceia(sucessor);
+}
+
+static processo *arvore_primeiro(processo *raiz)
+{
+  if (raiz == NULL) return NULL;
+  while (raiz->esq != NULL) raiz = raiz->esq;
+  return raiz;
+}
+
+// OPERAÇÕES {{{1
+
+static void cfs_atualiza_min_vruntime(cfs_t *self, long long vruntime)
+{
+  processo *primeiro = arvore_primeiro(self->raiz);
+  if (primeiro != NULL && primeiro->vruntime < vruntime) {
+    vruntime = primeiro->vruntime;
+  }
+  if (vruntime > self->min_vruntime) self->min_vruntime = vruntime;
+}
+
+static void cfs_insere(void *esc, processo *p)
+{
+  cfs_t *self = esc;
+  if (p->vruntime < 0) p->vruntime = self->min_vruntime;
+  self->raiz = arvore_insere(self->raiz, p);
+}
+
+static void cfs_remove(void *esc, processo *p)
+{
+  cfs_t *self = esc;
+  self->raiz = arvore_remove(self->raiz, p);
+}
+
+static processo *cfs_escolhe(void *esc)
+{
+  cfs_t *self = esc;
+  if (self->raiz == NULL) return NULL;
+  processo *p;
+  self->raiz = arvore_retira_primeiro(self->raiz, &p);
+  setQuantum(p, self->quantum);
+  cfs_atualiza_min_vruntime(self, p->vruntime);
+  return p;
+}
+
+static void cfs_tique(void *esc, processo *p)
+{
+  cfs_t *self = esc;
+  if (p == NULL) return;
+  setQuantum(p, getQuantum(p) - 1);
+  p->vruntime += (long long)VRUNTIME_TIQUE * PESO_NORMAL / getPeso(p);
+  cfs_atualiza_min_vruntime(self, p->vruntime);
+}
+
+static bool cfs_deve_trocar(void *esc, processo *p)
+{
+  cfs_t *self = esc;
+  processo *primeiro = arvore_primeiro(self->raiz);
+  if (primeiro == NULL) return false;
+  long long vantagem = p->vruntime - primeiro->vruntime;
+  if (getQuantum(p) <= 0) return vantagem > 0;
+  return vantagem > (long long)self->quantum * VRUNTIME_TIQUE;
+}
+
+static void cfs_bloqueia(void *esc, processo *p, tipo_bloqueio_t tipo)
+{
+}
+
+static void cfs_acorda(void *esc, processo *p)
+{
+  cfs_t *self = esc;
+  long long limite = self->min_vruntime
+                   - (long long)self->quantum * VRUNTIME_TIQUE / 2;
+  if (p->vruntime < limite) p->vruntime = limite;
+}
+
+escalonador_ops_t escalonador_cfs = {
+  .nome = "cfs",
+  .cria = cfs_cria,
+  .destroi = cfs_destroi,
+  .insere = cfs_insere,
+  .remove = cfs_remove,
+  .escolhe = cfs_escolhe,
+  .tique = cfs_tique,
+  .deve_trocar = cfs_deve_trocar,
+  .bloqueia = cfs_bloqueia,
+  .acorda = cfs_acorda,
+};
+
+// vim: foldmethod=marker
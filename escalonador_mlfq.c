@@ -0,0 +1,158 @@
+// escalonador_mlfq.c
+// escalonador com filas multinível e realimentação
+// simulador de computador
+// so24b
+
+// os processos prontos ficam numa fila por nível (o nível 0 é o mais
+//   prioritário), e o escolhido é o primeiro do nível mais prioritário com
+//   processo, que é o bit menos significativo ligado no mapa de níveis
+// o quantum dobra a cada nível; quem usa todo o quantum desce um nível, quem
+//   bloqueia por E/S sobe um, e o processo que está executando sai da CPU se
+//   ficar pronto um processo de nível mais prioritário
+// periodicamente, todos os processos voltam para o nível 0, para os de nível
+//   menos prioritário não ficarem sem executar; os que estão nas filas mudam
+//   de fila na hora, os outros (executando ou bloqueados) quando voltarem
+//   para o escalonador: o nível de um processo só vale se foi definido desde
+//   a última promoção (campo epoca)
+
+#include "escalonador.h"
+#include "console.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#define MLFQ_NIVEIS 4
+#define MLFQ_PERIODO_PROMOCAO 100  // em interrupções do relógio
+
+typedef struct {
+  int quantum;
+  fila_processos_t filas[MLFQ_NIVEIS];
+  unsigned mapa;                   // bit n ligado se a fila n não está vazia
+  int tiques_ate_promocao;
+  int epoca;                       // número de promoções feitas
+} mlfq_t;
+
+static void *mlfq_cria(int quantum)
+{
+  mlfq_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->quantum = quantum;
+  for (int nivel = 0; nivel < MLFQ_NIVEIS; nivel++) {
+    inicializa_fila_processos(&self->filas[nivel]);
+  }
+  self->mapa = 0;
+  self->tiques_ate_promocao = MLFQ_PERIODO_PROMOCAO;
+  self->epoca = 0;
+  return self;
+}
+
+static void mlfq_destroi(void *esc)
+{
+  free(esc);
+}
+
+// o nível do processo, considerando as promoções
+static int mlfq_nivel(mlfq_t *self, processo *p)
+{
+  return p->epoca == self->epoca ? getNivel(p) : 0;
+}
+
+// o processo (que não está em fila) muda para o nível 'nivel'
+static void mlfq_muda_nivel(mlfq_t *self, processo *p, int nivel)
+{
+  if (nivel < 0) nivel = 0;
+  if (nivel >= MLFQ_NIVEIS) nivel = MLFQ_NIVEIS - 1;
+  if (nivel != mlfq_nivel(self, p)) {
+    log_depura(LOG_SO, "SO: processo %d do nível %d para %d", getPID(p),
+               mlfq_nivel(self, p), nivel);
+  }
+  setNivel(p, nivel);
+  p->epoca = self->epoca;
+}
+
+static void mlfq_insere(void *esc, processo *p)
+{
+  mlfq_t *self = esc;
+  mlfq_muda_nivel(self, p, mlfq_nivel(self, p));
+  int nivel = getNivel(p);
+  fila_insere_processo(&self->filas[nivel], p);
+  self->mapa |= 1u << nivel;
+}
+
+static void mlfq_remove(void *esc, processo *p)
+{
+  mlfq_t *self = esc;
+  fila_processos_t *fila = &self->filas[getNivel(p)];
+  fila_remove_processo(fila, p);
+  if (fila->n == 0) self->mapa &= ~(1u << getNivel(p));
+}
+
+static processo *mlfq_escolhe(void *esc)
+{
+  mlfq_t *self = esc;
+  if (self->mapa == 0) return NULL;
+  processo *p = self->filas[__builtin_ctz(self->mapa)].primeiro;
+  mlfq_remove(self, p);
+  setQuantum(p, self->quantum << getNivel(p));
+  return p;
+}
+
+// passa todos os processos para o nível 0
+static void mlfq_promove_todos(mlfq_t *self)
+{
+  log_depura(LOG_SO, "SO: promoção de todos os processos para o nível 0");
+  self->epoca++;
+  for (int nivel = 1; nivel < MLFQ_NIVEIS; nivel++) {
+    processo *p;
+    while ((p = self->filas[nivel].primeiro) != NULL) {
+      mlfq_remove(self, p);
+      mlfq_insere(self, p);
+    }
+  }
+}
+
+static void mlfq_tique(void *esc, processo *p)
+{
+  mlfq_t *self = esc;
+  if (--self->tiques_ate_promocao <= 0) {
+    self->tiques_ate_promocao = MLFQ_PERIODO_PROMOCAO;
+    mlfq_promove_todos(self);
+  }
+  if (p == NULL) return;
+  setQuantum(p, getQuantum(p) - 1);
+  // usou todo o quantum, desce um nível
+  if (getQuantum(p) <= 0) mlfq_muda_nivel(self, p, mlfq_nivel(self, p) + 1);
+}
+
+static bool mlfq_deve_trocar(void *esc, processo *p)
+{
+  mlfq_t *self = esc;
+  if (getQuantum(p) <= 0) return true;
+  return self->mapa != 0 && __builtin_ctz(self->mapa) < mlfq_nivel(self, p);
+}
+
+static void mlfq_bloqueia(void *esc, processo *p, tipo_bloqueio_t tipo)
+{
+  mlfq_t *self = esc;
+  // quem bloqueia por E/S sobe de nível
+  if (tipo == ESPERANDO_ENTRADA || tipo == ESPERANDO_SAIDA) {
+    mlfq_muda_nivel(self, p, mlfq_nivel(self, p) - 1);
+  }
+}
+
+static void mlfq_acorda(void *esc, processo *p)
+{
+}
+
+escalonador_ops_t escalonador_mlfq = {
+  .nome = "mlfq",
+  .cria = mlfq_cria,
+  .destroi = mlfq_destroi,
+  .insere = mlfq_insere,
+  .remove = mlfq_remove,
+  .escolhe = mlfq_escolhe,
+  .tique = mlfq_tique,
+  .deve_trocar = mlfq_deve_trocar,
+  .bloqueia = mlfq_bloqueia,
+  .acorda = mlfq_acorda,
+};
@@ -0,0 +1,83 @@
+// escalonador_rr.c
+// escalonador round-robin
+// simulador de computador
+// so24b
+
+// os processos prontos ficam numa fila, na ordem em que vão executar; o
+//   processo escolhido recebe um quantum, e sai da CPU quando ele acaba (e
+//   volta para o fim da fila, que pode estar vazia)
+
+#include "escalonador.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct {
+  int quantum;
+  fila_processos_t prontos;
+} rr_t;
+
+static void *rr_cria(int quantum)
+{
+  rr_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->quantum = quantum;
+  inicializa_fila_processos(&self->prontos);
+  return self;
+}
+
+static void rr_destroi(void *esc)
+{
+  free(esc);
+}
+
+static void rr_insere(void *esc, processo *p)
+{
+  rr_t *self = esc;
+  fila_insere_processo(&self->prontos, p);
+}
+
+static void rr_remove(void *esc, processo *p)
+{
+  rr_t *self = esc;
+  fila_remove_processo(&self->prontos, p);
+}
+
+static processo *rr_escolhe(void *esc)
+{
+  rr_t *self = esc;
+  processo *p = fila_retira_primeiro(&self->prontos);
+  if (p != NULL) setQuantum(p, self->quantum);
+  return p;
+}
+
+static void rr_tique(void *esc, processo *p)
+{
+  if (p != NULL) setQuantum(p, getQuantum(p) - 1);
+}
+
+static bool rr_deve_trocar(void *esc, processo *p)
+{
+  return getQuantum(p) <= 0;
+}
+
+static void rr_bloqueia(void *esc, processo *p, tipo_bloqueio_t tipo)
+{
+}
+
+static void rr_acorda(void *esc, processo *p)
+{
+}
+
+escalonador_ops_t escalonador_rr = {
+  .nome = "rr",
+  .cria = rr_cria,
+  .destroi = rr_destroi,
+  .insere = rr_insere,
+  .remove = rr_remove,
+  .escolhe = rr_escolhe,
+  .tique = rr_tique,
+  .deve_trocar = rr_deve_trocar,
+  .bloqueia = rr_bloqueia,
+  .acorda = rr_acorda,
+};
@@ -0,0 +1,251 @@
+// escritor.c
+// escrita de linhas num arquivo, em segundo plano
+// simulador de computador
+// so24b
+
+// O buffer é uma fila circular de bytes com um produtor (quem chama
+//   escritor_linha) e um consumidor (a thread de escrita), sem trava: cada
+//   um só altera o seu índice, e os índices são atômicos. O produtor só
+//   publica o novo fim depois de copiar a linha inteira, então o consumidor
+//   sempre vê linhas completas. O consumidor escreve de uma vez tudo o que
+//   encontra no buffer (com writev, porque o bloco pode dar a volta no fim do
+//   buffer), e dorme um pouco quando não tem nada.
+
+#include "escritor.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+// tamanho do buffer (tem que ser potência de 2, os índices dão a volta)
+#define TAM_BUFFER (1 << 20)
+
+// número de arquivos antigos mantidos quando o arquivo é rodado
+#define N_ARQUIVOS_VELHOS 3
+
+// tempo que a thread de escrita dorme quando o buffer está vazio (ms)
+#define ESPERA_MS 2
+
+struct escritor_t {
+  char *nome;
+  int fd;
+  long tam_max;
+  long tam_arquivo;         // bytes já escritos no arquivo atual
+  char *buffer;
+  // os índices crescem sem parar; a posição no buffer é o resto da divisão
+  //   por TAM_BUFFER. 'ini' é alterado só pela thread de escrita, 'fim' só
+  //   por quem coloca linhas
+  atomic_uint ini;
+  atomic_uint fim;
+  atomic_long descartadas;
+  atomic_bool termina;
+  pthread_t thread;
+};
+
+static void *escritor_laco(void *arg);
+
+// CRIAÇÃO {{{1
+
+escritor_t *escritor_cria(char *nome, long tam_max)
+{
+  int fd = open(nome, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return NULL;
+  escritor_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->nome = strdup(nome);
+  self->buffer = malloc(TAM_BUFFER);
+  assert(self->nome != NULL && self->buffer != NULL);
+  self->fd = fd;
+  self->tam_max = tam_max;
+  self->tam_arquivo = 0;
+  atomic_init(&self->ini, 0);
+  atomic_init(&self->fim, 0);
+  atomic_init(&self->descartadas, 0);
+  atomic_init(&self->termina, false);
+  int err = pthread_create(&self->thread, NULL, escritor_laco, self);
+  assert(err == 0);
+  return self;
+}
+
+void escritor_destroi(escritor_t *self)
+{
+  // a thread só termina depois de esvaziar o buffer
+  atomic_store(&self->termina, true);
+  pthread_join(self->thread, NULL);
+  long descartadas = atomic_load(&self->descartadas);
+  if (descartadas > 0 && self->fd >= 0) {
+    dprintf(self->fd, "ESCRITOR: %ld linhas descartadas\n", descartadas);
+  }
+  if (self->fd >= 0) close(self->fd);
+  free(self->buffer);
+  free(self->nome);
+  free(self);
+}
+
+long escritor_descartadas(escritor_t *self)
+{
+  return atomic_load(&self->descartadas);
+}
+
+// PRODUTOR {{{1
+
+// copia 'n' bytes de 's' para o buffer, a partir do índice 'pos'
+static void copia_para_buffer(escritor_t *self, unsigned pos, char *s,
+                              unsigned n)
+{
+  unsigned i = pos % TAM_BUFFER;
+  unsigned ate_o_fim = TAM_BUFFER - i;
+  if (n <= ate_o_fim) {
+    memcpy(&self->buffer[i], s, n);
+  } else {
+    memcpy(&self->buffer[i], s, ate_o_fim);
+    memcpy(self->buffer, s + ate_o_fim, n - ate_o_fim);
+  }
+}
+
+void escritor_linha(escritor_t *self, char *s)
+{
+  unsigned tam = strlen(s);
+  unsigned fim = atomic_load_explicit(&self->fim, memory_order_relaxed);
+  unsigned ini = atomic_load_explicit(&self->ini, memory_order_acquire);
+  if (tam + 1 > TAM_BUFFER - (fim - ini)) {
+    atomic_fetch_add_explicit(&self->descartadas, 1, memory_order_relaxed);
+    return;
+  }
+  copia_para_buffer(self, fim, s, tam);
+  self->buffer[(fim + tam) % TAM_BUFFER] = '\n';
+  atomic_store_explicit(&self->fim, fim + tam + 1, memory_order_release);
+}
+
+// THREAD DE ESCRITA {{{1
+
+static char byte_do_buffer(escritor_t *self, unsigned pos)
+{
+  return self->buffer[pos % TAM_BUFFER];
+}
+
+// troca o arquivo por um novo, renomeando os antigos
+// o arquivo novo é aberto antes de mexer nos antigos; se não for possível
+//   abrir, o arquivo atual continua sendo usado, e não é mais rodado
+static void roda_arquivo(escritor_t *self)
+{
+  int tam_nome = strlen(self->nome) + 12;
+  char velho[tam_nome], novo[tam_nome];
+  snprintf(novo, tam_nome, "%s.novo", self->nome);
+  int fd = open(novo, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    dprintf(self->fd, "ESCRITOR: não foi possível criar '%s' (%s), o arquivo"
+            " não será mais rodado\n", novo, strerror(errno));
+    self->tam_max = 0;
+    return;
+  }
+  for (int i = N_ARQUIVOS_VELHOS - 1; i >= 1; i--) {
+    snprintf(velho, tam_nome, "%s.%d", self->nome, i);
+    snprintf(novo, tam_nome, "%s.%d", self->nome, i + 1);
+    rename(velho, novo);
+  }
+  snprintf(novo, tam_nome, "%s.1", self->nome);
+  rename(self->nome, novo);
+  snprintf(velho, tam_nome, "%s.novo", self->nome);
+  rename(velho, self->nome);
+  close(self->fd);
+  self->fd = fd;
+  self->tam_arquivo = 0;
+}
+
+// conta as linhas que terminam nos 'n' bytes do buffer a partir de 'ini'
+static long conta_linhas(escritor_t *self, unsigned ini, unsigned n)
+{
+  long linhas = 0;
+  for (unsigned i = 0; i < n; i++) {
+    if (byte_do_buffer(self, ini + i) == '\n') linhas++;
+  }
+  return linhas;
+}
+
+// retorna quantos dos 'n' bytes a partir de 'ini' podem ser escritos no
+//   arquivo atual sem passar do tamanho máximo, terminando numa linha
+//   completa; se não couber nenhuma linha e o arquivo estiver vazio, a
+//   primeira linha é escrita mesmo assim
+static unsigned bytes_que_cabem(escritor_t *self, unsigned ini, unsigned n)
+{
+  if (self->tam_max == 0) return n;
+  long resta = self->tam_max - self->tam_arquivo;
+  if (n <= resta) return n;
+  for (long i = resta; i > 0; i--) {
+    if (byte_do_buffer(self, ini + i - 1) == '\n') return i;
+  }
+  if (self->tam_arquivo > 0) return 0;
+  unsigned i = 1;
+  while (byte_do_buffer(self, ini + i - 1) != '\n') i++;
+  return i;
+}
+
+// escreve 'n' bytes do buffer a partir de 'ini', e os libera
+static void escreve_bloco(escritor_t *self, unsigned ini, unsigned n)
+{
+  while (n > 0) {
+    unsigned i = ini % TAM_BUFFER;
+    unsigned ate_o_fim = TAM_BUFFER - i;
+    struct iovec iov[2];
+    int n_iov = 1;
+    iov[0].iov_base = &self->buffer[i];
+    iov[0].iov_len = (n < ate_o_fim) ? n : ate_o_fim;
+    if (n > ate_o_fim) {
+      iov[1].iov_base = self->buffer;
+      iov[1].iov_len = n - ate_o_fim;
+      n_iov = 2;
+    }
+    ssize_t escritos = writev(self->fd, iov, n_iov);
+    if (escritos < 0) {
+      if (errno == EINTR) continue;
+      // não tem o que fazer com um erro de escrita, o bloco é perdido, e
+      //   suas linhas são contadas como descartadas
+      atomic_fetch_add_explicit(&self->descartadas,
+                                conta_linhas(self, ini, n),
+                                memory_order_relaxed);
+      escritos = n;
+    } else {
+      self->tam_arquivo += escritos;
+    }
+    ini += escritos;
+    n -= escritos;
+    atomic_store_explicit(&self->ini, ini, memory_order_release);
+  }
+}
+
+static void *escritor_laco(void *arg)
+{
+  escritor_t *self = arg;
+  for (;;) {
+    // 'termina' é lido antes de 'fim', para não perder o que foi colocado
+    //   antes do pedido de término
+    bool termina = atomic_load(&self->termina);
+    unsigned ini = atomic_load_explicit(&self->ini, memory_order_relaxed);
+    unsigned fim = atomic_load_explicit(&self->fim, memory_order_acquire);
+    if (ini == fim) {
+      if (termina) break;
+      struct timespec ts = { 0, ESPERA_MS * 1000000 };
+      nanosleep(&ts, NULL);
+      continue;
+    }
+    unsigned n = bytes_que_cabem(self, ini, fim - ini);
+    if (n == 0) {
+      roda_arquivo(self);
+      continue;
+    }
+    escreve_bloco(self, ini, n);
+  }
+  return NULL;
+}
+
+// vim: foldmethod=marker
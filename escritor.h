@@ -0,0 +1,38 @@
+// escritor.h
+// escrita de linhas num arquivo, em segundo plano
+// simulador de computador
+// so24b
+
+#ifndef ESCRITOR_H
+#define ESCRITOR_H
+
+// O escritor guarda as linhas num buffer circular de tamanho fixo, e uma
+//   thread separada as escreve no arquivo em blocos grandes. Quem escreve
+//   nunca espera pelo disco: se o buffer estiver cheio, a linha é descartada
+//   (e contada).
+// O arquivo pode ser "rodado" quando chega num tamanho máximo: o arquivo
+//   "nome" vira "nome.1", o "nome.1" vira "nome.2" etc, e um "nome" novo é
+//   criado. Só alguns arquivos antigos são mantidos. Se o arquivo novo não
+//   puder ser criado, o atual continua sendo usado, sem limite de tamanho.
+
+typedef struct escritor_t escritor_t;
+
+// cria um escritor para o arquivo 'nome' (que é truncado)
+// se 'tam_max' não for 0, o arquivo é rodado antes de passar de 'tam_max'
+//   bytes (a não ser que tenha uma linha maior que isso)
+// retorna NULL se não conseguir abrir o arquivo
+escritor_t *escritor_cria(char *nome, long tam_max);
+
+// escreve o que ainda está no buffer, e destrói o escritor
+// se alguma linha foi descartada, escreve no final do arquivo quantas
+void escritor_destroi(escritor_t *self);
+
+// coloca a linha 's' no buffer para ser escrita no arquivo (com um '\n' no
+//   final); não espera a escrita
+void escritor_linha(escritor_t *self, char *s);
+
+// retorna o número de linhas descartadas por falta de espaço no buffer ou
+//   por erro de escrita no arquivo
+long escritor_descartadas(escritor_t *self);
+
+#endif // ESCRITOR_H
@@ -0,0 +1,212 @@
+// eventos.c
+// fila de eventos dos dispositivos, ordenada pelo tempo simulado
+// simulador de computador
+// so24b
+
+// Os eventos ficam num vetor, indexado pelo identificador; a ordem é mantida
+//   por um heap binário de identificadores, ordenado pela hora do evento (e
+//   pela ordem de agendamento, para desempatar). Cada evento sabe sua posição
+//   no heap, para poder ser cancelado sem busca.
+
+#include "eventos.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+// número de eventos para os quais tem espaço inicialmente (cresce se precisar)
+#define N_EVENTOS_INICIAL 16
+
+typedef struct {
+  int quando;
+  long long ordem;        // número de agendamento, para desempate
+  eventos_func_t func;
+  void *arg;
+  int dado;
+  int pos;                // posição no heap; -1 se o identificador está livre
+} evento_t;
+
+struct eventos_t {
+  int agora;
+  long long n_agendados;
+  int cap;                // número de eventos com espaço alocado
+  evento_t *ev;           // os eventos, indexados pelo identificador
+  int *heap;              // identificadores dos eventos pendentes
+  int n_heap;
+  int *livres;            // identificadores livres
+  int n_livres;
+  // quem é avisado quando um evento é agendado
+  eventos_func_t f_aviso;
+  void *arg_aviso;
+};
+
+// CRIAÇÃO {{{1
+
+eventos_t *eventos_cria(void)
+{
+  eventos_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  self->agora = 0;
+  self->n_agendados = 0;
+  self->f_aviso = NULL;
+  self->cap = 0;
+  self->ev = NULL;
+  self->heap = NULL;
+  self->livres = NULL;
+  self->n_heap = 0;
+  self->n_livres = 0;
+  return self;
+}
+
+void eventos_destroi(eventos_t *self)
+{
+  free(self->ev);
+  free(self->heap);
+  free(self->livres);
+  free(self);
+}
+
+int eventos_agora(eventos_t *self)
+{
+  return self->agora;
+}
+
+// HEAP {{{1
+
+// true se o evento 'a' deve acontecer antes do 'b'
+static bool antes(eventos_t *self, int a, int b)
+{
+  evento_t *ea = &self->ev[a];
+  evento_t *eb = &self->ev[b];
+  if (ea->quando != eb->quando) return ea->quando < eb->quando;
+  return ea->ordem < eb->ordem;
+}
+
+static void coloca(eventos_t *self, int pos, int id)
+{
+  self->heap[pos] = id;
+  self->ev[id].pos = pos;
+}
+
+static void sobe(eventos_t *self, int pos)
+{
+  int id = self->heap[pos];
+  while (pos > 0) {
+    int pai = (pos - 1) / 2;
+    if (!antes(self, id, self->heap[pai])) break;
+    coloca(self, pos, self->heap[pai]);
+    pos = pai;
+  }
+  coloca(self, pos, id);
+}
+
+static void desce(eventos_t *self, int pos)
+{
+  int id = self->heap[pos];
+  for (;;) {
+    int filho = 2 * pos + 1;
+    if (filho >= self->n_heap) break;
+    if (filho + 1 < self->n_heap
+        && antes(self, self->heap[filho + 1], self->heap[filho])) {
+      filho++;
+    }
+    if (!antes(self, self->heap[filho], id)) break;
+    coloca(self, pos, self->heap[filho]);
+    pos = filho;
+  }
+  coloca(self, pos, id);
+}
+
+// tira do heap o evento na posição 'pos', e libera seu identificador
+static void remove_do_heap(eventos_t *self, int pos)
+{
+  int id = self->heap[pos];
+  self->ev[id].pos = -1;
+  self->livres[self->n_livres++] = id;
+  self->n_heap--;
+  if (pos == self->n_heap) return;
+  // o último do heap vai para o lugar do removido, e sobe ou desce
+  int ultimo = self->heap[self->n_heap];
+  coloca(self, pos, ultimo);
+  sobe(self, pos);
+  desce(self, self->ev[ultimo].pos);
+}
+
+// garante que tem um identificador livre
+static void garante_espaco(eventos_t *self)
+{
+  if (self->n_livres > 0) return;
+  int nova_cap = self->cap == 0 ? N_EVENTOS_INICIAL : self->cap * 2;
+  self->ev = realloc(self->ev, nova_cap * sizeof(*self->ev));
+  self->heap = realloc(self->heap, nova_cap * sizeof(*self->heap));
+  self->livres = realloc(self->livres, nova_cap * sizeof(*self->livres));
+  assert(self->ev != NULL && self->heap != NULL && self->livres != NULL);
+  // os novos identificadores ficam livres, os menores no topo da pilha
+  for (int id = nova_cap - 1; id >= self->cap; id--) {
+    self->ev[id].pos = -1;
+    self->livres[self->n_livres++] = id;
+  }
+  self->cap = nova_cap;
+}
+
+// AGENDAMENTO {{{1
+
+int eventos_agenda(eventos_t *self, int quando, eventos_func_t func,
+                   void *arg, int dado)
+{
+  if (quando <= self->agora) {
+    func(arg, dado);
+    return -1;
+  }
+  garante_espaco(self);
+  int id = self->livres[--self->n_livres];
+  evento_t *ev = &self->ev[id];
+  ev->quando = quando;
+  ev->ordem = self->n_agendados++;
+  ev->func = func;
+  ev->arg = arg;
+  ev->dado = dado;
+  coloca(self, self->n_heap++, id);
+  sobe(self, ev->pos);
+  if (self->f_aviso != NULL) self->f_aviso(self->arg_aviso, quando);
+  return id;
+}
+
+void eventos_define_aviso(eventos_t *self, eventos_func_t func, void *arg)
+{
+  self->f_aviso = func;
+  self->arg_aviso = arg;
+}
+
+void eventos_cancela(eventos_t *self, int id)
+{
+  if (id == -1) return;
+  assert(id >= 0 && id < self->cap && self->ev[id].pos != -1);
+  remove_do_heap(self, self->ev[id].pos);
+}
+
+// PASSAGEM DO TEMPO {{{1
+
+int eventos_tempo_ate_proximo(eventos_t *self)
+{
+  if (self->n_heap == 0) return 0;
+  return self->ev[self->heap[0]].quando - self->agora;
+}
+
+int eventos_avanca(eventos_t *self, int n)
+{
+  int fim = self->agora + n;
+  int n_eventos = 0;
+  while (self->n_heap > 0 && self->ev[self->heap[0]].quando <= fim) {
+    // copia o evento antes de liberar, a função pode agendar outro
+    evento_t ev = self->ev[self->heap[0]];
+    remove_do_heap(self, 0);
+    self->agora = ev.quando;
+    ev.func(ev.arg, ev.dado);
+    n_eventos++;
+  }
+  self->agora = fim;
+  return n_eventos;
+}
+
+// vim: foldmethod=marker
@@ -0,0 +1,60 @@
+// eventos.h
+// fila de eventos dos dispositivos, ordenada pelo tempo simulado
+// simulador de computador
+// so24b
+
+#ifndef EVENTOS_H
+#define EVENTOS_H
+
+// A fila de eventos mantém a hora atual da simulação (em unidades de tempo,
+//   que é o que uma instrução leva para executar), e os eventos programados
+//   pelos dispositivos para acontecer no futuro (o timer do relógio expirar,
+//   um terminal terminar de rolar ou limpar a saída, chegar um caractere na
+//   entrada de um terminal).
+// Um evento é uma função que é chamada quando o tempo chega na hora marcada.
+// O controlador faz o tempo passar, e só precisa se preocupar com os
+//   dispositivos quando algum evento acontece.
+
+typedef struct eventos_t eventos_t;
+
+// função chamada quando um evento acontece, com o argumento e o dado
+//   fornecidos quando o evento foi agendado
+typedef void (*eventos_func_t)(void *arg, int dado);
+
+// cria uma fila de eventos vazia, com a hora atual 0
+eventos_t *eventos_cria(void);
+
+// destrói a fila (os eventos ainda não acontecidos são descartados)
+void eventos_destroi(eventos_t *self);
+
+// retorna a hora atual
+int eventos_agora(eventos_t *self);
+
+// agenda um evento para acontecer na hora 'quando', chamando func(arg, dado)
+// eventos com a mesma hora acontecem na ordem em que foram agendados
+// se 'quando' não estiver no futuro, o evento acontece imediatamente (a
+//   função é chamada antes de retornar), e retorna -1
+// retorna um identificador do evento, que pode ser usado para cancelá-lo
+//   até ele acontecer (depois disso, o identificador pode ser reusado)
+int eventos_agenda(eventos_t *self, int quando, eventos_func_t func,
+                   void *arg, int dado);
+
+// define uma função a ser chamada (com 'arg' e a hora do evento) cada vez
+//   que um evento é agendado para o futuro (NULL para nenhuma); serve para o
+//   controlador saber que um evento foi agendado antes do que ele esperava
+void eventos_define_aviso(eventos_t *self, eventos_func_t func, void *arg);
+
+// cancela um evento que ainda não aconteceu; ignora o identificador -1
+void eventos_cancela(eventos_t *self, int id);
+
+// retorna quanto tempo falta para o próximo evento, ou 0 se não tem nenhum
+//   agendado
+int eventos_tempo_ate_proximo(eventos_t *self);
+
+// faz passar 'n' unidades de tempo, executando em ordem os eventos que
+//   acontecem nesse período; durante a execução de um evento, a hora atual é
+//   a hora marcada para ele
+// retorna o número de eventos que aconteceram
+int eventos_avanca(eventos_t *self, int n);
+
+#endif // EVENTOS_H
@@ -8,44 +8,46 @@
 #include <stddef.h>
 #include <string.h>
 
+// a tabela é indexada pelo opcode, para que nome e número de argumentos
+//   possam ser obtidos sem busca (instrucao_num_args é usada pela CPU)
 struct {
   char *nome;
   int num_args;
   opcode_t opcode;
-} instrucoes[] = {
-  { "NOP",    0,  NOP    },
-  { "PARA",   0,  PARA   },
-  { "CARGI",  1,  CARGI  },
-  { "CARGM",  1,  CARGM  },
-  { "CARGX",  1,  CARGX  },
-  { "ARMM",   1,  ARMM   },
-  { "ARMX",   1,  ARMX   },
-  { "TRAX",   0,  TRAX   },
-  { "CPXA",   0,  CPXA   },
-  { "INCX",   0,  INCX   },
-  { "SOMA",   1,  SOMA   },
-  { "SUB",    1,  SUB    },
-  { "MULT",   1,  MULT   },
-  { "DIV",    1,  DIV    },
-  { "RESTO",  1,  RESTO  },
-  { "NEG",    0,  NEG    },
-  { "DESV",   1,  DESV   },
-  { "DESVZ",  1,  DESVZ  },
-  { "DESVNZ", 1,  DESVNZ },
-  { "DESVN",  1,  DESVN  },
-  { "DESVP",  1,  DESVP  },
-  { "CHAMA",  1,  CHAMA  },
-  { "RET",    1,  RET    },
-  { "LE",     1,  LE     },
-  { "ESCR",   1,  ESCR   },
-  { "RETI",   0,  RETI   },
-  { "CHAMAC", 0,  CHAMAC },
-  { "CHAMAS", 0,  CHAMAS },
+} instrucoes[N_OPCODE] = {
+  [NOP]    = { "NOP",    0,  NOP    },
+  [PARA]   = { "PARA",   0,  PARA   },
+  [CARGI]  = { "CARGI",  1,  CARGI  },
+  [CARGM]  = { "CARGM",  1,  CARGM  },
+  [CARGX]  = { "CARGX",  1,  CARGX  },
+  [ARMM]   = { "ARMM",   1,  ARMM   },
+  [ARMX]   = { "ARMX",   1,  ARMX   },
+  [TRAX]   = { "TRAX",   0,  TRAX   },
+  [CPXA]   = { "CPXA",   0,  CPXA   },
+  [INCX]   = { "INCX",   0,  INCX   },
+  [SOMA]   = { "SOMA",   1,  SOMA   },
+  [SUB]    = { "SUB",    1,  SUB    },
+  [MULT]   = { "MULT",   1,  MULT   },
+  [DIV]    = { "DIV",    1,  DIV    },
+  [RESTO]  = { "RESTO",  1,  RESTO  },
+  [NEG]    = { "NEG",    0,  NEG    },
+  [DESV]   = { "DESV",   1,  DESV   },
+  [DESVZ]  = { "DESVZ",  1,  DESVZ  },
+  [DESVNZ] = { "DESVNZ", 1,  DESVNZ },
+  [DESVN]  = { "DESVN",  1,  DESVN  },
+  [DESVP]  = { "DESVP",  1,  DESVP  },
+  [CHAMA]  = { "CHAMA",  1,  CHAMA  },
+  [RET]    = { "RET",    1,  RET    },
+  [LE]     = { "LE",     1,  LE     },
+  [ESCR]   = { "ESCR",   1,  ESCR   },
+  [RETI]   = { "RETI",   0,  RETI   },
+  [CHAMAC] = { "CHAMAC", 0,  CHAMAC },
+  [CHAMAS] = { "CHAMAS", 0,  CHAMAS },
   // pseudo-instrucoes
-  { "VALOR",  1,  VALOR  },
-  { "STRING", 1,  STRING },
-  { "ESPACO", 1,  ESPACO },
-  { "DEFINE", 1,  DEFINE },
+  [VALOR]  = { "VALOR",  1,  VALOR  },
+  [STRING] = { "STRING", 1,  STRING },
+  [ESPACO] = { "ESPACO", 1,  ESPACO },
+  [DEFINE] = { "DEFINE", 1,  DEFINE },
 };
 
 opcode_t instrucao_opcode(char *nome)
@@ -61,21 +63,13 @@ opcode_t instrucao_opcode(char *nome)
 
 char *instrucao_nome(int opcode)
 {
-  for (int i=0; i<N_OPCODE; i++) {
-    if (instrucoes[i].opcode == opcode) {
-      return instrucoes[i].nome;
-    }
-  }
-  return NULL;
+  if (opcode < 0 || opcode >= N_OPCODE) return NULL;
+  return instrucoes[opcode].nome;
 }
 
 int instrucao_num_args(int opcode)
 {
-  for (int i=0; i<N_OPCODE; i++) {
-    if (instrucoes[i].opcode == opcode) {
-      return instrucoes[i].num_args;
-    }
-  }
-  return -1;
+  if (opcode < 0 || opcode >= N_OPCODE) return -1;
+  return instrucoes[opcode].num_args;
 }
 
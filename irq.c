@@ -12,6 +12,7 @@ static char *nomes[N_IRQ] = {
   [IRQ_RELOGIO] = "E/S: relógio",
   [IRQ_TECLADO] = "E/S: teclado",
   [IRQ_TELA]    = "E/S: console",
+  [IRQ_IPI]     = "Outra CPU",
 };
 
 // retorna o nome da interrupção
@@ -19,4 +20,10 @@ char *irq_nome(irq_t irq)
 {
   if (irq < 0 || irq >= N_IRQ) return "DESCONHECIDA";
   return nomes[irq];
+}
+
+int irq_area(int cpu)
+{
+  if (cpu == 0) return 0;
+  return IRQ_END_AREAS + (cpu - 1) * IRQ_TAM_AREA;
 }
\ No newline at end of file
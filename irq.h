@@ -17,14 +17,21 @@ typedef enum {
   // interrupções de E/S ainda não implementadas
   IRQ_TECLADO,       // interrupção causada pelo teclado
   IRQ_TELA,          // interrupção causada pela tela
+  // interrupção pedida por outra CPU (ver D_IPI)
+  IRQ_IPI,
   N_IRQ              // número de interrupções
 } irq_t;
 
 char *irq_nome(irq_t irq);
 
+// número máximo de CPUs numa máquina
+#define MAX_CPUS 8
+
 // endereços na memória onde a CPU salva os valores dos registradores
 //   quando aceita uma interrupção, e de onde recupera esses valores
 //   quando retorna de uma interrupção
+// são relativos ao início da área de salvamento da CPU (ver irq_area); na
+//   CPU 0, a área começa no endereço 0
 #define IRQ_END_PC          0
 #define IRQ_END_A           1
 #define IRQ_END_X           2
@@ -35,4 +42,13 @@ char *irq_nome(irq_t irq);
 // endereço para onde desviar quando aceita uma interrupção
 #define IRQ_END_TRATADOR   10
 
+// as áreas de salvamento das CPUs 1 em diante ficam depois do tratador, a
+//   partir de IRQ_END_AREAS, com IRQ_TAM_AREA posições cada (todas antes do
+//   endereço 100, onde começam os programas)
+#define IRQ_END_AREAS      20
+#define IRQ_TAM_AREA        8
+
+// retorna o endereço da área de salvamento da CPU 'cpu'
+int irq_area(int cpu);
+
 #endif // IRQ_H
\ No newline at end of file
@@ -0,0 +1,578 @@
+// jit.c
+// tradução de blocos de código da CPU para código nativo x86-64
+// simulador de computador
+// so24b
+
+// INCLUDES {{{1
+#include "jit.h"
+#include "instrucao.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <dlfcn.h>
+
+// DECLARAÇÃO {{{1
+
+// número de vezes que um endereço deve ser início de bloco para ser traduzido
+#define JIT_LIMIAR 50
+// número máximo de bytes de código nativo gerado por instrução, contando as
+//   saídas antecipadas que ela pode ter
+#define JIT_MAX_BYTES_INSTR 80
+// tamanho da área de código nativo; quando enche, todos os blocos são
+//   descartados e a tradução recomeça
+#define JIT_TAM_CODIGO (4 * 1024 * 1024)
+// número máximo de bibliotecas com blocos traduzidos antes da execução
+#define JIT_MAX_AOT 16
+
+// situação da tradução de um endereço
+typedef enum {
+  sem_traducao,  // o endereço ainda não foi traduzido
+  traduzido,     // tem um bloco nativo que começa no endereço
+  intraduzivel,  // a instrução no endereço não pode ser traduzida
+} situacao_t;
+
+// o que o JIT sabe sobre cada endereço da memória
+typedef struct {
+  situacao_t situacao;
+  int contador;         // vezes que foi início de bloco sem tradução
+  jit_bloco_t codigo;   // código nativo do bloco (se traduzido)
+  int n_instr;          // número de instruções do bloco
+  int fim;              // endereço seguinte à última palavra do bloco
+} entrada_t;
+
+// saída de um bloco antes do fim, a ser gerada depois do código do bloco
+typedef struct {
+  int pos_desvio;       // posição do deslocamento do desvio que leva à saída
+  int PC;               // PC da instrução que não foi executada
+  int executadas;       // número de instruções executadas antes dela
+} saida_t;
+
+struct jit_t {
+  mem_t *mem;
+  int tam;
+  // uma entrada por endereço da memória
+  entrada_t *entradas;
+  // identificação do JIT como observador de alterações na memória
+  int obs;
+  // área de código nativo
+  uint8_t *codigo;
+  int tam_usado;
+  // saídas do bloco sendo traduzido
+  saida_t saidas[2 * JIT_MAX_INSTR]; // até 2 por instrução (divisão)
+  int n_saidas;
+  // se traduz blocos durante a execução
+  bool traduz;
+  // bibliotecas carregadas com blocos traduzidos antes da execução
+  void *bibliotecas[JIT_MAX_AOT];
+  int n_bibliotecas;
+};
+
+static void invalida(void *arg, int endereco);
+
+// CRIAÇÃO {{{1
+
+jit_t *jit_cria(mem_t *mem)
+{
+#if defined(__x86_64__)
+  void *codigo = mmap(NULL, JIT_TAM_CODIGO, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (codigo == MAP_FAILED) return NULL;
+
+  jit_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  // a memória pode já ter todos os observadores que comporta (uma cache de
+  //   decodificação para cada CPU)
+  self->obs = mem_registra_observador(mem, invalida, self);
+  if (self->obs < 0) {
+    munmap(codigo, JIT_TAM_CODIGO);
+    free(self);
+    return NULL;
+  }
+  self->mem = mem;
+  self->tam = mem_tam(mem);
+  self->entradas = calloc(self->tam, sizeof(*self->entradas));
+  assert(self->entradas != NULL);
+  self->codigo = codigo;
+  self->tam_usado = 0;
+  self->traduz = true;
+  self->n_bibliotecas = 0;
+  return self;
+#else
+  // só sabe gerar código para x86-64
+  return NULL;
+#endif
+}
+
+void jit_destroi(jit_t *self)
+{
+  mem_remove_observador(self->mem, self->obs);
+  munmap(self->codigo, JIT_TAM_CODIGO);
+  for (int i = 0; i < self->n_bibliotecas; i++) {
+    dlclose(self->bibliotecas[i]);
+  }
+  free(self->entradas);
+  free(self);
+}
+
+void jit_define_traducao(jit_t *self, bool traduz)
+{
+  self->traduz = traduz;
+}
+
+// INVALIDAÇÃO {{{1
+
+// chamada pela memória quando um endereço usado por um bloco é alterado
+// invalida todos os blocos (e instruções intraduzíveis) que contêm o endereço;
+//   um bloco tem no máximo 2 * JIT_MAX_INSTR palavras
+static void invalida(void *arg, int endereco)
+{
+  jit_t *self = arg;
+  int primeiro = endereco - 2 * JIT_MAX_INSTR;
+  if (primeiro < 0) primeiro = 0;
+  for (int ini = primeiro; ini <= endereco; ini++) {
+    entrada_t *e = &self->entradas[ini];
+    if (e->situacao != sem_traducao && endereco < e->fim) {
+      e->situacao = sem_traducao;
+      e->contador = 0;
+    }
+  }
+}
+
+// verifica se o código de um bloco está na área de código do JIT (ou se é de
+//   uma biblioteca)
+static bool codigo_do_jit(jit_t *self, jit_bloco_t codigo)
+{
+  uint8_t *p = (uint8_t *)codigo;
+  return p >= self->codigo && p < self->codigo + JIT_TAM_CODIGO;
+}
+
+// descarta todos os blocos gerados pelo JIT, para liberar a área de código
+static void descarta_tudo(jit_t *self)
+{
+  for (int end = 0; end < self->tam; end++) {
+    entrada_t *e = &self->entradas[end];
+    if (e->situacao == traduzido && codigo_do_jit(self, e->codigo)) {
+      e->situacao = sem_traducao;
+      e->contador = 0;
+    }
+  }
+  self->tam_usado = 0;
+}
+
+// GERAÇÃO DE CÓDIGO {{{1
+// O código gerado mantém A em eax e X em esi; rdi aponta para os
+//   registradores (jit_regs_t), r8 para o conteúdo da memória, r9 para as
+//   marcas de observação e r10d tem o tamanho da memória. ecx e edx são
+//   usados como temporários. Todos esses são registradores que uma função
+//   pode alterar sem salvar, na convenção de chamada do System V.
+
+#define DESL_PC         offsetof(jit_regs_t, PC)
+#define DESL_A          offsetof(jit_regs_t, A)
+#define DESL_X          offsetof(jit_regs_t, X)
+#define DESL_EXECUTADAS offsetof(jit_regs_t, executadas)
+#define DESL_MEM        offsetof(jit_regs_t, mem)
+#define DESL_OBSERVADO  offsetof(jit_regs_t, observado)
+#define DESL_TAM        offsetof(jit_regs_t, tam)
+
+static void emite(jit_t *self, int n, const uint8_t bytes[n])
+{
+  for (int i = 0; i < n; i++) {
+    self->codigo[self->tam_usado++] = bytes[i];
+  }
+}
+
+static void emite32(jit_t *self, int32_t valor)
+{
+  uint32_t v = valor;
+  uint8_t bytes[4] = { v, v >> 8, v >> 16, v >> 24 };
+  emite(self, 4, bytes);
+}
+
+// corrige o deslocamento de 32 bits que está em 'pos' para desviar para 'alvo'
+static void corrige_desvio(jit_t *self, int pos, int alvo)
+{
+  int32_t desl = alvo - (pos + 4);
+  uint32_t v = desl;
+  for (int i = 0; i < 4; i++) {
+    self->codigo[pos + i] = v >> (8 * i);
+  }
+}
+
+// mov dword [rdi+desl], valor
+static void emite_poe_reg(jit_t *self, int desl, int valor)
+{
+  emite(self, 3, (uint8_t[]){ 0xC7, 0x47, desl });
+  emite32(self, valor);
+}
+
+// desvio condicional de 32 bits (0F cc) para uma saída do bloco, que
+//   não executa a instrução em PC (já foram executadas 'executadas')
+static void emite_saida(jit_t *self, uint8_t cc, int PC, int executadas)
+{
+  emite(self, 2, (uint8_t[]){ 0x0F, cc });
+  saida_t *s = &self->saidas[self->n_saidas++];
+  s->pos_desvio = self->tam_usado;
+  s->PC = PC;
+  s->executadas = executadas;
+  emite32(self, 0);
+}
+
+#define JE  0x84
+#define JNE 0x85
+#define JAE 0x83
+
+// operação de 32 bits entre eax e mem[endereco] (41 op 80 disp32)
+static void emite_op_mem(jit_t *self, int n, const uint8_t op[n], int endereco)
+{
+  emite(self, 1, (uint8_t[]){ 0x41 });
+  emite(self, n, op);
+  emite(self, 1, (uint8_t[]){ 0x80 });
+  emite32(self, endereco * 4);
+}
+
+// sai do bloco se o endereço constante estiver sendo observado
+static void emite_verifica_observado(jit_t *self, int endereco, int PC, int executadas)
+{
+  // cmp byte [r9+endereco], 0
+  emite(self, 3, (uint8_t[]){ 0x41, 0x80, 0xB9 });
+  emite32(self, endereco);
+  emite(self, 1, (uint8_t[]){ 0x00 });
+  emite_saida(self, JNE, PC, executadas);
+}
+
+// calcula em ecx o endereço A1+X e sai do bloco se for inválido
+static void emite_endereco_indexado(jit_t *self, int A1, int PC, int executadas)
+{
+  // lea ecx, [rsi+A1]
+  emite(self, 2, (uint8_t[]){ 0x8D, 0x8E });
+  emite32(self, A1);
+  // cmp ecx, r10d ; jae saída (sem sinal, pega também os negativos)
+  emite(self, 3, (uint8_t[]){ 0x44, 0x39, 0xD1 });
+  emite_saida(self, JAE, PC, executadas);
+}
+
+// divisão de eax por mem[endereco]; sai do bloco se o resultado não for
+//   definido (divisor 0, ou o menor inteiro dividido por -1), para que o
+//   interpretador faça o que faria
+static void emite_divisao(jit_t *self, int endereco, bool resto, int PC, int executadas)
+{
+  // mov ecx, [r8+endereco*4]
+  emite(self, 3, (uint8_t[]){ 0x41, 0x8B, 0x88 });
+  emite32(self, endereco * 4);
+  // test ecx, ecx ; jz saída
+  emite(self, 2, (uint8_t[]){ 0x85, 0xC9 });
+  emite_saida(self, JE, PC, executadas);
+  // cmp ecx, -1 ; jne +(5+6) ; cmp eax, 0x80000000 ; je saída
+  emite(self, 5, (uint8_t[]){ 0x83, 0xF9, 0xFF, 0x75, 11 });
+  emite(self, 5, (uint8_t[]){ 0x3D, 0x00, 0x00, 0x00, 0x80 });
+  emite_saida(self, JE, PC, executadas);
+  // cdq ; idiv ecx
+  emite(self, 3, (uint8_t[]){ 0x99, 0xF7, 0xF9 });
+  if (resto) {
+    // mov eax, edx
+    emite(self, 2, (uint8_t[]){ 0x89, 0xD0 });
+  }
+}
+
+// gera o código de um desvio condicional no final do bloco: PC vai para A1
+//   se a condição for verdadeira, ou para 'seguinte'
+// 'cc_falso' é o código do desvio curto que pula a troca do PC
+static void emite_desvio_condicional(jit_t *self, uint8_t cc_falso, int A1, int seguinte)
+{
+  emite_poe_reg(self, DESL_PC, seguinte);
+  // test eax, eax ; j(não condição) +7
+  emite(self, 4, (uint8_t[]){ 0x85, 0xC0, cc_falso, 7 });
+  emite_poe_reg(self, DESL_PC, A1);
+}
+
+// TRADUÇÃO {{{1
+
+// lê a instrução em 'end' para tradução, marcando as palavras lidas como
+//   observadas; retorna false se ela não pode ser traduzida (não é uma
+//   instrução sem privilégio, ou o argumento não está na memória)
+static bool le_instrucao(jit_t *self, int end, int *popcode, int *pA1)
+{
+  if (mem_le(self->mem, end, popcode) != ERR_OK) return false;
+  mem_observa(self->mem, self->obs, end);
+  if (*popcode < NOP || *popcode > RET || *popcode == PARA) return false;
+  *pA1 = 0;
+  if (instrucao_num_args(*popcode) > 0) {
+    if (mem_le(self->mem, end + 1, pA1) != ERR_OK) return false;
+    mem_observa(self->mem, self->obs, end + 1);
+  }
+  return true;
+}
+
+// verifica se a instrução acessa um endereço constante inválido (e deve
+//   ficar para o interpretador, para causar o erro)
+static bool endereco_invalido(jit_t *self, int opcode, int A1)
+{
+  switch (opcode) {
+    case CARGM: case ARMM: case SOMA: case SUB: case MULT: case DIV:
+    case RESTO: case CHAMA: case RET:
+      return A1 < 0 || A1 >= self->tam;
+    default:
+      return false;
+  }
+}
+
+// gera o código de uma instrução que não termina o bloco
+static void traduz_instrucao(jit_t *self, int opcode, int A1, int PC, int n)
+{
+  switch (opcode) {
+    case NOP:
+      break;
+    case CARGI: // mov eax, A1
+      emite(self, 1, (uint8_t[]){ 0xB8 });
+      emite32(self, A1);
+      break;
+    case CARGM: // mov eax, [r8+A1*4]
+      emite_op_mem(self, 1, (uint8_t[]){ 0x8B }, A1);
+      break;
+    case CARGX: // mov eax, [r8+rcx*4]
+      emite_endereco_indexado(self, A1, PC, n);
+      emite(self, 4, (uint8_t[]){ 0x41, 0x8B, 0x04, 0x88 });
+      break;
+    case ARMM: // mov [r8+A1*4], eax
+      emite_verifica_observado(self, A1, PC, n);
+      emite_op_mem(self, 1, (uint8_t[]){ 0x89 }, A1);
+      break;
+    case ARMX:
+      emite_endereco_indexado(self, A1, PC, n);
+      // cmp byte [r9+rcx], 0 ; jne saída ; mov [r8+rcx*4], eax
+      emite(self, 5, (uint8_t[]){ 0x41, 0x80, 0x3C, 0x09, 0x00 });
+      emite_saida(self, JNE, PC, n);
+      emite(self, 4, (uint8_t[]){ 0x41, 0x89, 0x04, 0x88 });
+      break;
+    case TRAX: // xchg eax, esi
+      emite(self, 1, (uint8_t[]){ 0x96 });
+      break;
+    case CPXA: // mov eax, esi
+      emite(self, 2, (uint8_t[]){ 0x89, 0xF0 });
+      break;
+    case INCX: // add esi, 1
+      emite(self, 3, (uint8_t[]){ 0x83, 0xC6, 0x01 });
+      break;
+    case SOMA: // add eax, [r8+A1*4]
+      emite_op_mem(self, 1, (uint8_t[]){ 0x03 }, A1);
+      break;
+    case SUB: // sub eax, [r8+A1*4]
+      emite_op_mem(self, 1, (uint8_t[]){ 0x2B }, A1);
+      break;
+    case MULT: // imul eax, [r8+A1*4]
+      emite_op_mem(self, 2, (uint8_t[]){ 0x0F, 0xAF }, A1);
+      break;
+    case DIV:
+      emite_divisao(self, A1, false, PC, n);
+      break;
+    case RESTO:
+      emite_divisao(self, A1, true, PC, n);
+      break;
+    case NEG: // neg eax
+      emite(self, 2, (uint8_t[]){ 0xF7, 0xD8 });
+      break;
+  }
+}
+
+// gera o código da instrução que termina o bloco (um desvio), que deixa o
+//   novo PC nos registradores
+static void traduz_desvio(jit_t *self, int opcode, int A1, int PC, int n)
+{
+  switch (opcode) {
+    case DESV:
+      emite_poe_reg(self, DESL_PC, A1);
+      break;
+    // os desvios curtos são para a condição contrária
+    case DESVZ:  emite_desvio_condicional(self, 0x75, A1, PC + 2); break;
+    case DESVNZ: emite_desvio_condicional(self, 0x74, A1, PC + 2); break;
+    case DESVN:  emite_desvio_condicional(self, 0x7D, A1, PC + 2); break;
+    case DESVP:  emite_desvio_condicional(self, 0x7E, A1, PC + 2); break;
+    case CHAMA:
+      emite_verifica_observado(self, A1, PC, n);
+      // mov dword [r8+A1*4], PC+2
+      emite(self, 3, (uint8_t[]){ 0x41, 0xC7, 0x80 });
+      emite32(self, A1 * 4);
+      emite32(self, PC + 2);
+      emite_poe_reg(self, DESL_PC, A1 + 1);
+      break;
+    case RET:
+      // mov ecx, [r8+A1*4] ; mov [rdi+PC], ecx
+      emite(self, 3, (uint8_t[]){ 0x41, 0x8B, 0x88 });
+      emite32(self, A1 * 4);
+      emite(self, 3, (uint8_t[]){ 0x89, 0x4F, DESL_PC });
+      break;
+  }
+}
+
+// traduz o bloco que começa em 'inicio'
+static void traduz(jit_t *self, int inicio)
+{
+  entrada_t *e = &self->entradas[inicio];
+
+  // garante espaço para o maior bloco possível
+  if (self->tam_usado + (JIT_MAX_INSTR + 2) * JIT_MAX_BYTES_INSTR > JIT_TAM_CODIGO) {
+    descarta_tudo(self);
+  }
+  int pos_inicio = self->tam_usado;
+  self->n_saidas = 0;
+
+  // prólogo: carrega os registradores
+  // mov eax, [rdi+A] ; mov esi, [rdi+X]
+  emite(self, 3, (uint8_t[]){ 0x8B, 0x47, DESL_A });
+  emite(self, 3, (uint8_t[]){ 0x8B, 0x77, DESL_X });
+  // mov r8, [rdi+mem] ; mov r9, [rdi+observado] ; mov r10d, [rdi+tam]
+  emite(self, 4, (uint8_t[]){ 0x4C, 0x8B, 0x47, DESL_MEM });
+  emite(self, 4, (uint8_t[]){ 0x4C, 0x8B, 0x4F, DESL_OBSERVADO });
+  emite(self, 4, (uint8_t[]){ 0x44, 0x8B, 0x57, DESL_TAM });
+
+  int PC = inicio;
+  int n = 0;
+  bool desviou = false;
+  while (n < JIT_MAX_INSTR) {
+    int opcode, A1;
+    if (!le_instrucao(self, PC, &opcode, &A1)) break;
+    if (endereco_invalido(self, opcode, A1)) break;
+    if (opcode >= DESV) {
+      // desvio, chamada ou retorno: última instrução do bloco
+      traduz_desvio(self, opcode, A1, PC, n);
+      PC += 1 + instrucao_num_args(opcode);
+      n++;
+      desviou = true;
+      break;
+    }
+    traduz_instrucao(self, opcode, A1, PC, n);
+    PC += 1 + instrucao_num_args(opcode);
+    n++;
+  }
+
+  // se não terminou com desvio, a instrução em PC (até 2 palavras) também foi
+  //   lida e é observada
+  e->fim = PC + (desviou ? 0 : 2);
+  if (n == 0) {
+    // a primeira instrução não é traduzível -- não adianta tentar de novo
+    //   enquanto ela não mudar
+    self->tam_usado = pos_inicio;
+    e->situacao = intraduzivel;
+    return;
+  }
+
+  // o bloco terminou sem desvio: continua na instrução seguinte
+  if (!desviou) {
+    emite_poe_reg(self, DESL_PC, PC);
+  }
+  emite_poe_reg(self, DESL_EXECUTADAS, n);
+  // epílogo: salva os registradores
+  // mov [rdi+A], eax ; mov [rdi+X], esi ; ret
+  int pos_epilogo = self->tam_usado;
+  emite(self, 3, (uint8_t[]){ 0x89, 0x47, DESL_A });
+  emite(self, 3, (uint8_t[]){ 0x89, 0x77, DESL_X });
+  emite(self, 1, (uint8_t[]){ 0xC3 });
+
+  // saídas antecipadas: informam onde pararam e vão para o epílogo
+  for (int i = 0; i < self->n_saidas; i++) {
+    saida_t *s = &self->saidas[i];
+    corrige_desvio(self, s->pos_desvio, self->tam_usado);
+    emite_poe_reg(self, DESL_PC, s->PC);
+    emite_poe_reg(self, DESL_EXECUTADAS, s->executadas);
+    emite(self, 1, (uint8_t[]){ 0xE9 });
+    emite32(self, 0);
+    corrige_desvio(self, self->tam_usado - 4, pos_epilogo);
+  }
+
+  e->situacao = traduzido;
+  e->codigo = (jit_bloco_t)(self->codigo + pos_inicio);
+  e->n_instr = n;
+}
+
+// TRADUÇÃO ANTES DA EXECUÇÃO {{{1
+
+// verifica se a imagem traduzida é compatível e corresponde ao que está na
+//   memória
+static bool aot_valido(jit_t *self, const jit_aot_t *aot)
+{
+  if (aot->versao != JIT_AOT_VERSAO) return false;
+  if (aot->carga < 0 || aot->tam < 0 || aot->carga + aot->tam > self->tam) {
+    return false;
+  }
+  int *conteudo = mem_conteudo(self->mem);
+  if (memcmp(&conteudo[aot->carga], aot->imagem, aot->tam * sizeof(int)) != 0) {
+    return false;
+  }
+  // os blocos devem estar dentro da imagem, e ter o tamanho que a
+  //   invalidação considera
+  for (int i = 0; i < aot->n_blocos; i++) {
+    const jit_bloco_aot_t *b = &aot->blocos[i];
+    if (b->inicio < aot->carga || b->fim > aot->carga + aot->tam
+        || b->fim <= b->inicio || b->fim - b->inicio > 2 * JIT_MAX_INSTR
+        || b->n_instr < 1 || b->n_instr > JIT_MAX_INSTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// guarda a biblioteca, para ser fechada na destruição do JIT
+// retorna false se não tem mais espaço
+static bool guarda_biblioteca(jit_t *self, void *biblioteca)
+{
+  for (int i = 0; i < self->n_bibliotecas; i++) {
+    if (self->bibliotecas[i] == biblioteca) {
+      // já estava aberta; dlopen conta as aberturas
+      dlclose(biblioteca);
+      return true;
+    }
+  }
+  if (self->n_bibliotecas >= JIT_MAX_AOT) return false;
+  self->bibliotecas[self->n_bibliotecas++] = biblioteca;
+  return true;
+}
+
+bool jit_carrega_aot(jit_t *self, char *nome)
+{
+  void *biblioteca = dlopen(nome, RTLD_NOW | RTLD_LOCAL);
+  if (biblioteca == NULL) return false;
+  const jit_aot_t *aot = dlsym(biblioteca, "jit_aot");
+  if (aot == NULL || !aot_valido(self, aot) || !guarda_biblioteca(self, biblioteca)) {
+    dlclose(biblioteca);
+    return false;
+  }
+
+  for (int i = 0; i < aot->n_blocos; i++) {
+    const jit_bloco_aot_t *b = &aot->blocos[i];
+    entrada_t *e = &self->entradas[b->inicio];
+    e->situacao = traduzido;
+    e->codigo = b->codigo;
+    e->n_instr = b->n_instr;
+    e->fim = b->fim;
+    for (int end = b->inicio; end < b->fim; end++) {
+      mem_observa(self->mem, self->obs, end);
+    }
+  }
+  return true;
+}
+
+// EXECUÇÃO {{{1
+
+int jit_executa(jit_t *self, jit_regs_t *regs, int max)
+{
+  if (regs->PC < 0 || regs->PC >= self->tam) return 0;
+  entrada_t *e = &self->entradas[regs->PC];
+  if (e->situacao == sem_traducao && self->traduz) {
+    e->contador++;
+    if (e->contador < JIT_LIMIAR) return 0;
+    traduz(self, regs->PC);
+  }
+  if (e->situacao != traduzido || e->n_instr > max) return 0;
+
+  regs->mem = mem_conteudo(self->mem);
+  regs->observado = mem_marcas(self->mem);
+  regs->tam = self->tam;
+  e->codigo(regs);
+  return regs->executadas;
+}
+
+// vim: foldmethod=marker
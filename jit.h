@@ -0,0 +1,104 @@
+// jit.h
+// tradução de blocos de código da CPU para código nativo x86-64
+// simulador de computador
+// so24b
+
+#ifndef JIT_H
+#define JIT_H
+
+// O JIT traduz blocos básicos muito executados (sequências de instruções
+//   terminadas por um desvio, CHAMA ou RET) para código nativo, que é
+//   executado diretamente pelo processador hospedeiro.
+// Só são traduzidas instruções sem privilégio e que não causam interrupção
+//   (CARGI...DESVP, CHAMA, RET); um bloco termina antes de qualquer outra
+//   (PARA, LE, ESCR, RETI, CHAMAC, CHAMAS, instrução inválida), que fica para
+//   o interpretador.
+// Se durante a execução de um bloco uma instrução for causar erro (endereço
+//   inválido, divisão por zero) ou for escrever em memória observada (que
+//   pode conter código decodificado ou traduzido), o bloco termina antes
+//   dela, e o interpretador continua a partir daí.
+// Os blocos traduzidos ficam numa cache, e são invalidados quando a memória
+//   que ocupam é alterada.
+// A cache também pode receber blocos traduzidos antes da execução, pelo
+//   tradutor (que gera uma biblioteca dinâmica a partir de um .maq); esses
+//   blocos seguem as mesmas regras dos gerados pelo JIT.
+// O JIT só deve ser usado para código executado em modo usuário.
+
+#include "memoria.h"
+
+#include <stdbool.h>
+
+typedef struct jit_t jit_t;
+
+// número máximo de instruções em um bloco
+#define JIT_MAX_INSTR 64
+
+// estado da CPU visto por um bloco nativo
+// os 3 últimos campos são preenchidos pelo JIT
+typedef struct {
+  int PC;
+  int A;
+  int X;
+  int executadas;           // número de instruções executadas pelo bloco
+  int *mem;                 // conteúdo da memória
+  unsigned char *observado; // marcas de observação da memória
+  int tam;                  // tamanho da memória
+} jit_regs_t;
+
+// código nativo de um bloco
+typedef void (*jit_bloco_t)(jit_regs_t *regs);
+
+// TRADUÇÃO ANTES DA EXECUÇÃO
+// A biblioteca gerada pelo tradutor exporta uma variável 'jit_aot', do tipo
+//   jit_aot_t, que descreve a imagem traduzida e os blocos
+
+// versão da interface entre os blocos e o simulador; muda quando jit_regs_t
+//   ou as estruturas abaixo mudam
+#define JIT_AOT_VERSAO 1
+
+// um bloco traduzido antes da execução
+typedef struct {
+  int inicio;           // endereço da primeira instrução
+  int fim;              // endereço seguinte à última palavra do bloco
+  int n_instr;          // número de instruções do bloco
+  jit_bloco_t codigo;
+} jit_bloco_aot_t;
+
+// uma imagem traduzida antes da execução
+typedef struct {
+  int versao;           // JIT_AOT_VERSAO
+  int carga;            // endereço de carga da imagem
+  int tam;              // número de palavras da imagem
+  const int *imagem;    // conteúdo da imagem que foi traduzida
+  int n_blocos;
+  const jit_bloco_aot_t *blocos;
+} jit_aot_t;
+
+// cria um JIT para traduzir código que está na memória 'mem'
+// retorna NULL se não for possível gerar código nativo neste computador, ou
+//   se a memória não aceitar mais observadores (ver mem_registra_observador)
+jit_t *jit_cria(mem_t *mem);
+
+// liga ou desliga a tradução de blocos durante a execução (o padrão é ligada)
+// com a tradução desligada, só são executados os blocos traduzidos antes
+void jit_define_traducao(jit_t *self, bool traduz);
+
+// carrega a biblioteca 'nome', gerada pelo tradutor, e coloca seus blocos na
+//   cache, se a imagem traduzida for igual ao conteúdo atual da memória
+// retorna false se não foi possível (a biblioteca não existe, não é
+//   compatível ou a imagem não corresponde ao que está na memória)
+bool jit_carrega_aot(jit_t *self, char *nome);
+
+// destrói o JIT e o código gerado por ele
+void jit_destroi(jit_t *self);
+
+// executa o bloco nativo que começa em regs->PC, se existir e tiver no
+//   máximo 'max' instruções; se ainda não existir, traduz o bloco se o
+//   endereço já tiver sido pedido vezes suficientes
+// atualiza PC, A e X em regs, e retorna o número de instruções executadas,
+//   que pode ser 0 (não tem bloco, ou a primeira instrução precisa do
+//   interpretador), ou menos que o bloco (uma instrução precisa do
+//   interpretador, que deve continuar a partir de regs->PC)
+int jit_executa(jit_t *self, jit_regs_t *regs, int max);
+
+#endif // JIT_H
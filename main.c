@@ -3,109 +3,165 @@
 // simulador de computador
 // so24b
 
-#include "controle.h"
-#include "memoria.h"
-#include "cpu.h"
-#include "relogio.h"
-#include "console.h"
-#include "terminal.h"
-#include "es.h"
-#include "dispositivos.h"
-#include "so.h"
+#include "maquina.h"
 
 #include <stdio.h>
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 
-// constantes
-#define MEM_TAM 10000        // tamanho da memória principal
-
-// estrutura com os componentes do computador simulado
+// opções da simulação, escolhidas na linha de comando
 typedef struct {
-  mem_t *mem;
-  cpu_t *cpu;
-  relogio_t *relogio;
-  console_t *console;
-  es_t *es;
-  controle_t *controle;
-} hardware_t;
+  maquina_config_t maq;
+  char *estatisticas;
+} opcoes_t;
 
-static void cria_hardware(hardware_t *hw)
+static void uso(char *nome)
 {
-  // cria a memória
-  hw->mem = mem_cria(MEM_TAM);
-
-  // cria dispositivos de E/S
-  hw->console = console_cria();
-  hw->relogio = relogio_cria();
-
-  // cria o controlador de E/S e registra os dispositivos
-  //   por exemplo, o dispositivo 8 do controlador de E/S (e da CPU) será o
-  //   dispositivo 0 do relógio (que é o contador de instruções)
-  hw->es = es_cria();
-  // lê teclado, testa teclado, escreve tela, testa tela do terminal A
-  terminal_t *terminal;
-  terminal = console_terminal(hw->console, 'A');
-  es_registra_dispositivo(hw->es, D_TERM_A_TECLADO    , terminal, 0, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_A_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_A_TELA       , terminal, 2, NULL, terminal_escrita);
-  es_registra_dispositivo(hw->es, D_TERM_A_TELA_OK    , terminal, 3, terminal_leitura, NULL);
-  // lê teclado, testa teclado, escreve tela, testa tela do terminal B
-  terminal = console_terminal(hw->console, 'B');
-  es_registra_dispositivo(hw->es, D_TERM_B_TECLADO    , terminal, 0, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_B_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_B_TELA       , terminal, 2, NULL, terminal_escrita);
-  es_registra_dispositivo(hw->es, D_TERM_B_TELA_OK    , terminal, 3, terminal_leitura, NULL);
-  // lê teclado, testa teclado, escreve tela, testa tela do terminal C
-  terminal = console_terminal(hw->console, 'C');
-  es_registra_dispositivo(hw->es, D_TERM_C_TECLADO    , terminal, 0, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_C_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_C_TELA       , terminal, 2, NULL, terminal_escrita);
-  es_registra_dispositivo(hw->es, D_TERM_C_TELA_OK    , terminal, 3, terminal_leitura, NULL);
-  // lê teclado, testa teclado, escreve tela, testa tela do terminal D
-  terminal = console_terminal(hw->console, 'D');
-  es_registra_dispositivo(hw->es, D_TERM_D_TECLADO    , terminal, 0, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_D_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_TERM_D_TELA       , terminal, 2, NULL, terminal_escrita);
-  es_registra_dispositivo(hw->es, D_TERM_D_TELA_OK    , terminal, 3, terminal_leitura, NULL);
-  // lê relógio virtual, relógio real
-  es_registra_dispositivo(hw->es, D_RELOGIO_INSTRUCOES, hw->relogio, 0, relogio_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_RELOGIO_REAL      , hw->relogio, 1, relogio_leitura, NULL);
-  es_registra_dispositivo(hw->es, D_RELOGIO_TIMER     , hw->relogio, 2, relogio_leitura, relogio_escrita);
-  es_registra_dispositivo(hw->es, D_RELOGIO_INTERRUPCAO,hw->relogio, 3, relogio_leitura, relogio_escrita);
-
-  // cria a unidade de execução e inicializa com a memória e o controlador de E/S
-  hw->cpu = cpu_cria(hw->mem, hw->es);
+  fprintf(stderr, "uso: %s [-m switch|encadeado] [-j] [-J] [-a] [-p] [-n comandos]"
+                  " [-l kbytes] [-i programa] [-e arquivo] [-r roteiro]"
+                  " [-c cpus] [-C cpus] [-d] [-s rr|mlfq|cfs]\n", nome);
+  fprintf(stderr, "  -m  motor de execução de instruções da CPU (padrão: switch)\n");
+  fprintf(stderr, "  -j  traduz código de usuário muito executado para código nativo\n");
+  fprintf(stderr, "  -J  como -j, mas compara cada bloco nativo com o interpretador\n");
+  fprintf(stderr, "  -a  usa o código nativo gerado antes pelo tradutor para cada\n"
+                  "      programa carregado (x.so para x.maq), se existir; só deve\n"
+                  "      ser usado com programas confiáveis\n");
+  fprintf(stderr, "  -p  conta as sequências de instruções executadas, e informa as\n"
+                  "      mais frequentes no final\n");
+  fprintf(stderr, "  -n  executa sem tela, com os comandos do operador lidos do arquivo\n"
+                  "      'comandos'; a console vai para a saída padrão e a saída de\n"
+                  "      cada terminal para o arquivo saida_do_terminal_X\n");
+  fprintf(stderr, "  -l  começa um novo log_da_console a cada 'kbytes' kB (o anterior\n"
+                  "      vira log_da_console.1, e assim por diante)\n");
+  fprintf(stderr, "  -i  programa executado pelo primeiro processo (padrão: init.maq)\n");
+  fprintf(stderr, "  -e  no final, escreve no arquivo estatísticas da execução (em JSON)\n");
+  fprintf(stderr, "  -r  coloca nos terminais a entrada descrita no arquivo 'roteiro', na\n"
+                  "      hora do relógio simulado (ver console.h)\n");
+  fprintf(stderr, "  -c  simula 'cpus' CPUs compartilhando a memória, cada uma\n"
+                  "      executando na sua thread (ver controle.h)\n");
+  fprintf(stderr, "  -C  como -c, mas com as CPUs executando uma depois da outra na\n"
+                  "      mesma thread (resultado reprodutível)\n");
+  fprintf(stderr, "  -d  tratamento direto das interrupções: a CPU chama o SO sem\n"
+                  "      executar o tratador em assembly (mesmo resultado)\n");
+  fprintf(stderr, "  -s  escalonador de processos do SO (padrão: rr)\n"
+                  "      rr (round-robin), mlfq (filas multinível) ou cfs (justo)\n");
+  exit(1);
+}
 
-  // cria o controlador da CPU e inicializa com a unidade de execução, a console e
-  //   o relógio
-  hw->controle = controle_cria(hw->cpu, hw->console, hw->relogio);
+static void pega_opcoes(int argc, char *argv[argc], opcoes_t *opcoes)
+{
+  maquina_config_padrao(&opcoes->maq);
+  opcoes->estatisticas = NULL;
+  for (int argi = 1; argi < argc; argi++) {
+    if (strcmp(argv[argi], "-m") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      if (strcmp(argv[argi], "switch") == 0) {
+        opcoes->maq.motor = CPU_MOTOR_SWITCH;
+      } else if (strcmp(argv[argi], "encadeado") == 0) {
+        opcoes->maq.motor = CPU_MOTOR_ENCADEADO;
+      } else {
+        fprintf(stderr, "ERRO: motor desconhecido: '%s'\n", argv[argi]);
+        uso(argv[0]);
+      }
+    } else if (strcmp(argv[argi], "-j") == 0) {
+      opcoes->maq.jit = true;
+    } else if (strcmp(argv[argi], "-J") == 0) {
+      opcoes->maq.jit = true;
+      opcoes->maq.jit_compara = true;
+    } else if (strcmp(argv[argi], "-a") == 0) {
+      opcoes->maq.aot = true;
+    } else if (strcmp(argv[argi], "-p") == 0) {
+      opcoes->maq.perfil = true;
+    } else if (strcmp(argv[argi], "-n") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->maq.comandos = argv[argi];
+    } else if (strcmp(argv[argi], "-l") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->maq.tam_log = atol(argv[argi]) * 1024;
+    } else if (strcmp(argv[argi], "-i") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->maq.programa_inicial = argv[argi];
+    } else if (strcmp(argv[argi], "-e") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->estatisticas = argv[argi];
+    } else if (strcmp(argv[argi], "-r") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->maq.roteiro = argv[argi];
+    } else if (strcmp(argv[argi], "-c") == 0 || strcmp(argv[argi], "-C") == 0) {
+      opcoes->maq.paralelo = (argv[argi][1] == 'c');
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      opcoes->maq.n_cpus = atoi(argv[argi]);
+      if (opcoes->maq.n_cpus < 1 || opcoes->maq.n_cpus > MAX_CPUS) {
+        fprintf(stderr, "ERRO: número de CPUs deve ser de 1 a %d\n", MAX_CPUS);
+        uso(argv[0]);
+      }
+    } else if (strcmp(argv[argi], "-d") == 0) {
+      opcoes->maq.tratamento_direto = true;
+    } else if (strcmp(argv[argi], "-s") == 0) {
+      argi++;
+      if (argi >= argc) uso(argv[0]);
+      if (strcmp(argv[argi], "rr") == 0) {
+        opcoes->maq.escalonador = SO_ESCALONADOR_RR;
+      } else if (strcmp(argv[argi], "mlfq") == 0) {
+        opcoes->maq.escalonador = SO_ESCALONADOR_MLFQ;
+      } else if (strcmp(argv[argi], "cfs") == 0) {
+        opcoes->maq.escalonador = SO_ESCALONADOR_CFS;
+      } else {
+        fprintf(stderr, "ERRO: escalonador desconhecido: '%s'\n", argv[argi]);
+        uso(argv[0]);
+      }
+    } else {
+      uso(argv[0]);
+    }
+  }
 }
 
-static void destroi_hardware(hardware_t *hw)
+// escreve as estatísticas da execução no arquivo 'nome', em JSON, para
+//   serem lidas por programas (como o bench/roda)
+static void escreve_estatisticas(char *nome, maquina_t *maq)
 {
-  controle_destroi(hw->controle);
-  cpu_destroi(hw->cpu);
-  es_destroi(hw->es);
-  relogio_destroi(hw->relogio);
-  console_destroi(hw->console);
-  mem_destroi(hw->mem);
+  FILE *arq = fopen(nome, "w");
+  if (arq == NULL) {
+    fprintf(stderr, "ERRO: não consegui criar '%s'\n", nome);
+    return;
+  }
+  struct rusage uso;
+  getrusage(RUSAGE_SELF, &uso);
+  maquina_estatisticas_t est;
+  maquina_estatisticas(maq, &est);
+  fprintf(arq, "{\n");
+  maquina_escreve_estatisticas(arq, &est, "  ");
+  fprintf(arq, ",\n");
+  fprintf(arq, "  \"rss_max_kb\": %ld\n", uso.ru_maxrss);
+  fprintf(arq, "}\n");
+  fclose(arq);
 }
 
-int main()
+int main(int argc, char *argv[argc])
 {
-  hardware_t hw;
-  so_t *so;
+  opcoes_t opcoes;
+
+  pega_opcoes(argc, argv, &opcoes);
+  opcoes.maq.mede_tempo = (opcoes.estatisticas != NULL);
 
-  // cria o hardware
-  cria_hardware(&hw);
-  // cria o sistema operacional
-  so = so_cria(hw.cpu, hw.mem, hw.es, hw.console);
-  
-  // executa o laço principal do controlador
-  controle_laco(hw.controle);
+  // cria o hardware e o sistema operacional
+  maquina_t *maq = maquina_cria(&opcoes.maq);
+
+  // executa até o operador mandar terminar
+  maquina_executa(maq);
+  if (opcoes.estatisticas != NULL) {
+    escreve_estatisticas(opcoes.estatisticas, maq);
+  }
 
   // destroi tudo
-  so_destroi(so);
-  destroi_hardware(&hw);
+  maquina_destroi(maq);
 }
-
@@ -0,0 +1,244 @@
+// maquina.c
+// um computador simulado completo, com o seu sistema operacional
+// simulador de computador
+// so24b
+
+#include "maquina.h"
+#include "controle.h"
+#include "memoria.h"
+#include "cpu.h"
+#include "relogio.h"
+#include "eventos.h"
+#include "console.h"
+#include "terminal.h"
+#include "es.h"
+#include "dispositivos.h"
+#include "so.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+// constantes
+#define MEM_TAM 10000        // tamanho padrão da memória principal
+#define INTERVALO_INTERRUPCAO 50  // intervalo padrão entre interrupções
+#define QUANTUM 10                // quantum padrão do escalonador
+
+// estrutura com os componentes do computador simulado
+typedef struct {
+  eventos_t *eventos;
+  mem_t *mem;
+  cpu_t *cpus[MAX_CPUS];
+  int n_cpus;
+  relogio_t *relogio;
+  console_t *console;
+  es_t *es;
+  controle_t *controle;
+} hardware_t;
+
+struct maquina_t {
+  hardware_t hw;
+  so_t *so;
+  double segundos;
+};
+
+void maquina_config_padrao(maquina_config_t *cfg)
+{
+  cfg->motor = CPU_MOTOR_SWITCH;
+  cfg->jit = false;
+  cfg->jit_compara = false;
+  cfg->aot = false;
+  cfg->perfil = false;
+  cfg->comandos = NULL;
+  cfg->tam_log = 0;
+  cfg->dir = NULL;
+  cfg->roteiro = NULL;
+  cfg->programa_inicial = "init.maq";
+  cfg->tam_memoria = MEM_TAM;
+  cfg->intervalo_interrupcao = INTERVALO_INTERRUPCAO;
+  cfg->quantum = QUANTUM;
+  cfg->escalonador = SO_ESCALONADOR_RR;
+  cfg->mede_tempo = false;
+  cfg->n_cpus = 1;
+  cfg->paralelo = false;
+  cfg->tratamento_direto = false;
+}
+
+// CRIAÇÃO {{{1
+
+static void cria_hardware(hardware_t *hw, maquina_config_t *cfg)
+{
+  // cria a fila de eventos, que mantém o tempo simulado para os dispositivos
+  hw->eventos = eventos_cria();
+
+  // cria a memória
+  hw->mem = mem_cria(cfg->tam_memoria);
+
+  // cria dispositivos de E/S
+  hw->console = console_cria(hw->eventos, cfg->comandos, cfg->tam_log, cfg->dir);
+  hw->relogio = relogio_cria(hw->eventos);
+  if (cfg->roteiro != NULL && !console_define_roteiro(hw->console, cfg->roteiro)) {
+    console_printf("ERRO: não consegui abrir o roteiro '%s'", cfg->roteiro);
+  }
+
+  // cria o controlador de E/S e registra os dispositivos
+  //   por exemplo, o dispositivo 8 do controlador de E/S (e da CPU) será o
+  //   dispositivo 0 do relógio (que é o contador de instruções)
+  hw->es = es_cria();
+  // lê teclado, testa teclado, escreve tela, testa tela do terminal A
+  terminal_t *terminal;
+  terminal = console_terminal(hw->console, 'A');
+  es_registra_dispositivo(hw->es, D_TERM_A_TECLADO    , terminal, 0, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_A_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_A_TELA       , terminal, 2, NULL, terminal_escrita);
+  es_registra_dispositivo(hw->es, D_TERM_A_TELA_OK    , terminal, 3, terminal_leitura, NULL);
+  // lê teclado, testa teclado, escreve tela, testa tela do terminal B
+  terminal = console_terminal(hw->console, 'B');
+  es_registra_dispositivo(hw->es, D_TERM_B_TECLADO    , terminal, 0, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_B_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_B_TELA       , terminal, 2, NULL, terminal_escrita);
+  es_registra_dispositivo(hw->es, D_TERM_B_TELA_OK    , terminal, 3, terminal_leitura, NULL);
+  // lê teclado, testa teclado, escreve tela, testa tela do terminal C
+  terminal = console_terminal(hw->console, 'C');
+  es_registra_dispositivo(hw->es, D_TERM_C_TECLADO    , terminal, 0, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_C_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_C_TELA       , terminal, 2, NULL, terminal_escrita);
+  es_registra_dispositivo(hw->es, D_TERM_C_TELA_OK    , terminal, 3, terminal_leitura, NULL);
+  // lê teclado, testa teclado, escreve tela, testa tela do terminal D
+  terminal = console_terminal(hw->console, 'D');
+  es_registra_dispositivo(hw->es, D_TERM_D_TECLADO    , terminal, 0, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_D_TECLADO_OK , terminal, 1, terminal_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_TERM_D_TELA       , terminal, 2, NULL, terminal_escrita);
+  es_registra_dispositivo(hw->es, D_TERM_D_TELA_OK    , terminal, 3, terminal_leitura, NULL);
+  // lê relógio virtual, relógio real
+  es_registra_dispositivo(hw->es, D_RELOGIO_INSTRUCOES, hw->relogio, 0, relogio_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_RELOGIO_REAL      , hw->relogio, 1, relogio_leitura, NULL);
+  es_registra_dispositivo(hw->es, D_RELOGIO_TIMER     , hw->relogio, 2, relogio_leitura, relogio_escrita);
+  es_registra_dispositivo(hw->es, D_RELOGIO_INTERRUPCAO,hw->relogio, 3, relogio_leitura, relogio_escrita);
+  // timer e pedido de interrupção das outras CPUs
+  for (int k = 1; k < MAX_CPUS; k++) {
+    es_registra_dispositivo(hw->es, D_TIMER(k), hw->relogio, 2 + 2 * k, relogio_leitura, relogio_escrita);
+    es_registra_dispositivo(hw->es, D_TIMER_INTERRUPCAO(k), hw->relogio, 3 + 2 * k, relogio_leitura, relogio_escrita);
+  }
+
+  // cria as unidades de execução e inicializa com a memória e o controlador de E/S
+  hw->n_cpus = cfg->n_cpus;
+  if (hw->n_cpus < 1) hw->n_cpus = 1;
+  if (hw->n_cpus > MAX_CPUS) hw->n_cpus = MAX_CPUS;
+  for (int k = 0; k < hw->n_cpus; k++) {
+    hw->cpus[k] = cpu_cria(hw->mem, hw->es, k);
+  }
+
+  // cria o controlador da CPU e inicializa com a unidade de execução, a console,
+  //   o relógio e a fila de eventos
+  hw->controle = controle_cria(hw->cpus[0], hw->console, hw->relogio, hw->eventos);
+  for (int k = 1; k < hw->n_cpus; k++) {
+    controle_adiciona_cpu(hw->controle, hw->cpus[k]);
+  }
+  controle_define_paralelo(hw->controle, cfg->paralelo);
+  // pedido de interrupção entre CPUs
+  es_registra_dispositivo(hw->es, D_IPI, hw->controle, 0, NULL, controle_escrita_ipi);
+}
+
+static void destroi_hardware(hardware_t *hw)
+{
+  controle_destroi(hw->controle);
+  for (int k = 0; k < hw->n_cpus; k++) {
+    cpu_destroi(hw->cpus[k]);
+  }
+  es_destroi(hw->es);
+  relogio_destroi(hw->relogio);
+  console_destroi(hw->console);
+  mem_destroi(hw->mem);
+  eventos_destroi(hw->eventos);
+}
+
+// cria o hardware com a configuração, e o SO
+maquina_t *maquina_cria(maquina_config_t *cfg)
+{
+  maquina_t *self = malloc(sizeof(*self));
+  assert(self != NULL);
+  hardware_t *hw = &self->hw;
+
+  // cria o hardware
+  cria_hardware(hw, cfg);
+  for (int k = 0; k < hw->n_cpus; k++) {
+    cpu_define_motor(hw->cpus[k], cfg->motor);
+    cpu_define_perfil(hw->cpus[k], cfg->perfil);
+  }
+  if (cfg->jit && hw->n_cpus > 1) {
+    log_aviso(LOG_CPU, "JIT não disponível com mais de uma CPU, usando só o interpretador");
+  } else if (cfg->jit && !cpu_define_jit(hw->cpus[0], true, cfg->jit_compara)) {
+    log_aviso(LOG_CPU, "JIT não disponível neste computador, usando só o interpretador");
+  }
+  // cria o sistema operacional
+  self->so = so_cria(hw->cpus[0], hw->mem, hw->es, hw->console, cfg->programa_inicial);
+  for (int k = 1; k < hw->n_cpus; k++) {
+    so_adiciona_cpu(self->so, hw->cpus[k]);
+  }
+  if (cfg->intervalo_interrupcao != INTERVALO_INTERRUPCAO) {
+    so_define_intervalo_interrupcao(self->so, cfg->intervalo_interrupcao);
+  }
+  so_define_quantum(self->so, cfg->quantum);
+  so_define_escalonador(self->so, cfg->escalonador);
+  so_define_tratamento_direto(self->so, cfg->tratamento_direto);
+  so_define_codigo_nativo(self->so, cfg->aot);
+  so_mede_tempo(self->so, cfg->mede_tempo);
+  self->segundos = 0;
+  return self;
+}
+
+void maquina_destroi(maquina_t *self)
+{
+  so_destroi(self->so);
+  destroi_hardware(&self->hw);
+  free(self);
+}
+
+// EXECUÇÃO {{{1
+
+static double agora_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void maquina_executa(maquina_t *self)
+{
+  // executa o laço principal do controlador
+  double inicio = agora_s();
+  controle_laco(self->hw.controle);
+  self->segundos += agora_s() - inicio;
+  for (int k = 0; k < self->hw.n_cpus; k++) {
+    cpu_relata_perfil(self->hw.cpus[k]);
+  }
+}
+
+// ESTATÍSTICAS {{{1
+
+void maquina_estatisticas(maquina_t *self, maquina_estatisticas_t *est)
+{
+  est->segundos = self->segundos;
+  est->tempo_simulado = relogio_agora(self->hw.relogio);
+  est->instrucoes = controle_instrucoes(self->hw.controle);
+  est->interrupcoes = so_interrupcoes(self->so);
+  est->segundos_no_so = so_tempo_tratando(self->so);
+}
+
+void maquina_escreve_estatisticas(FILE *arq, maquina_estatisticas_t *est,
+                                  char *recuo)
+{
+  double s = est->segundos;
+  fprintf(arq, "%s\"segundos\": %.6f,\n", recuo, s);
+  fprintf(arq, "%s\"tempo_simulado\": %d,\n", recuo, est->tempo_simulado);
+  fprintf(arq, "%s\"instrucoes\": %lld,\n", recuo, est->instrucoes);
+  fprintf(arq, "%s\"mips\": %.3f,\n", recuo, est->instrucoes / s / 1e6);
+  fprintf(arq, "%s\"interrupcoes\": %ld,\n", recuo, est->interrupcoes);
+  fprintf(arq, "%s\"interrupcoes_por_s\": %.0f,\n", recuo, est->interrupcoes / s);
+  fprintf(arq, "%s\"fracao_no_so\": %.4f", recuo, est->segundos_no_so / s);
+}
+
+// vim: foldmethod=marker
@@ -0,0 +1,80 @@
+// maquina.h
+// um computador simulado completo, com o seu sistema operacional
+// simulador de computador
+// so24b
+
+#ifndef MAQUINA_H
+#define MAQUINA_H
+
+// A máquina junta os componentes do computador simulado (memória, CPU,
+//   dispositivos, console, controlador) e o SO que executa nele.
+// Com mais de uma CPU, todas compartilham a memória e os dispositivos (ver
+//   as regras em controle.h); o JIT não é usado.
+// As máquinas são independentes umas das outras: várias podem executar ao
+//   mesmo tempo, cada uma na sua thread (ver console_cria), desde que só uma
+//   tenha tela e cada uma tenha seu diretório para os arquivos da console.
+
+#include "cpu.h"
+#include "so.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct maquina_t maquina_t;
+
+// configuração de uma máquina
+typedef struct {
+  cpu_motor_t motor;
+  bool jit;
+  bool jit_compara;
+  bool aot;                   // carrega o código nativo (.so) dos programas
+  bool perfil;
+  char *comandos;             // arquivo de comandos, NULL para ter tela
+  long tam_log;               // tamanho para rodar o log (0 para não rodar)
+  char *dir;                  // diretório dos arquivos da console, ou NULL
+  char *roteiro;              // roteiro de entrada dos terminais, ou NULL
+  char *programa_inicial;
+  int tam_memoria;
+  int intervalo_interrupcao;  // do relógio, em instruções
+  int quantum;                // do escalonador, em interrupções do relógio
+  so_escalonador_t escalonador;
+  bool mede_tempo;            // mede o tempo no SO (ver so_mede_tempo)
+  int n_cpus;                 // número de CPUs (até MAX_CPUS)
+  bool paralelo;              // cada CPU na sua thread (ver controle.h)
+  bool tratamento_direto;     // SO chamado sem o tratador em assembly
+} maquina_config_t;
+
+// estatísticas de uma execução
+typedef struct {
+  double segundos;            // tempo real executando
+  int tempo_simulado;
+  long long instrucoes;
+  long interrupcoes;
+  double segundos_no_so;      // só se mede_tempo
+} maquina_estatisticas_t;
+
+// preenche 'cfg' com a configuração padrão (com tela, init.maq, 10000
+//   posições de memória, interrupção a cada 50 instruções, quantum de 10
+//   interrupções, escalonador round-robin, uma CPU)
+void maquina_config_padrao(maquina_config_t *cfg);
+
+// cria a máquina com a configuração 'cfg', e o SO, que carrega o programa
+//   inicial
+maquina_t *maquina_cria(maquina_config_t *cfg);
+
+// destrói a máquina
+void maquina_destroi(maquina_t *self);
+
+// executa a máquina até o operador mandar terminar
+void maquina_executa(maquina_t *self);
+
+// preenche 'est' com as estatísticas da execução
+void maquina_estatisticas(maquina_t *self, maquina_estatisticas_t *est);
+
+// escreve as estatísticas em 'arq', em JSON, uma chave por linha, precedida
+//   por 'recuo'; as linhas são separadas por vírgulas, e a última não tem
+//   fim de linha (para quem chama poder continuar o objeto)
+void maquina_escreve_estatisticas(FILE *arq, maquina_estatisticas_t *est,
+                                  char *recuo);
+
+#endif // MAQUINA_H
@@ -8,10 +8,30 @@
 #include <stdlib.h>
 #include <assert.h>
 
+// um observador de alterações na memória
+typedef struct {
+  mem_f_alteracao_t f_alteracao;
+  void *arg;
+} observador_t;
+
+// A memória pode ser compartilhada por várias CPUs, cada uma na sua thread.
+// Cada acesso a um endereço (ao conteúdo e às marcas) é atômico, sem impor
+//   ordem entre endereços diferentes (memory_order_relaxed, que custa o
+//   mesmo que um acesso comum); a ordem entre as CPUs é dada pelo controle
+//   (ver controle.h).
+// Sem ordem entre o conteúdo e as marcas, uma escrita feita ao mesmo tempo
+//   em que outra thread marca o endereço e o lê pode não ser avisada: a
+//   escrita não vê a marca, e a leitura não vê o valor novo. Colocar uma
+//   barreira nesse ponto custaria em toda escrita; em vez disso, quem observa
+//   confere o que leu depois da próxima sincronização entre as threads.
+
 // tipo de dados para representar uma região de memória
 struct mem_t {
   int tam;
   int *conteudo;
+  // para cada endereço, um bit para cada observador que o marcou
+  unsigned char *observado;
+  observador_t observadores[MEM_MAX_OBSERVADORES];
 };
 
 mem_t *mem_cria(int tam)
@@ -23,6 +43,12 @@ mem_t *mem_cria(int tam)
   self->conteudo = malloc(tam * sizeof(*(self->conteudo)));
   assert(self->conteudo != NULL);
 
+  self->observado = calloc(tam, sizeof(*(self->observado)));
+  assert(self->observado != NULL);
+  for (int obs = 0; obs < MEM_MAX_OBSERVADORES; obs++) {
+    self->observadores[obs].f_alteracao = NULL;
+  }
+
   self->tam = tam;
 
   return self;
@@ -34,6 +60,7 @@ void mem_destroi(mem_t *self)
     if (self->conteudo != NULL) {
       free(self->conteudo);
     }
+    free(self->observado);
     free(self);
   }
 }
@@ -56,16 +83,73 @@ err_t mem_le(mem_t *self, int endereco, int *pvalor)
 {
   err_t err = verifica_permissao(self, endereco);
   if (err == ERR_OK) {
-    *pvalor = self->conteudo[endereco];
+    *pvalor = __atomic_load_n(&self->conteudo[endereco], __ATOMIC_RELAXED);
   }
   return err;
 }
 
+// avisa os observadores que marcaram o endereço que ele foi alterado
+static void avisa_observadores(mem_t *self, int endereco)
+{
+  unsigned char marcas = __atomic_exchange_n(&self->observado[endereco], 0,
+                                             __ATOMIC_RELAXED);
+  for (int obs = 0; obs < MEM_MAX_OBSERVADORES; obs++) {
+    observador_t *o = &self->observadores[obs];
+    if ((marcas & (1 << obs)) != 0 && o->f_alteracao != NULL) {
+      o->f_alteracao(o->arg, endereco);
+    }
+  }
+}
+
 err_t mem_escreve(mem_t *self, int endereco, int valor)
 {
   err_t err = verifica_permissao(self, endereco);
   if (err == ERR_OK) {
-    self->conteudo[endereco] = valor;
+    __atomic_store_n(&self->conteudo[endereco], valor, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&self->observado[endereco], __ATOMIC_RELAXED) != 0) {
+      avisa_observadores(self, endereco);
+    }
   }
   return err;
 }
+
+// OBSERVAÇÃO DE ESCRITAS
+
+int mem_registra_observador(mem_t *self, mem_f_alteracao_t f_alteracao, void *arg)
+{
+  for (int obs = 0; obs < MEM_MAX_OBSERVADORES; obs++) {
+    if (self->observadores[obs].f_alteracao == NULL) {
+      self->observadores[obs].f_alteracao = f_alteracao;
+      self->observadores[obs].arg = arg;
+      return obs;
+    }
+  }
+  return -1;
+}
+
+void mem_remove_observador(mem_t *self, int obs)
+{
+  if (obs < 0 || obs >= MEM_MAX_OBSERVADORES) return;
+  self->observadores[obs].f_alteracao = NULL;
+  for (int end = 0; end < self->tam; end++) {
+    self->observado[end] &= ~(1 << obs);
+  }
+}
+
+void mem_observa(mem_t *self, int obs, int endereco)
+{
+  if (verifica_permissao(self, endereco) != ERR_OK) return;
+  __atomic_fetch_or(&self->observado[endereco], 1 << obs, __ATOMIC_RELAXED);
+}
+
+// ACESSO DIRETO
+
+int *mem_conteudo(mem_t *self)
+{
+  return self->conteudo;
+}
+
+unsigned char *mem_marcas(mem_t *self)
+{
+  return self->observado;
+}
@@ -31,4 +31,45 @@ err_t mem_le(mem_t *self, int endereco, int *pvalor);
 // retorna erro ERR_END_INV se endereço inválido
 err_t mem_escreve(mem_t *self, int endereco, int valor);
 
+// mem_le e mem_escreve podem ser chamadas ao mesmo tempo por várias threads
+//   (CPUs); cada acesso a um endereço é atômico
+
+// OBSERVAÇÃO DE ESCRITAS
+// Um observador pode marcar endereços da memória, e é avisado (pela chamada
+//   da função que ele registrou) quando um endereço marcado por ele é
+//   alterado por mem_escreve. A marca é removida quando o aviso é feito.
+// Serve para manter coerentes dados derivados do conteúdo da memória (por
+//   exemplo, instruções já decodificadas), mesmo com código que se altera.
+// Com várias threads, uma escrita simultânea à marcação do endereço por
+//   outra thread pode não ser avisada; o observador deve conferir o que leu
+//   depois de uma sincronização (ver memoria.c).
+
+// número máximo de observadores de uma memória
+#define MEM_MAX_OBSERVADORES 8
+
+// tipo da função chamada quando um endereço observado é alterado
+typedef void (*mem_f_alteracao_t)(void *arg, int endereco);
+
+// registra um observador, que será avisado chamando 'f_alteracao' com 'arg'
+// retorna a identificação do observador, ou -1 se não foi possível registrar
+int mem_registra_observador(mem_t *self, mem_f_alteracao_t f_alteracao, void *arg);
+
+// remove o registro do observador 'obs'
+void mem_remove_observador(mem_t *self, int obs);
+
+// marca 'endereco' como observado por 'obs' (ignora endereço inválido)
+void mem_observa(mem_t *self, int obs, int endereco);
+
+// ACESSO DIRETO
+// Para código que acessa a memória sem passar por mem_le e mem_escreve
+//   (código nativo gerado pelo JIT). Quem escreve diretamente não pode
+//   alterar endereços observados (com marca diferente de 0).
+// Só pode ser usado com uma CPU: os acessos diretos não são atômicos.
+
+// retorna o vetor com o conteúdo da memória (tem mem_tam() valores)
+int *mem_conteudo(mem_t *self);
+
+// retorna o vetor com as marcas de observação (um valor por endereço)
+unsigned char *mem_marcas(mem_t *self);
+
 #endif // MEMORIA_H
@@ -0,0 +1,416 @@
+// microbench.c
+// mede o tempo das operações básicas do simulador, isoladamente
+// simulador de computador
+// so24b
+
+// Cada operação é executada muitas vezes; o tempo é medido com
+//   clock_gettime em amostras (de um lote de execuções, para as operações
+//   muito rápidas, ou de uma execução, para as demoradas), depois de algumas
+//   amostras de aquecimento que são descartadas. O resultado é o tempo por
+//   operação nos percentis 50 e 99 das amostras.
+// As medidas são:
+//   - cpu_executa_1 para cada instrução (executando uma sequência da mesma
+//     instrução, em modo supervisor)
+//   - mem_le e mem_escreve
+//   - es_le e es_escreve, que despacham para o dispositivo por ponteiro de
+//     função
+//   - terminal_leitura
+//   - o tratamento completo de uma interrupção pelo SO, desde a CPU aceitar
+//     a interrupção até o retorno ao processo, para cada tipo de interrupção
+//   - o reset, medido à parte porque cria um processo, lendo o programa do
+//     disco, e não é só latência de interrupção
+// A console é criada sem tela, e cria os arquivos dela (log_da_console,
+//   saida_do_terminal_X) num diretório temporário, removido no final; as
+//   mensagens do SO e da CPU ficam desligadas.
+
+#include "cpu.h"
+#include "memoria.h"
+#include "es.h"
+#include "relogio.h"
+#include "eventos.h"
+#include "console.h"
+#include "terminal.h"
+#include "instrucao.h"
+#include "dispositivos.h"
+#include "irq.h"
+#include "so.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+// CONSTANTES {{{1
+
+#define MEM_TAM 10000
+
+// número de amostras medidas e de aquecimento
+#define N_AMOSTRAS      2000
+#define N_AQUECIMENTO    200
+// número de operações em cada amostra das operações rápidas
+#define OPS_POR_AMOSTRA  100
+
+// endereços usados pelos programas de teste das instruções
+#define END_PROGRAMA  IRQ_END_TRATADOR
+#define END_DADO      5000
+#define END_SUBROTINA 6000
+
+// MEDIÇÃO {{{1
+
+static double agora_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compara_double(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+// amostras de uma medida (tempo por operação, em ns)
+typedef struct {
+  double v[N_AMOSTRAS];
+  int n;
+} amostras_t;
+
+static void relata(char *nome, amostras_t *a)
+{
+  qsort(a->v, a->n, sizeof(a->v[0]), compara_double);
+  double p50 = a->v[a->n * 50 / 100];
+  double p99 = a->v[a->n * 99 / 100];
+  printf("  %-36s p50 %9.1f ns   p99 %9.1f ns\n", nome, p50, p99);
+}
+
+// função medida: executa a operação 'n' vezes
+typedef void (*f_medida_t)(void *arg, int n);
+// função chamada antes de cada amostra, fora da medida
+typedef void (*f_prepara_t)(void *arg);
+
+// mede a função, com 'n_amostras' amostras de 'ops' operações cada
+static void mede_com_preparo(char *nome, f_prepara_t prepara, f_medida_t f,
+                             void *arg, int n_amostras, int ops)
+{
+  static amostras_t a;
+  for (int i = 0; i < N_AQUECIMENTO; i++) {
+    if (prepara != NULL) prepara(arg);
+    f(arg, ops);
+  }
+  a.n = 0;
+  for (int i = 0; i < n_amostras; i++) {
+    if (prepara != NULL) prepara(arg);
+    double ini = agora_ns();
+    f(arg, ops);
+    a.v[a.n++] = (agora_ns() - ini) / ops;
+  }
+  relata(nome, &a);
+}
+
+static void mede(char *nome, f_medida_t f, void *arg, int n_amostras, int ops)
+{
+  mede_com_preparo(nome, NULL, f, arg, n_amostras, ops);
+}
+
+// INSTRUÇÕES {{{1
+
+// cada instrução é medida com um programa que é a repetição dela, seguida de
+//   um desvio para o início; os desvios vão para a instrução seguinte, e o
+//   CHAMA vai para uma subrotina que só tem o RET
+typedef struct {
+  char *nome;
+  int opcode;
+  int arg;
+  int passos;   // número de instruções executadas para cada uma do programa
+} teste_instr_t;
+
+static teste_instr_t testes_instr[] = {
+  { "NOP",         NOP,    0,                  1 },
+  { "CARGI",       CARGI,  1,                  1 },
+  { "CARGM",       CARGM,  END_DADO,           1 },
+  { "CARGX",       CARGX,  END_DADO,           1 },
+  { "ARMM",        ARMM,   END_DADO,           1 },
+  { "ARMX",        ARMX,   END_DADO,           1 },
+  { "TRAX",        TRAX,   0,                  1 },
+  { "CPXA",        CPXA,   0,                  1 },
+  { "INCX",        INCX,   0,                  1 },
+  { "SOMA",        SOMA,   END_DADO,           1 },
+  { "SUB",         SUB,    END_DADO,           1 },
+  { "MULT",        MULT,   END_DADO,           1 },
+  { "DIV",         DIV,    END_DADO,           1 },
+  { "RESTO",       RESTO,  END_DADO,           1 },
+  { "NEG",         NEG,    0,                  1 },
+  { "DESV",        DESV,   -1,                 1 },
+  { "DESVZ",       DESVZ,  -1,                 1 },
+  { "DESVNZ",      DESVNZ, -1,                 1 },
+  { "DESVN",       DESVN,  -1,                 1 },
+  { "DESVP",       DESVP,  -1,                 1 },
+  { "CHAMA+RET",   CHAMA,  END_SUBROTINA,      2 },
+  { "LE",          LE,     D_RELOGIO_INSTRUCOES, 1 },
+  { "ESCR",        ESCR,   D_RELOGIO_INTERRUPCAO, 1 },
+};
+#define N_TESTES_INSTR (sizeof(testes_instr) / sizeof(testes_instr[0]))
+
+typedef struct {
+  cpu_t *cpu;
+  int passos;
+} arg_instr_t;
+
+static void executa_instr(void *arg, int n)
+{
+  arg_instr_t *a = arg;
+  for (int i = 0; i < n * a->passos; i++) {
+    cpu_executa_1(a->cpu);
+  }
+}
+
+// escreve o programa de teste da instrução na memória
+static void monta_programa(mem_t *mem, teste_instr_t *t)
+{
+  int tam = instrucao_num_args(t->opcode) + 1;
+  int end = END_PROGRAMA;
+  for (int i = 0; i < OPS_POR_AMOSTRA; i++) {
+    mem_escreve(mem, end, t->opcode);
+    if (tam > 1) {
+      // arg -1: desvio para a próxima instrução
+      mem_escreve(mem, end + 1, t->arg == -1 ? end + tam : t->arg);
+    }
+    end += tam;
+  }
+  mem_escreve(mem, end, DESV);
+  mem_escreve(mem, end + 1, END_PROGRAMA);
+  mem_escreve(mem, END_DADO, 1);
+  mem_escreve(mem, END_SUBROTINA + 1, RET);
+  mem_escreve(mem, END_SUBROTINA + 2, END_SUBROTINA);
+}
+
+static void mede_instrucoes(es_t *es)
+{
+  printf("cpu_executa_1, por instrução:\n");
+  for (int i = 0; i < N_TESTES_INSTR; i++) {
+    teste_instr_t *t = &testes_instr[i];
+    mem_t *mem = mem_cria(MEM_TAM);
+    cpu_t *cpu = cpu_cria(mem, es, 0);
+    monta_programa(mem, t);
+    // a interrupção põe a CPU em modo supervisor, executando a partir de
+    //   END_PROGRAMA
+    cpu_interrompe(cpu, IRQ_RESET);
+    arg_instr_t arg = { cpu, t->passos };
+    // uma amostra executa OPS_POR_AMOSTRA instruções; o desvio de volta ao
+    //   início fica no meio de alguma, e entra na conta (1%)
+    mede(t->nome, executa_instr, &arg, N_AMOSTRAS, OPS_POR_AMOSTRA);
+    cpu_destroi(cpu);
+    mem_destroi(mem);
+  }
+}
+
+// MEMÓRIA E E/S {{{1
+
+static void mem_le_n(void *arg, int n)
+{
+  int v;
+  for (int i = 0; i < n; i++) {
+    mem_le(arg, END_DADO + i, &v);
+  }
+}
+
+static void mem_escreve_n(void *arg, int n)
+{
+  for (int i = 0; i < n; i++) {
+    mem_escreve(arg, END_DADO + i, i);
+  }
+}
+
+static void es_le_n(void *arg, int n)
+{
+  int v;
+  for (int i = 0; i < n; i++) {
+    es_le(arg, D_RELOGIO_INSTRUCOES, &v);
+  }
+}
+
+static void es_escreve_n(void *arg, int n)
+{
+  for (int i = 0; i < n; i++) {
+    es_escreve(arg, D_RELOGIO_INTERRUPCAO, 0);
+  }
+}
+
+static void terminal_teclado_ok_n(void *arg, int n)
+{
+  int v;
+  for (int i = 0; i < n; i++) {
+    terminal_leitura(arg, 1, &v);
+  }
+}
+
+static void terminal_tela_ok_n(void *arg, int n)
+{
+  int v;
+  for (int i = 0; i < n; i++) {
+    terminal_leitura(arg, 3, &v);
+  }
+}
+
+static void mede_mem_es(es_t *es, terminal_t *terminal)
+{
+  mem_t *mem = mem_cria(MEM_TAM);
+  printf("memória:\n");
+  mede("mem_le", mem_le_n, mem, N_AMOSTRAS, OPS_POR_AMOSTRA);
+  mede("mem_escreve", mem_escreve_n, mem, N_AMOSTRAS, OPS_POR_AMOSTRA);
+  mem_destroi(mem);
+  printf("E/S:\n");
+  mede("es_le (D_RELOGIO_INSTRUCOES)", es_le_n, es, N_AMOSTRAS, OPS_POR_AMOSTRA);
+  mede("es_escreve (D_RELOGIO_INTERRUPCAO)", es_escreve_n, es, N_AMOSTRAS, OPS_POR_AMOSTRA);
+  mede("terminal_leitura (teclado ok)", terminal_teclado_ok_n, terminal,
+       N_AMOSTRAS, OPS_POR_AMOSTRA);
+  mede("terminal_leitura (tela ok)", terminal_tela_ok_n, terminal,
+       N_AMOSTRAS, OPS_POR_AMOSTRA);
+}
+
+// INTERRUPÇÕES {{{1
+
+typedef struct {
+  cpu_t *cpu;
+  mem_t *mem;
+  eventos_t *eventos;
+  irq_t irq;
+} arg_irq_t;
+
+// uma volta completa: a CPU aceita a interrupção e executa o tratador
+//   (CHAMAC, DESVNZ, RETI ou PARA), que chama o SO
+static void interrompe_n(void *arg, int n)
+{
+  arg_irq_t *a = arg;
+  for (int i = 0; i < n; i++) {
+    cpu_interrompe(a->cpu, a->irq);
+    if (a->irq == IRQ_SISTEMA) {
+      // o processo pede para escrever um caractere
+      mem_escreve(a->mem, IRQ_END_A, SO_ESCR);
+      mem_escreve(a->mem, IRQ_END_X, 'x');
+    }
+    for (int passo = 0; passo < 3; passo++) {
+      cpu_executa_1(a->cpu);
+    }
+  }
+}
+
+// deixa o terminal terminar o que estiver fazendo, para a próxima escrita
+//   não bloquear o processo
+static void avanca_tempo(void *arg)
+{
+  arg_irq_t *a = arg;
+  eventos_avanca(a->eventos, 1000);
+}
+
+static void mede_interrupcoes(es_t *es, console_t *console,
+                              eventos_t *eventos)
+{
+  printf("so_trata_interrupcao, volta completa:\n");
+  mem_t *mem = mem_cria(MEM_TAM);
+  cpu_t *cpu = cpu_cria(mem, es, 0);
+  so_t *so = so_cria(cpu, mem, es, console, "init.maq");
+  arg_irq_t arg = { cpu, mem, eventos, IRQ_RESET };
+  // o reset cria o processo que é interrompido nas outras
+  interrompe_n(&arg, 1);
+  arg.irq = IRQ_SISTEMA;
+  mede_com_preparo("IRQ_SISTEMA (SO_ESCR)", avanca_tempo, interrompe_n, &arg,
+                   N_AMOSTRAS, 1);
+  arg.irq = IRQ_RELOGIO;
+  mede_com_preparo("IRQ_RELOGIO", avanca_tempo, interrompe_n, &arg,
+                   N_AMOSTRAS, 1);
+  // o erro de CPU põe o SO em erro interno, e tem que ser a última
+  arg.irq = IRQ_ERR_CPU;
+  mede_com_preparo("IRQ_ERR_CPU", avanca_tempo, interrompe_n, &arg,
+                   N_AMOSTRAS, 1);
+  so_destroi(so);
+  cpu_destroi(cpu);
+  mem_destroi(mem);
+}
+
+// cada reset cria mais um processo, lendo o programa do disco; é medido num
+//   SO separado, para os processos a mais não deixarem as outras
+//   interrupções mais lentas
+static void mede_reset(es_t *es, console_t *console, eventos_t *eventos)
+{
+  printf("reset, com a criação de um processo (inclui a leitura do programa):\n");
+  mem_t *mem = mem_cria(MEM_TAM);
+  cpu_t *cpu = cpu_cria(mem, es, 0);
+  so_t *so = so_cria(cpu, mem, es, console, "init.maq");
+  arg_irq_t arg = { cpu, mem, eventos, IRQ_RESET };
+  mede_com_preparo("IRQ_RESET", avanca_tempo, interrompe_n, &arg,
+                   N_AMOSTRAS / 10, 1);
+  so_destroi(so);
+  cpu_destroi(cpu);
+  mem_destroi(mem);
+}
+
+// DIRETÓRIO TEMPORÁRIO {{{1
+
+// remove o diretório e os arquivos que estão nele
+static void remove_diretorio(char *dir)
+{
+  DIR *d = opendir(dir);
+  if (d == NULL) return;
+  struct dirent *ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    char nome[strlen(dir) + strlen(ent->d_name) + 2];
+    sprintf(nome, "%s/%s", dir, ent->d_name);
+    unlink(nome);
+  }
+  closedir(d);
+  rmdir(dir);
+}
+
+// PRINCIPAL {{{1
+
+int main(void)
+{
+  // os arquivos da console não devem sobrescrever os de uma execução do
+  //   simulador no diretório atual
+  char dir[] = "/tmp/microbench_XXXXXX";
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  eventos_t *eventos = eventos_cria();
+  console_t *console = console_cria(eventos, "/dev/null", 0, dir);
+  console_define_nivel(console, LOG_SO, LOG_NENHUM);
+  console_define_nivel(console, LOG_CPU, LOG_NENHUM);
+  relogio_t *relogio = relogio_cria(eventos);
+  es_t *es = es_cria();
+  // os terminais ocupam 4 dispositivos cada, na mesma ordem dos seus ids
+  for (int t = 0; t < 4; t++) {
+    terminal_t *terminal = console_terminal(console, 'A' + t);
+    int d = D_TERM_A_TECLADO + 4 * t;
+    es_registra_dispositivo(es, d + 0, terminal, 0, terminal_leitura, NULL);
+    es_registra_dispositivo(es, d + 1, terminal, 1, terminal_leitura, NULL);
+    es_registra_dispositivo(es, d + 2, terminal, 2, NULL, terminal_escrita);
+    es_registra_dispositivo(es, d + 3, terminal, 3, terminal_leitura, NULL);
+  }
+  es_registra_dispositivo(es, D_RELOGIO_INSTRUCOES, relogio, 0, relogio_leitura, NULL);
+  es_registra_dispositivo(es, D_RELOGIO_REAL, relogio, 1, relogio_leitura, NULL);
+  es_registra_dispositivo(es, D_RELOGIO_TIMER, relogio, 2, relogio_leitura, relogio_escrita);
+  es_registra_dispositivo(es, D_RELOGIO_INTERRUPCAO, relogio, 3, relogio_leitura, relogio_escrita);
+
+  mede_instrucoes(es);
+  mede_mem_es(es, console_terminal(console, 'A'));
+  mede_interrupcoes(es, console, eventos);
+  mede_reset(es, console, eventos);
+
+  es_destroi(es);
+  relogio_destroi(relogio);
+  console_destroi(console);
+  eventos_destroi(eventos);
+  remove_diretorio(dir);
+  return 0;
+}
+
+// vim: foldmethod=marker
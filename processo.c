@@ -1,14 +1,36 @@
 #include <stdlib.h>
+#include <assert.h>
 #include "processo.h"
 
+#define TAM_INDICE_INICIAL 16
+
 
 // Funcoes Processo
 
-processo *processo_cria(int pid, int PC) {
-    processo *p = (processo*) malloc(sizeof(processo));
+// pega um descritor livre da reserva, alocando mais um bloco se não tiver
+static processo *pega_descritor(tabela_processos_t *tabela) {
+    if (tabela->livres == NULL) {
+        bloco_processos_t *bloco = malloc(sizeof(*bloco));
+        assert(bloco != NULL);
+        bloco->proximo = tabela->blocos;
+        tabela->blocos = bloco;
+        for (int i = PROCESSOS_POR_BLOCO - 1; i >= 0; i--) {
+            bloco->descritores[i].proximo_processo = tabela->livres;
+            tabela->livres = &bloco->descritores[i];
+        }
+    }
+    processo *p = tabela->livres;
+    tabela->livres = p->proximo_processo;
+    return p;
+}
+
+processo *processo_cria(tabela_processos_t *tabela, int pid, int PC) {
+    processo *p = pega_descritor(tabela);
     p->pid = pid;
     p->estado = PROCESSO_PRONTO;
     p->proximo_processo = NULL;
+    p->anterior_processo = NULL;
+    p->proximo_indice = NULL;
     p->PC = PC;
     p->A = 0;
     p->X = 0;
@@ -16,6 +38,17 @@ processo *processo_cria(int pid, int PC) {
     p->tipo_bloqueio = NULO;
     p->pid_prioridade = -1;
     p->QUANTUM = -1;
+    p->nivel = 0;
+    p->epoca = 0;
+    p->vruntime = -1;
+    p->peso = PESO_NORMAL;
+    p->esq = NULL;
+    p->dir = NULL;
+    p->altura = 0;
+    p->fila = NULL;
+    p->proximo_fila = NULL;
+    p->anterior_fila = NULL;
+    inicializa_fila_processos(&p->esperam_fim);
     return p;
 }
 
@@ -43,6 +76,14 @@ void processo_bloqueia(processo *p, tipo_bloqueio_t TIPO_BLOQUEIO, int pid_prior
     }
 }
 
+void processo_termina(tabela_processos_t *tabela, processo *p)
+{
+    if (p->estado != TERMINADO) {
+        p->estado = TERMINADO;
+        tabela->n_vivos--;
+    }
+}
+
 void processo_desbloqueia(processo *p)
 {
     if (p->estado==PROCESSO_BLOQUEADO)
@@ -62,12 +103,60 @@ void inicializa_tabela_processos(tabela_processos_t *tabela) {
     tabela->primeiro = NULL;
     tabela->ultimo = NULL;
     tabela->id = 0;
+    tabela->n = 0;
+    tabela->n_vivos = 0;
+    tabela->tam_indice = TAM_INDICE_INICIAL;
+    tabela->indice = calloc(tabela->tam_indice, sizeof(processo *));
+    assert(tabela->indice != NULL);
+    tabela->livres = NULL;
+    tabela->blocos = NULL;
+}
+
+void destroi_tabela_processos(tabela_processos_t *tabela) {
+    while (tabela->blocos != NULL) {
+        bloco_processos_t *bloco = tabela->blocos;
+        tabela->blocos = bloco->proximo;
+        free(bloco);
+    }
+    free(tabela->indice);
+    tabela->indice = NULL;
+    tabela->primeiro = NULL;
+    tabela->ultimo = NULL;
+    tabela->livres = NULL;
+}
+
+// o balde do índice onde fica o pid
+static processo **balde(tabela_processos_t *tabela, int pid) {
+    return &tabela->indice[pid & (tabela->tam_indice - 1)];
+}
+
+// dobra o número de baldes do índice, redistribuindo os processos
+static void aumenta_indice(tabela_processos_t *tabela) {
+    processo **antigo = tabela->indice;
+    int tam_antigo = tabela->tam_indice;
+    tabela->tam_indice *= 2;
+    tabela->indice = calloc(tabela->tam_indice, sizeof(processo *));
+    assert(tabela->indice != NULL);
+    for (int i = 0; i < tam_antigo; i++) {
+        processo *p = antigo[i];
+        while (p != NULL) {
+            processo *proximo = p->proximo_indice;
+            processo **b = balde(tabela, p->pid);
+            p->proximo_indice = *b;
+            *b = p;
+            p = proximo;
+        }
+    }
+    free(antigo);
 }
 
 void adiciona_processo(tabela_processos_t *tabela, processo *novo_processo) {
 
     tabela->id++;
+    tabela->n++;
+    if (novo_processo->estado != TERMINADO) tabela->n_vivos++;
 
+    novo_processo->anterior_processo = tabela->ultimo;
     if (tabela->primeiro == NULL) {
         // Primeiro processo na tabela
         tabela->primeiro = novo_processo;
@@ -78,23 +167,26 @@ void adiciona_processo(tabela_processos_t *tabela, processo *novo_processo) {
         tabela->ultimo = novo_processo;
     }
     novo_processo->proximo_processo = NULL; // Final da lista
+
+    if (tabela->n > tabela->tam_indice) aumenta_indice(tabela);
+    processo **b = balde(tabela, novo_processo->pid);
+    novo_processo->proximo_indice = *b;
+    *b = novo_processo;
 }
 
 processo *busca_processo(tabela_processos_t *tabela, int pid) {
-    if (tabela == NULL || tabela->primeiro == NULL) {
-        // A tabela está vazia ou inválida
+    if (tabela == NULL || tabela->indice == NULL) {
+        // A tabela está inválida
         return NULL;
     }
 
-    processo *atual = tabela->primeiro;
-
-    // Percorre a lista para procurar o processo
-    while (atual != NULL) {
+    // Percorre o balde do índice para procurar o processo
+    for (processo *atual = *balde(tabela, pid); atual != NULL;
+         atual = atual->proximo_indice) {
         if (atual->pid == pid) {
             // Processo encontrado
             return atual;
         }
-        atual = atual->proximo_processo;
     }
     
     // Processo não encontrado
@@ -128,38 +220,28 @@ void remove_processo_tabela(tabela_processos_t *tabela, processo *processo_remov
         return;
     }
 
-    processo *atual = tabela->primeiro;
-    processo *anterior = NULL;
+    // tira da lista
+    if (processo_remover->anterior_processo == NULL) {
+        tabela->primeiro = processo_remover->proximo_processo;
+    } else {
+        processo_remover->anterior_processo->proximo_processo = processo_remover->proximo_processo;
+    }
+    if (processo_remover->proximo_processo == NULL) {
+        tabela->ultimo = processo_remover->anterior_processo;
+    } else {
+        processo_remover->proximo_processo->anterior_processo = processo_remover->anterior_processo;
+    }
+    processo_remover->proximo_processo = NULL;
+    processo_remover->anterior_processo = NULL;
 
-    // Percorre a lista para encontrar o processo
-    while (atual != NULL) {
-        if (atual == processo_remover) {
-            // Processo encontrado
-            if (anterior == NULL) {
-                // O processo a remover é o primeiro da lista
-                tabela->primeiro = atual->proximo_processo;
-                if (tabela->primeiro == NULL) {
-                    // A tabela ficou vazia
-                    tabela->ultimo = NULL;
-                }
-            } else {
-                // Removendo um processo do meio ou fim da lista
-                anterior->proximo_processo = atual->proximo_processo;
-                if (atual == tabela->ultimo) {
-                    // O processo a remover era o último da lista
-                    tabela->ultimo = anterior;
-                }
-            }
-
-            // Libera o processo, se necessário
-            //atual->proximo_processo = NULL;
-            return;
-        }
+    // tira do índice
+    processo **b = balde(tabela, processo_remover->pid);
+    while (*b != NULL && *b != processo_remover) b = &(*b)->proximo_indice;
+    if (*b != NULL) *b = processo_remover->proximo_indice;
+    processo_remover->proximo_indice = NULL;
 
-        // Avança na lista
-        anterior = atual;
-        atual = atual->proximo_processo;
-    }
+    tabela->n--;
+    if (processo_remover->estado != TERMINADO) tabela->n_vivos--;
 }
 
 void remove_primeiro_fila(tabela_processos_t *fila)
@@ -168,6 +250,65 @@ void remove_primeiro_fila(tabela_processos_t *fila)
     fila->id-=1;
 }
 
+void libera_processo(tabela_processos_t *tabela, processo *p)
+{
+    remove_processo_tabela(tabela, p);
+    p->proximo_processo = tabela->livres;
+    tabela->livres = p;
+}
+
+
+// Funcoes fila
+
+void inicializa_fila_processos(fila_processos_t *fila) {
+    fila->primeiro = NULL;
+    fila->ultimo = NULL;
+    fila->n = 0;
+}
+
+void fila_insere_processo(fila_processos_t *fila, processo *p) {
+    if (p->fila != NULL) {
+        // já está numa fila
+        return;
+    }
+    p->fila = fila;
+    p->proximo_fila = NULL;
+    p->anterior_fila = fila->ultimo;
+    if (fila->ultimo == NULL) {
+        fila->primeiro = p;
+    } else {
+        fila->ultimo->proximo_fila = p;
+    }
+    fila->ultimo = p;
+    fila->n++;
+}
+
+void fila_remove_processo(fila_processos_t *fila, processo *p) {
+    if (p == NULL || fila == NULL || p->fila != fila) {
+        return;
+    }
+    if (p->anterior_fila == NULL) {
+        fila->primeiro = p->proximo_fila;
+    } else {
+        p->anterior_fila->proximo_fila = p->proximo_fila;
+    }
+    if (p->proximo_fila == NULL) {
+        fila->ultimo = p->anterior_fila;
+    } else {
+        p->proximo_fila->anterior_fila = p->anterior_fila;
+    }
+    p->fila = NULL;
+    p->proximo_fila = NULL;
+    p->anterior_fila = NULL;
+    fila->n--;
+}
+
+processo *fila_retira_primeiro(fila_processos_t *fila) {
+    processo *p = fila->primeiro;
+    fila_remove_processo(fila, p);
+    return p;
+}
+
 
 // Gets e Sets
 // Métodos Set Processo
@@ -212,6 +353,14 @@ void setQuantum(processo *p, int valor){
     p->QUANTUM = valor;
 }
 
+void setNivel(processo *p, int valor){
+    p->nivel = valor;
+}
+
+void setPeso(processo *p, int valor){
+    p->peso = valor;
+}
+
 // Métodos Get Processo
 int getPID(processo *p) {
     return p->pid;
@@ -251,4 +400,12 @@ int getPidPrioridade(processo *p){
 
 int getQuantum(processo *p){
     return p->QUANTUM;
+}
+
+int getNivel(processo *p){
+    return p->nivel;
+}
+
+int getPeso(processo *p){
+    return p->peso;
 }
\ No newline at end of file
@@ -8,6 +8,12 @@ typedef enum {
     TERMINADO
 } estado_t;
 
+// peso de um processo no escalonador justo, se não for mudado
+#define PESO_NORMAL 1024
+// limites do peso que um processo pode pedir (ver SO_DEFINE_PESO)
+#define PESO_MIN 16
+#define PESO_MAX (64 * PESO_NORMAL)
+
 typedef enum {
     ESPERANDO_ENTRADA,
     ESPERANDO_SAIDA,
@@ -17,12 +23,26 @@ typedef enum {
 
 struct processo;
 
+// Fila Processo
+// fila de processos (como a de prontos ou uma de espera), duplamente
+//   encadeada pelos campos proximo_fila e anterior_fila do processo; um
+//   processo está em no máximo uma fila, e todas as operações são O(1)
+typedef struct fila_processos_t {
+    struct processo *primeiro;
+    struct processo *ultimo;
+    int n;
+} fila_processos_t;
+
 typedef struct processo {
     int pid;
 
     estado_t estado;
 
+    // encadeamento na tabela (ou na lista de descritores livres) e no balde
+    //   do índice por pid
     struct processo *proximo_processo;
+    struct processo *anterior_processo;
+    struct processo *proximo_indice;
 
     int PC;
     int A;
@@ -33,37 +53,91 @@ typedef struct processo {
     int pid_prioridade;
 
     int QUANTUM;
+    // nível na MLFQ (0 é o mais prioritário), e a promoção de todos em que
+    //   ele foi definido (ver escalonador_mlfq.c)
+    int nivel;
+    int epoca;
+    // escalonador justo: tempo virtual de execução (-1 se ainda não
+    //   executou), peso (PESO_NORMAL se não for mudado), e o encadeamento na
+    //   árvore de prontos (ver escalonador_cfs.c)
+    long long vruntime;
+    int peso;
+    struct processo *esq;
+    struct processo *dir;
+    int altura;
+
+    // fila em que o processo está (NULL se nenhuma) e o encadeamento nela,
+    //   separado do encadeamento da tabela (proximo_processo); é a de
+    //   prontos, ou, se está bloqueado, a de espera pelo recurso
+    fila_processos_t *fila;
+    struct processo *proximo_fila;
+    struct processo *anterior_fila;
+    // processos bloqueados esperando o fim deste (SO_ESPERA_PROC)
+    fila_processos_t esperam_fim;
 
 } processo;
 
-// Funções Processo
-processo *processo_cria(int id, int pc);
-void processo_salva_estado_cpu(processo *p, int PC, int A, int X, int complemento);
-void processo_bloqueia(processo *p, tipo_bloqueio_t TIPO_BLOQUEIO, int pid_bloqueado);
-void processo_desbloqueia(processo *p);
-
 // Tabela
+// os processos que ainda têm descritor (vivos, e os que terminaram mas ainda
+//   não foram liberados), duplamente encadeados pelos campos
+//   proximo_processo e anterior_processo, com um índice por pid (tabela hash
+//   com encadeamento pelo campo proximo_indice, que dobra de tamanho quando
+//   tem mais descritores que baldes)
+// os descritores vêm de uma reserva, alocada em blocos de
+//   PROCESSOS_POR_BLOCO; os liberados voltam para a lista de livres e são
+//   reaproveitados, então a memória usada e o custo da busca dependem do
+//   número de processos que têm descritor, não do número de processos criados
+// os pids não são reaproveitados (pid é id+1 quando o processo é criado),
+//   então um pid de um processo liberado não encontra o descritor reaproveitado
+#define PROCESSOS_POR_BLOCO 16
+
+typedef struct bloco_processos_t {
+    struct bloco_processos_t *proximo;
+    processo descritores[PROCESSOS_POR_BLOCO];
+} bloco_processos_t;
+
 typedef struct {
     processo *primeiro;
     processo *ultimo;
-    int id;
+    int id;                     // número de processos criados
+    int n;                      // número de processos na tabela
+    int n_vivos;                // dos que estão na tabela, os não TERMINADO
+    processo **indice;
+    int tam_indice;             // número de baldes (potência de 2)
+    processo *livres;
+    bloco_processos_t *blocos;
 } tabela_processos_t;
 
+// Funções Processo
+// pega um descritor da reserva da tabela e inicializa (não coloca na tabela)
+processo *processo_cria(tabela_processos_t *tabela, int id, int pc);
+void processo_salva_estado_cpu(processo *p, int PC, int A, int X, int complemento);
+void processo_bloqueia(processo *p, tipo_bloqueio_t TIPO_BLOQUEIO, int pid_bloqueado);
+void processo_desbloqueia(processo *p);
+// o processo (que está na tabela) terminou; o descritor continua na tabela
+void processo_termina(tabela_processos_t *tabela, processo *p);
+
 // Funções Tabela
 processo *busca_processo(tabela_processos_t *tabela, int pid);
 processo *busca_processo_bloqueado(tabela_processos_t *tabela);
 void inicializa_tabela_processos(tabela_processos_t *tabela);
+// libera toda a memória da tabela (inclusive dos descritores)
+void destroi_tabela_processos(tabela_processos_t *tabela);
 void adiciona_processo(tabela_processos_t *tabela, processo *novo_processo);
 void remove_processo_tabela(tabela_processos_t *tabela, processo *processo_remover);
 void remove_primeiro_fila(tabela_processos_t *fila);
+// tira o processo da tabela e devolve o descritor para a reserva
+void libera_processo(tabela_processos_t *tabela, processo *p);
 
-// Fila Processo
-typedef struct {
-    processo *primeiro;
-    processo *ultimo;
-    int id;
-} fila_processos_t;
 
+// Funções Fila
+void inicializa_fila_processos(fila_processos_t *fila);
+// coloca o processo no final da fila
+void fila_insere_processo(fila_processos_t *fila, processo *p);
+// retira e retorna o primeiro processo da fila (NULL se vazia)
+processo *fila_retira_primeiro(fila_processos_t *fila);
+// retira o processo da fila, se estiver nela (fila pode ser NULL)
+void fila_remove_processo(fila_processos_t *fila, processo *p);
 
 
 // Construtores Processo
@@ -80,6 +154,8 @@ void setComplemento(processo *p, int valor);
 void setTipoBloqueio(processo *p, tipo_bloqueio_t valor);
 void setPidPrioridade(processo *p, int valor);
 void setQuantum(processo *p, int valor);
+void setNivel(processo *p, int valor);
+void setPeso(processo *p, int valor);
 
 // Metodos Get Processo
 int getPID(processo *p);
@@ -92,6 +168,8 @@ int getComplemento(processo *p);
 tipo_bloqueio_t getTipoBloqueio(processo *p);
 int getPidPrioridade(processo *p);
 int getQuantum(processo *p);
+int getNivel(processo *p);
+int getPeso(processo *p);
 
 
 
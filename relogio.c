@@ -9,66 +9,120 @@
 #include <time.h>
 #include <assert.h>
 
-struct relogio_t {
-  // que horas são (em tics)
-  int agora;
-  // quanto tempo até gerar uma interrupção
-  int t_ate_interrupcao;
+// um timer, com o seu pedido de interrupção
+typedef struct {
+  // o evento de expiração do timer (-1 se não está agendado)
+  int evento_timer;
+  // quando o timer expira (se está agendado)
+  int quando_interrupcao;
   // 1 se está gerando interrupção, 0 se não
   int interrupcao;
+} temporizador_t;
+
+struct relogio_t {
+  // a fila de eventos, que sabe que horas são (em tics)
+  eventos_t *eventos;
+  // um timer por CPU
+  temporizador_t timers[MAX_CPUS];
+  // quem é avisado quando muda o pedido de interrupção
+  relogio_f_interrupcao_t f_interrupcao;
+  void *arg_interrupcao;
 };
 
-relogio_t *relogio_cria(void)
+relogio_t *relogio_cria(eventos_t *eventos)
 {
   relogio_t *self;
   self = malloc(sizeof(relogio_t));
   assert(self != NULL);
 
-  self->agora = 0;
+  self->eventos = eventos;
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    self->timers[cpu].evento_timer = -1;
+    self->timers[cpu].interrupcao = 0;
+  }
+  self->f_interrupcao = NULL;
 
   return self;
 }
 
 void relogio_destroi(relogio_t *self)
 {
+  for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+    eventos_cancela(self->eventos, self->timers[cpu].evento_timer);
+  }
   free(self);
 }
 
-void relogio_tictac(relogio_t *self)
+void relogio_define_interrupcao(relogio_t *self, relogio_f_interrupcao_t func,
+                                void *arg)
 {
-  self->agora++;
-  // vê se tem que gerar interrupção
-  if (self->t_ate_interrupcao != 0) {
-    self->t_ate_interrupcao--;
-    if (self->t_ate_interrupcao == 0) {
-      self->interrupcao = 1;
-    }
-  }
+  self->f_interrupcao = func;
+  self->arg_interrupcao = arg;
 }
 
 int relogio_agora(relogio_t *self)
 {
-  return self->agora;
+  return eventos_agora(self->eventos);
+}
+
+// altera o pedido de interrupção do timer da CPU 'cpu', avisando se mudou
+static void relogio_muda_interrupcao(relogio_t *self, int cpu, int interrupcao)
+{
+  temporizador_t *timer = &self->timers[cpu];
+  if (interrupcao == timer->interrupcao) return;
+  timer->interrupcao = interrupcao;
+  if (self->f_interrupcao != NULL) {
+    self->f_interrupcao(self->arg_interrupcao, cpu, interrupcao != 0);
+  }
+}
+
+// evento de expiração do timer da CPU 'cpu'
+static void relogio_expira(void *arg, int cpu)
+{
+  relogio_t *self = arg;
+  self->timers[cpu].evento_timer = -1;
+  relogio_muda_interrupcao(self, cpu, 1);
+}
+
+// programa o timer da CPU 'cpu' para expirar daqui a 't' tics (0 desliga;
+//   um valor negativo expira no próximo tic)
+static void relogio_programa_timer(relogio_t *self, int cpu, int t)
+{
+  temporizador_t *timer = &self->timers[cpu];
+  eventos_cancela(self->eventos, timer->evento_timer);
+  timer->evento_timer = -1;
+  if (t == 0) return;
+  if (t < 0) t = 1;
+  timer->quando_interrupcao = relogio_agora(self) + t;
+  timer->evento_timer = eventos_agenda(self->eventos, timer->quando_interrupcao,
+                                       relogio_expira, self, cpu);
 }
 
 err_t relogio_leitura(void *disp, int id, int *pvalor)
 {
   relogio_t *self = disp;
   err_t err = ERR_OK;
+  if (id >= 2 && id < 2 + 2 * MAX_CPUS) {
+    temporizador_t *timer = &self->timers[(id - 2) / 2];
+    if (id % 2 == 0) {
+      if (timer->evento_timer == -1) {
+        *pvalor = 0;
+      } else {
+        *pvalor = timer->quando_interrupcao - relogio_agora(self);
+      }
+    } else {
+      *pvalor = timer->interrupcao;
+    }
+    return err;
+  }
   switch (id) {
     case 0:
-      *pvalor = self->agora;
+      *pvalor = relogio_agora(self);
       break;
     case 1:
       *pvalor = clock()/(CLOCKS_PER_SEC/1000);
       break;
-    case 2:
-      *pvalor = self->t_ate_interrupcao;
-      break;
-    case 3:
-      *pvalor = self->interrupcao;
-      break;
-    default: 
+    default:
       err = ERR_END_INV;
   }
   return err;
@@ -77,16 +131,12 @@ err_t relogio_leitura(void *disp, int id, int *pvalor)
 err_t relogio_escrita(void *disp, int id, int pvalor)
 {
   relogio_t *self = disp;
-  err_t err = ERR_OK;
-  switch (id) {
-    case 2:
-      self->t_ate_interrupcao = pvalor;
-      break;
-    case 3:
-      self->interrupcao = (pvalor == 0) ? 0 : 1;
-      break;
-    default: 
-      err = ERR_END_INV;
+  if (id < 2 || id >= 2 + 2 * MAX_CPUS) return ERR_END_INV;
+  int cpu = (id - 2) / 2;
+  if (id % 2 == 0) {
+    relogio_programa_timer(self, cpu, pvalor);
+  } else {
+    relogio_muda_interrupcao(self, cpu, (pvalor == 0) ? 0 : 1);
   }
-  return err;
+  return ERR_OK;
 }
@@ -7,22 +7,33 @@
 #define RELOGIO_H
 
 // simulador do relógio
-// registra a passagem do tempo
+// a hora é a da fila de eventos; o timer é um evento agendado nela
+// tem um timer para cada CPU (até MAX_CPUS), cada um com o seu pedido de
+//   interrupção
 
 #include "err.h"
+#include "eventos.h"
+#include "irq.h"
+
+#include <stdbool.h>
 
 typedef struct relogio_t relogio_t;
 
-// cria e inicializa um relógio
-relogio_t *relogio_cria(void);
+// tipo da função chamada quando muda o pedido de interrupção do timer da
+//   CPU 'cpu' ('pedindo' é true quando o timer expira, false quando o pedido
+//   é desligado pelo dispositivo 3)
+typedef void (*relogio_f_interrupcao_t)(void *arg, int cpu, bool pedindo);
+
+// cria e inicializa um relógio, que usa a hora da fila de eventos
+relogio_t *relogio_cria(eventos_t *eventos);
 
 // destrói um relógio
 // nenhuma outra operação pode ser realizada no relógio após esta chamada
 void relogio_destroi(relogio_t *self);
 
-// registra a passagem de uma unidade de tempo
-// esta função é chamada pelo controlador após a execução de cada instrução
-void relogio_tictac(relogio_t *self);
+// define a função a chamar quando muda o pedido de interrupção
+void relogio_define_interrupcao(relogio_t *self, relogio_f_interrupcao_t func,
+                                void *arg);
 
 // retorna a hora atual do sistema, em unidades de tempo
 int relogio_agora(relogio_t *self);
@@ -32,6 +43,7 @@ int relogio_agora(relogio_t *self);
 //   '1' para ler o tempo de CPU consumido pelo simulador (em ms)
 //   '2' para ler ou escrever em quanto tempo uma interrupção será gerada
 //   '3' para ler ou escrever se uma interrupção está sendo pedida
+//   '2+2k' e '3+2k' para o mesmo que '2' e '3', com o timer da CPU k
 // Devem seguir o protocolo f_leitura_t e f_escrita_t declarados em es.h
 err_t relogio_leitura(void *disp, int id, int *pvalor);
 err_t relogio_escrita(void *disp, int id, int pvalor);
@@ -10,13 +10,19 @@
 #include "programa.h"
 #include "instrucao.h"
 #include "processo.h"
+#include "escalonador.h"
 #include "assert.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #define MAX_PROCESSOS 10
+// número de terminais (cada processo usa um, ver so_pega_terminal)
+#define N_TERMINAIS 4
 
 typedef enum {
   PROC_TERM_TECLADO        =  0,
@@ -29,8 +35,19 @@ typedef enum {
 
 
 // CONSTANTES E TIPOS {{{1
-// intervalo entre interrupções do relógio
+// intervalo entre interrupções do relógio, se não for escolhido outro
 #define INTERVALO_INTERRUPCAO 50   // em instruções executadas
+// quantum do escalonador, se não for escolhido outro
+#define QUANTUM 10                 // em interrupções do relógio
+
+// o que o SO sabe de cada CPU (com o SO, é o argumento de CHAMAC)
+typedef struct {
+  so_t *so;
+  cpu_t *cpu;
+  int id;
+  // processo executando na CPU (NULL se ela está parada)
+  processo *corrente;
+} so_cpu_t;
 
 struct so_t {
   cpu_t *cpu;
@@ -42,23 +59,63 @@ struct so_t {
   // t1: tabela de processos, processo corrente, pendências, etc
   tabela_processos_t tabela_processos;
   processo *processo_corrente;
-  tabela_processos_t fila_processos_prontos;
+  // escalonador: as operações da política escolhida e o estado dela, que
+  //   guarda os processos prontos (n_prontos no total), e o quantum (ver
+  //   escalonador.h e so_escalona)
+  escalonador_ops_t *esc_ops;
+  void *esc;
+  int n_prontos;
+  int quantum;
+  // processos bloqueados por E/S, numa fila de espera por terminal para a
+  //   entrada e outra para a saída, na ordem em que bloquearam (os que
+  //   esperam o fim de um processo estão no descritor dele, em esperam_fim)
+  fila_processos_t espera_entrada[N_TERMINAIS];
+  fila_processos_t espera_saida[N_TERMINAIS];
 
   bool *dispositivos_disponiveis;
+
+  // as CPUs (a primeira é 'cpu'); durante o tratamento de uma interrupção,
+  //   cpu_atual é a CPU que foi interrompida, e processo_corrente e area
+  //   (o endereço da área de salvamento) são os dela
+  // com mais de uma CPU, só uma de cada vez executa o SO (trava do núcleo)
+  so_cpu_t cpus[MAX_CPUS];
+  int n_cpus;
+  int cpu_atual;
+  int area;
+  pthread_mutex_t trava;
+  // tratamento direto das interrupções (ver so_define_tratamento_direto);
+  //   durante o atendimento de uma interrupção tratada assim, 'estado' é o
+  //   estado salvo da CPU interrompida (NULL se ele está na memória)
+  bool tratamento_direto;
+  cpu_estado_t *estado;
+  // carrega o código nativo dos programas (ver so_define_codigo_nativo)
+  bool codigo_nativo;
+
+  // programa executado pelo primeiro processo
+  char *programa_inicial;
+  // intervalo entre interrupções do relógio (em instruções executadas)
+  int intervalo_interrupcao;
+  // estatísticas
+  long n_interrupcoes;
+  bool mede_tempo;
+  double tempo_tratando;
 };
 
-// função de tratamento de interrupção (entrada no SO)
+// funções de tratamento de interrupção (entrada no SO)
 static int so_trata_interrupcao(void *argC, int reg_A);
+static int so_trata_interrupcao_direta(void *arg, irq_t irq, cpu_estado_t *estado);
 
 // funções auxiliares
 // carrega o programa contido no arquivo na memória do processador; retorna end. inicial
 static int so_carrega_programa(so_t *self, char *nome_do_executavel);
+static void so_carrega_codigo_nativo(so_t *self, char *nome_do_executavel);
 // copia para str da memória do processador, até copiar um 0 (retorna true) ou tam bytes
 static bool copia_str_da_mem(int tam, char str[tam], mem_t *mem, int ender);
 
 // CRIAÇÃO {{{1
 
-so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console)
+so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console,
+              char *programa_inicial)
 {
   so_t *self = malloc(sizeof(*self));
   if (self == NULL) return NULL;
@@ -68,19 +125,39 @@ so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console)
   self->es = es;
   self->console = console;
   self->erro_interno = false;
-
+  self->programa_inicial = programa_inicial;
+  self->intervalo_interrupcao = INTERVALO_INTERRUPCAO;
+  self->n_interrupcoes = 0;
+  self->mede_tempo = false;
+  self->tempo_tratando = 0;
+  self->cpus[0] = (so_cpu_t){ self, cpu, 0, NULL };
+  self->n_cpus = 1;
+  self->cpu_atual = 0;
+  self->area = irq_area(0);
+  pthread_mutex_init(&self->trava, NULL);
+  self->tratamento_direto = false;
+  self->estado = NULL;
+  self->codigo_nativo = false;
 
   // Tabela de Processos
-  console_printf("SO_CHECK: Inicializa Tabela Processos");
+  log_depura(LOG_SO, "SO_CHECK: Inicializa Tabela Processos");
   inicializa_tabela_processos(&self->tabela_processos);
   self->processo_corrente = NULL;
-  inicializa_tabela_processos(&self->fila_processos_prontos);
+  self->esc_ops = &escalonador_rr;
+  self->quantum = QUANTUM;
+  self->esc = self->esc_ops->cria(self->quantum);
+  self->n_prontos = 0;
+  for (int t = 0; t < N_TERMINAIS; t++) {
+    inicializa_fila_processos(&self->espera_entrada[t]);
+    inicializa_fila_processos(&self->espera_saida[t]);
+  }
 
   self->dispositivos_disponiveis = malloc(4 * sizeof(bool));
 
   // quando a CPU executar uma instrução CHAMAC, deve chamar a função
-  //   so_trata_interrupcao, com primeiro argumento um ptr para o SO
-  cpu_define_chamaC(self->cpu, so_trata_interrupcao, self);
+  //   so_trata_interrupcao, com primeiro argumento um ptr para a descrição
+  //   da CPU no SO
+  cpu_define_chamaC(self->cpu, so_trata_interrupcao, &self->cpus[0]);
 
   // coloca o tratador de interrupção na memória
   // quando a CPU aceita uma interrupção, passa para modo supervisor, 
@@ -92,13 +169,13 @@ so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console)
   //   foi definido acima)
   int ender = so_carrega_programa(self, "trata_int.maq");
   if (ender != IRQ_END_TRATADOR) {
-    console_printf("SO: problema na carga do programa de tratamento de interrupção");
+    log_erro(LOG_SO, "SO: problema na carga do programa de tratamento de interrupção");
     self->erro_interno = true;
   }
 
-  // programa o relógio para gerar uma interrupção após INTERVALO_INTERRUPCAO
-  if (es_escreve(self->es, D_RELOGIO_TIMER, INTERVALO_INTERRUPCAO) != ERR_OK) {
-    console_printf("SO: problema na programação do timer");
+  // programa o relógio para gerar uma interrupção após o intervalo
+  if (es_escreve(self->es, D_RELOGIO_TIMER, self->intervalo_interrupcao) != ERR_OK) {
+    log_erro(LOG_SO, "SO: problema na programação do timer");
     self->erro_interno = true;
   }
 
@@ -107,10 +184,149 @@ so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console)
 
 void so_destroi(so_t *self)
 {
-  cpu_define_chamaC(self->cpu, NULL, NULL);
+  for (int i = 0; i < self->n_cpus; i++) {
+    cpu_define_chamaC(self->cpus[i].cpu, NULL, NULL);
+    cpu_define_tratador(self->cpus[i].cpu, NULL, NULL);
+  }
+  pthread_mutex_destroy(&self->trava);
+  self->esc_ops->destroi(self->esc);
+  destroi_tabela_processos(&self->tabela_processos);
+  free(self->dispositivos_disponiveis);
   free(self);
 }
 
+void so_define_intervalo_interrupcao(so_t *self, int intervalo)
+{
+  self->intervalo_interrupcao = intervalo;
+  for (int i = 0; i < self->n_cpus; i++) {
+    if (es_escreve(self->es, D_TIMER(i), intervalo) != ERR_OK) {
+      log_erro(LOG_SO, "SO: problema na programação do timer");
+      self->erro_interno = true;
+    }
+  }
+}
+
+// troca o estado do escalonador, por um da política 'ops' com o quantum do SO
+static void so_recria_escalonador(so_t *self, escalonador_ops_t *ops)
+{
+  // os processos prontos estão no escalonador anterior
+  assert(self->n_prontos == 0);
+  self->esc_ops->destroi(self->esc);
+  self->esc_ops = ops;
+  self->esc = ops->cria(self->quantum);
+}
+
+void so_define_quantum(so_t *self, int quantum)
+{
+  self->quantum = quantum;
+  so_recria_escalonador(self, self->esc_ops);
+}
+
+void so_define_escalonador(so_t *self, so_escalonador_t escalonador)
+{
+  switch (escalonador) {
+    case SO_ESCALONADOR_RR:
+      so_recria_escalonador(self, &escalonador_rr);
+      break;
+    case SO_ESCALONADOR_MLFQ:
+      so_recria_escalonador(self, &escalonador_mlfq);
+      break;
+    case SO_ESCALONADOR_CFS:
+      so_recria_escalonador(self, &escalonador_cfs);
+      break;
+  }
+}
+
+int so_adiciona_cpu(so_t *self, cpu_t *cpu)
+{
+  assert(self->n_cpus < MAX_CPUS);
+  int id = self->n_cpus++;
+  self->cpus[id] = (so_cpu_t){ self, cpu, id, NULL };
+  cpu_define_chamaC(cpu, so_trata_interrupcao, &self->cpus[id]);
+  if (self->tratamento_direto) {
+    cpu_define_tratador(cpu, so_trata_interrupcao_direta, &self->cpus[id]);
+  }
+  // o código nativo acessa a memória sem ser de forma atômica, só serve
+  //   com uma CPU
+  cpu_define_jit(self->cpu, false, false);
+  if (es_escreve(self->es, D_TIMER(id), self->intervalo_interrupcao) != ERR_OK) {
+    log_erro(LOG_SO, "SO: problema na programação do timer");
+    self->erro_interno = true;
+  }
+  return id;
+}
+
+void so_define_tratamento_direto(so_t *self, bool ativo)
+{
+  self->tratamento_direto = ativo;
+  for (int i = 0; i < self->n_cpus; i++) {
+    if (ativo) {
+      cpu_define_tratador(self->cpus[i].cpu, so_trata_interrupcao_direta,
+                          &self->cpus[i]);
+    } else {
+      cpu_define_tratador(self->cpus[i].cpu, NULL, NULL);
+    }
+  }
+}
+
+void so_define_codigo_nativo(so_t *self, bool ativo)
+{
+  self->codigo_nativo = ativo;
+}
+
+// ESTATÍSTICAS {{{1
+
+void so_mede_tempo(so_t *self, bool ativo)
+{
+  self->mede_tempo = ativo;
+}
+
+long so_interrupcoes(so_t *self)
+{
+  return self->n_interrupcoes;
+}
+
+double so_tempo_tratando(so_t *self)
+{
+  return self->tempo_tratando;
+}
+
+static double agora_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// ESCALONADOR {{{1
+
+// o escalonador é chamado pelas funções abaixo, que mantêm o número de
+//   processos prontos; um processo está no escalonador se e só se está pronto
+
+// coloca o processo (pronto) no escalonador
+static void so_insere_pronto(so_t *self, processo *p)
+{
+  self->esc_ops->insere(self->esc, p);
+  self->n_prontos++;
+}
+
+// tira o processo do escalonador, se estiver pronto
+static void so_remove_pronto(so_t *self, processo *p)
+{
+  if (getEstado(p) != PROCESSO_PRONTO) return;
+  self->esc_ops->remove(self->esc, p);
+  self->n_prontos--;
+}
+
+// retira do escalonador e retorna o próximo processo a executar (NULL se não
+//   tem pronto)
+static processo *so_retira_pronto(so_t *self)
+{
+  processo *p = self->esc_ops->escolhe(self->esc);
+  if (p != NULL) self->n_prontos--;
+  return p;
+}
 
 // Funncoes Processo
 // So cria processo e adiciona na tabela de processos
@@ -119,40 +335,54 @@ static processo *so_cria_processo(so_t *self, char *arquivo)
 
   int PC = so_carrega_programa(self, arquivo);
 
-  processo *p = processo_cria((self->tabela_processos.id)+1, PC);
+  processo *p = processo_cria(&self->tabela_processos,
+                              (self->tabela_processos.id)+1, PC);
   adiciona_processo(&self->tabela_processos, p);
-  adiciona_processo(&self->fila_processos_prontos, p);
+  // o processo é criado pronto, entra no fim da fila
+  so_insere_pronto(self, p);
 
   return p;
 }
-int so_pega_terminal(processo *p, proc_term_t TERMINAL)
+// o número do terminal usado pelo processo (de 0 a N_TERMINAIS-1)
+static int so_terminal_do_processo(processo *p)
 {
-  int pid = getPID(p)-1;
+  return (getPID(p) - 1) % N_TERMINAIS;
+}
 
-  int numero_terminal = ((pid%4)*4);
+int so_pega_terminal(processo *p, proc_term_t TERMINAL)
+{
+  int numero_terminal = so_terminal_do_processo(p) * 4;
 
   return numero_terminal+TERMINAL;
   
 }
 
-void so_bloqueia_processo(so_t *self, tipo_bloqueio_t TIPO_BLOQUEIO, int pid_prioridade)
+// bloqueia o processo corrente, que fica na fila de espera 'espera' até ser
+//   desbloqueado
+static void so_bloqueia_processo(so_t *self, tipo_bloqueio_t TIPO_BLOQUEIO,
+                                 int pid_prioridade, fila_processos_t *espera)
 {
 
   processo_bloqueia(self->processo_corrente, TIPO_BLOQUEIO, pid_prioridade);
   //self->processo_corrente->tipo_bloqueio=TIPO_BLOQUEIO;
   //tomar cuidado
-  console_printf("Bloqueia proc: %d de processo: %d, Tipo bloqueio: %d", self->processo_corrente->pid, self->processo_corrente->pid_prioridade, self->processo_corrente->tipo_bloqueio);
+  log_depura(LOG_SO, "Bloqueia proc: %d de processo: %d, Tipo bloqueio: %d", self->processo_corrente->pid, self->processo_corrente->pid_prioridade, self->processo_corrente->tipo_bloqueio);
+  self->esc_ops->bloqueia(self->esc, self->processo_corrente, TIPO_BLOQUEIO);
+  fila_insere_processo(espera, self->processo_corrente);
   self->processo_corrente = NULL;
 }
 
 static void so_desbloqueia_processo(so_t *self, processo *p)
 {
-  console_printf("Desbloqueia proc %d de processo: %d, Tipo bloqueio: %d", p->pid, p->pid_prioridade, p->tipo_bloqueio);
+  log_depura(LOG_SO, "Desbloqueia proc %d de processo: %d, Tipo bloqueio: %d", p->pid, p->pid_prioridade, p->tipo_bloqueio);
 
 
+  if (getEstado(p) != PROCESSO_BLOQUEADO) return;
+  fila_remove_processo(p->fila, p);
   processo_desbloqueia(p);
-  adiciona_processo(&self->fila_processos_prontos, p);
   //p->tipo_bloqueio=NULO;
+  self->esc_ops->acorda(self->esc, p);
+  so_insere_pronto(self, p);
 }
 
 
@@ -166,6 +396,9 @@ static void so_trata_irq(so_t *self, int irq);
 static void so_trata_pendencias(so_t *self);
 static void so_escalona(so_t *self);
 static int so_despacha(so_t *self);
+static void so_entra(so_t *self, so_cpu_t *cpu);
+static void so_sai(so_t *self, so_cpu_t *cpu);
+static int so_atende(so_cpu_t *cpu, irq_t irq, cpu_estado_t *estado);
 
 // função a ser chamada pela CPU quando executa a instrução CHAMAC, no tratador de
 //   interrupção em assembly
@@ -174,8 +407,8 @@ static int so_despacha(so_t *self);
 //   a instrução CHAMAC
 // a instrução CHAMAC só deve ser executada pelo tratador de interrupção
 //
-// o primeiro argumento é um ponteiro para o SO, o segundo é a identificação
-//   da interrupção
+// o primeiro argumento é um ponteiro para a descrição da CPU interrompida
+//   (so_cpu_t), o segundo é a identificação da interrupção
 // o valor retornado por esta função é colocado no registrador A, e pode ser
 //   testado pelo código que está após o CHAMAC. No tratador de interrupção em
 //   assembly esse valor é usado para decidir se a CPU deve retornar da interrupção
@@ -183,16 +416,35 @@ static int so_despacha(so_t *self);
 //   outra interrupção
 static int so_trata_interrupcao(void *argC, int reg_A)
 {
-  so_t *self = argC;
-  irq_t irq = reg_A;
+  return so_atende(argC, reg_A, NULL);
+}
+
+// função chamada pela CPU no tratamento direto, no lugar da execução do
+//   tratador em assembly; o estado da CPU interrompida está em 'estado' e não
+//   na área de salvamento, o resto é igual a so_trata_interrupcao
+static int so_trata_interrupcao_direta(void *arg, irq_t irq, cpu_estado_t *estado)
+{
+  return so_atende(arg, irq, estado);
+}
+
+// atende a interrupção 'irq' da CPU 'cpu', com o estado salvo da CPU em
+//   'estado' ou, se NULL, na área de salvamento da memória
+static int so_atende(so_cpu_t *cpu, irq_t irq, cpu_estado_t *estado)
+{
+  so_t *self = cpu->so;
+  so_entra(self, cpu);
+  processo *anterior = self->processo_corrente;
+  self->estado = estado;
+  double inicio = self->mede_tempo ? agora_s() : 0;
+  self->n_interrupcoes++;
   // esse print polui bastante, recomendo tirar quando estiver com mais confiança
-  console_printf("SO: recebi IRQ %d (%s)", irq, irq_nome(irq));
+  log_depura(LOG_SO, "SO: recebi IRQ %d (%s)", irq, irq_nome(irq));
 
   // salva o estado da cpu no descritor do processo que foi interrompido
-  so_salva_estado_da_cpu(self); // Processo corrente aqui é nulo
+  so_salva_estado_da_cpu(self);
   if(self->processo_corrente==NULL)
   {
-    console_printf("Processo Corrente Inexistente 1");
+    log_depura(LOG_SO, "SO: CPU %d sem processo corrente", self->cpu_atual);
   }
 
   // faz o atendimento da interrupção
@@ -201,15 +453,105 @@ static int so_trata_interrupcao(void *argC, int reg_A)
   so_trata_pendencias(self);
   // escolhe o próximo processo a executar
   so_escalona(self);
+  // o processo que estava na CPU e terminou não vai mais ser usado
+  if (anterior != NULL && anterior != self->processo_corrente
+      && getEstado(anterior) == TERMINADO) {
+    libera_processo(&self->tabela_processos, anterior);
+  }
   // recupera o estado do processo escolhido
-  return so_despacha(self);
+  int ret = so_despacha(self);
+  if (self->mede_tempo) self->tempo_tratando += agora_s() - inicio;
+  self->estado = NULL;
+  so_sai(self, cpu);
+  return ret;
+}
+
+// entra no SO pela CPU 'cpu': o SO passa a ver o processo corrente e a área
+//   de salvamento dessa CPU
+static void so_entra(so_t *self, so_cpu_t *cpu)
+{
+  if (self->n_cpus > 1) pthread_mutex_lock(&self->trava);
+  self->cpu_atual = cpu->id;
+  self->area = irq_area(cpu->id);
+  self->processo_corrente = cpu->corrente;
+}
+
+// com mais de uma CPU, pede interrupção para as outras CPUs que têm o que
+//   fazer: as que estão paradas, se tem processo pronto, e as que estão
+//   executando um processo que não pode mais executar (que foi morto)
+static void so_acorda_cpus(so_t *self)
+{
+  int n_prontos = self->n_prontos;
+  for (int i = 0; i < self->n_cpus; i++) {
+    if (i == self->cpu_atual) continue;
+    processo *p = self->cpus[i].corrente;
+    bool acorda;
+    if (p == NULL) {
+      acorda = n_prontos > 0;
+      if (acorda) n_prontos--;
+    } else {
+      acorda = getEstado(p) != PROCESSO_EXECUTANDO;
+    }
+    if (acorda && es_escreve(self->es, D_IPI, i) != ERR_OK) {
+      log_erro(LOG_SO, "SO: problema no pedido de interrupção para a CPU %d", i);
+      self->erro_interno = true;
+    }
+  }
+}
+
+// sai do SO pela CPU 'cpu', guardando o processo que ela vai executar
+static void so_sai(so_t *self, so_cpu_t *cpu)
+{
+  cpu->corrente = self->processo_corrente;
+  if (self->n_cpus > 1) {
+    so_acorda_cpus(self);
+    pthread_mutex_unlock(&self->trava);
+  }
+}
+
+// retorna o endereço do campo 'campo' (um dos IRQ_END_*) do estado salvo
+static int *so_campo_salvo(cpu_estado_t *estado, int campo)
+{
+  switch (campo) {
+    case IRQ_END_PC:          return &estado->PC;
+    case IRQ_END_A:           return &estado->A;
+    case IRQ_END_X:           return &estado->X;
+    case IRQ_END_erro:        return &estado->erro;
+    case IRQ_END_complemento: return &estado->complemento;
+    case IRQ_END_modo:        return &estado->modo;
+  }
+  assert(false);
+  return NULL;
+}
+
+// lê o campo 'campo' (um dos IRQ_END_*) do estado salvo da CPU interrompida,
+//   na área de salvamento ou no estado do tratamento direto
+static err_t so_le_salvo(so_t *self, int campo, int *pvalor)
+{
+  if (self->estado == NULL) {
+    return mem_le(self->mem, self->area + campo, pvalor);
+  }
+  *pvalor = *so_campo_salvo(self->estado, campo);
+  return ERR_OK;
+}
+
+// altera o campo 'campo' do estado salvo, que a CPU vai recuperar no retorno
+//   da interrupção
+static err_t so_escreve_salvo(so_t *self, int campo, int valor)
+{
+  if (self->estado == NULL) {
+    return mem_escreve(self->mem, self->area + campo, valor);
+  }
+  *so_campo_salvo(self->estado, campo) = valor;
+  return ERR_OK;
 }
 
 static void so_salva_estado_da_cpu(so_t *self)
 {
   // t1: salva os registradores que compõem o estado da cpu no descritor do
   //   processo corrente. os valores dos registradores foram colocados pela
-  //   CPU na memória, nos endereços IRQ_END_*
+  //   CPU na memória, nos endereços IRQ_END_* da área de salvamento (ou no
+  //   estado do tratamento direto, ver so_le_salvo)
   // se não houver processo corrente, não faz nada
 
   processo *p = self->processo_corrente;
@@ -219,12 +561,11 @@ static void so_salva_estado_da_cpu(so_t *self)
   }
   else{
     int PC, A, X, complemento;
-    mem_le(self->mem, IRQ_END_PC, &PC);
-    mem_le(self->mem, IRQ_END_A, &A);
-    mem_le(self->mem, IRQ_END_X, &X);
-    mem_le(self->mem, IRQ_END_complemento, &complemento);
+    so_le_salvo(self, IRQ_END_PC, &PC);
+    so_le_salvo(self, IRQ_END_A, &A);
+    so_le_salvo(self, IRQ_END_X, &X);
+    so_le_salvo(self, IRQ_END_complemento, &complemento);
     processo_salva_estado_cpu(p, PC, A, X, complemento);
-    console_printf("Não passou por aqui 1");
   }
   
 
@@ -239,65 +580,82 @@ static void so_salva_estado_da_cpu(so_t *self)
 
 
 
-static void so_trata_pendencia_entrada(so_t *self, processo *p)
+// faz a leitura pendente do processo, se o teclado tiver um dado, e
+//   desbloqueia o processo; retorna true se conseguiu
+static bool so_trata_pendencia_entrada(so_t *self, processo *p)
 {
   int estado;
   if (es_le(self->es, so_pega_terminal(p, PROC_TERM_TECLADO_OK), &estado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao estado do teclado");
+    log_erro(LOG_SO, "SO: problema no acesso ao estado do teclado");
     self->erro_interno = true;
-    return;
+    return false;
   }
   if (estado == 0)
   {
-    return;
+    return false;
   } 
   int dado;
   if (es_le(self->es, so_pega_terminal(p, PROC_TERM_TECLADO), &dado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao teclado");
+    log_erro(LOG_SO, "SO: problema no acesso ao teclado");
     self->erro_interno = true;
-    return;
+    return false;
   }
   setA(p, dado);
   so_desbloqueia_processo(self, p);
+  return true;
 }
 
 
-static void so_trata_pendencia_saida(so_t *self, processo *p)
+// faz a escrita pendente do processo, se a tela estiver livre, e desbloqueia
+//   o processo; retorna true se conseguiu
+static bool so_trata_pendencia_saida(so_t *self, processo *p)
 {
   int estado;
   /////////////////////////console_printf("PID processo_atual: %d", self->processo_corrente->pid);
   if (es_le(self->es, so_pega_terminal(p, PROC_TERM_TELA_OK), &estado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao estado da tela");
+    log_erro(LOG_SO, "SO: problema no acesso ao estado da tela");
     self->erro_interno = true;
-    return;
+    return false;
   }
   if (estado == 0)
   {
-    return;
+    return false;
   }
   int dado;
   dado = getX(p);
   if (es_escreve(self->es, so_pega_terminal(p, PROC_TERM_TELA), dado) != ERR_OK) {
-    console_printf("SO: problema no acesso à tela");
+    log_erro(LOG_SO, "SO: problema no acesso à tela");
     self->erro_interno = true;
-    return;
+    return false;
   }
   setA(p, 0);
   so_desbloqueia_processo(self, p);
+  return true;
 }
 
 
-static void so_trata_pendencia_processo(so_t *self, processo *p)
+// libera o descritor do processo que terminou, se nenhuma CPU está executando
+//   ele; senão, ele é liberado quando a CPU trocar de processo (ver
+//   so_atende)
+// os processos que esperavam o fim dele já foram desbloqueados, então ninguém
+//   mais precisa do descritor
+static void so_libera_processo(so_t *self, processo *p)
 {
-  int pid = getPidPrioridade(p);
-
-  processo *processo_prioridade = busca_processo(&self->tabela_processos, pid);
-
-  if (getEstado(processo_prioridade)==TERMINADO || processo_prioridade==NULL)
-  {
-    so_desbloqueia_processo(self, p);
-    console_printf("Desbloqueia processo %d", p->pid);
+  if (p == self->processo_corrente) return;
+  for (int i = 0; i < self->n_cpus; i++) {
+    if (self->cpus[i].corrente == p) return;
+  }
+  libera_processo(&self->tabela_processos, p);
+}
 
+// desbloqueia os processos que esperam o fim do processo 'p' (que morreu)
+static void so_trata_fim_processo(so_t *self, processo *p)
+{
+  processo *esperando;
+  while ((esperando = p->esperam_fim.primeiro) != NULL) {
+    setA(esperando, 0);
+    so_desbloqueia_processo(self, esperando);
+    log_depura(LOG_SO, "Desbloqueia processo %d", esperando->pid);
   }
 }
 
@@ -314,7 +672,7 @@ static void so_trata_pendencia_processo(so_t *self, processo *p)
   {
     int estado;
     if (es_le(self->es, dispositivo_ok, &estado) != ERR_OK) {
-      console_printf("SO: problema no acesso ao estado do teclado");
+      log_erro(LOG_SO, "SO: problema no acesso ao estado do teclado");
       self->erro_interno = true;
       return;
     }
@@ -326,7 +684,7 @@ static void so_trata_pendencia_processo(so_t *self, processo *p)
 
   int dado;
   if (es_le(self->es, dispositivo, &dado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao teclado");
+    log_erro(LOG_SO, "SO: problema no acesso ao teclado");
     self->erro_interno = true;
     return;
   }
@@ -344,7 +702,7 @@ static void so_trata_pendencia_processo(so_t *self, processo *p)
   {
     int estado;
     if (es_le(self->es, dispositivo_ok, &estado) != ERR_OK) {
-      console_printf("SO: problema no acesso ao estado da tela");
+      log_erro(LOG_SO, "SO: problema no acesso ao estado da tela");
       self->erro_interno = true;
       return;
     }
@@ -357,7 +715,7 @@ static void so_trata_pendencia_processo(so_t *self, processo *p)
   int dado;
   dado = getX(p);
   if (es_escreve(self->es, dispositivo, dado) != ERR_OK) {
-    console_printf("SO: problema no acesso à tela");
+    log_erro(LOG_SO, "SO: problema no acesso à tela");
     self->erro_interno = true;
     return;
   }
@@ -413,31 +771,20 @@ static void so_trata_pendencias(so_t *self)
   // - E/S pendente
   // - desbloqueio de processos
   // - contabilidades
-  tabela_processos_t *tabela = &self->tabela_processos;
-  if (tabela == NULL || tabela->primeiro == NULL) {
-        return;
+  // só olha as filas de espera dos terminais que têm processo: para cada
+  //   uma, atende os processos na ordem da fila enquanto o dispositivo
+  //   estiver pronto; o custo depende do número de terminais e de processos
+  //   desbloqueados, não do número de processos bloqueados
+  // os que esperam o fim de um processo são desbloqueados quando ele morre
+  //   (ver so_trata_fim_processo)
+  for (int t = 0; t < N_TERMINAIS; t++) {
+    processo *p;
+    while ((p = self->espera_entrada[t].primeiro) != NULL
+           && so_trata_pendencia_entrada(self, p)) {
+    }
+    while ((p = self->espera_saida[t].primeiro) != NULL
+           && so_trata_pendencia_saida(self, p)) {
     }
-
-  processo *atual = tabela->primeiro;
-
-  // Percorre a lista para procurar o processo
-  while (atual != NULL) {
-      if (atual->estado == PROCESSO_BLOQUEADO) {
-          tipo_bloqueio_t bloqueio = getTipoBloqueio(atual);
-          if (bloqueio==ESPERANDO_ENTRADA)
-          {
-            so_trata_pendencia_entrada(self, atual);
-          }
-          if (bloqueio==ESPERANDO_SAIDA)
-          {
-            so_trata_pendencia_saida(self, atual);
-          }
-          if (bloqueio==ESPERANDO_PROCESSO)
-          {
-            so_trata_pendencia_processo(self, atual);
-          }
-      }
-      atual = atual->proximo_processo;
   }
 
   /* if (self->fila_processos_prontos.primeiro==NULL && self->processo_corrente==NULL)
@@ -448,78 +795,41 @@ static void so_trata_pendencias(so_t *self)
 
 
 
-/* static void so_escalona_quantum(so_t *self)
+// mostra o estado de cada processo da tabela (só se as mensagens de
+//   depuração estão sendo mostradas, porque percorre a tabela toda)
+static void so_mostra_processos(so_t *self)
 {
-  // escolhe o próximo processo a executar, que passa a ser o processo
-  //   corrente; pode continuar sendo o mesmo de antes ou não
-  // t1: na primeira versão, escolhe um processo caso o processo corrente não possa continuar
-  //   executando. depois, implementar escalonador melhor
-  processo *p = self->processo_corrente;
-  //processo *aux = self->tabela_processos.primeiro;
-  if(p!=NULL && getQuantum(p)==0)
-  {
-    adiciona_processo(&self->fila_processos_prontos, p);
-    setEstado(p, PROCESSO_PRONTO);
-    p=NULL;
+  if (!log_ativo(LOG_DEPURA, LOG_SO)) return;
+  log_depura(LOG_SO, "-----------------------");
+  for (processo *p = self->tabela_processos.primeiro; p != NULL;
+       p = p->proximo_processo) {
+    log_depura(LOG_SO, "PID: %d - Estado: %d", p->pid, p->estado);
   }
-
-
-  if (p == NULL || getEstado(p) != PROCESSO_EXECUTANDO) {
-      if (self->fila_processos_prontos.primeiro!=NULL)
-      {
-        p = self->fila_processos_prontos.primeiro;
-        remove_primeiro_fila(&self->fila_processos_prontos);
-        self->processo_corrente = p;
-        setQuantum(p, 10);
-        setEstado(p, PROCESSO_EXECUTANDO);
-        return;
-      }
-      
-
-      // Se nenhum processo estiver pronto, define processo_corrente como NULL
-      self->processo_corrente = NULL; 
-    }
-  
-
-} */
-
+}
 
 static void so_escalona(so_t *self)
 {
   // escolhe o próximo processo a executar, que passa a ser o processo
   //   corrente; pode continuar sendo o mesmo de antes ou não
-  // t1: na primeira versão, escolhe um processo caso o processo corrente não possa continuar
-  //   executando. depois, implementar escalonador melhor
+  // o processo corrente continua enquanto o escalonador não mandar trocar
+  //   (em geral, quando acaba o quantum, ver so_trata_irq_relogio); quando
+  //   manda, ele volta para o escalonador, que escolhe o próximo (que pode
+  //   ser ele de novo, se não tiver outro), e define o quantum dele
   processo *p = self->processo_corrente;
-  processo *aux = self->tabela_processos.primeiro;
-
-  processo *aux2 = self->tabela_processos.primeiro;
-
-  // imprime o estado de cada processo na tabela
 
-  console_printf("-----------------------");
+  so_mostra_processos(self);
 
-  while (aux2 != NULL)
-  {
-    console_printf("PID: %d - Estado: %d", aux2->pid, aux2->estado);
-    aux2 = aux2->proximo_processo;
-  }
-
-  if (p == NULL || getEstado(p) != PROCESSO_EXECUTANDO) {
-        while (aux != NULL) {
-            if (aux->estado == PROCESSO_PRONTO) {
-                self->processo_corrente = aux; // Atualiza o processo corrente
-                setEstado(self->processo_corrente, PROCESSO_EXECUTANDO);
-                return;
-            }
-            aux = aux->proximo_processo; // Avança na lista de processos
-        }
-
-        // Se nenhum processo estiver pronto, define processo_corrente como NULL
-        self->processo_corrente = NULL; 
-    }
-  
+  if (p != NULL && getEstado(p) == PROCESSO_EXECUTANDO) {
+    if (!self->esc_ops->deve_trocar(self->esc, p)) return;
+    log_depura(LOG_SO, "SO: processo %d sai da CPU", getPID(p));
+    setEstado(p, PROCESSO_PRONTO);
+    so_insere_pronto(self, p);
+  }
 
+  p = so_retira_pronto(self);
+  // se nenhum processo estiver pronto, processo_corrente fica NULL
+  self->processo_corrente = p;
+  if (p != NULL) setEstado(p, PROCESSO_EXECUTANDO);
 }
 
 static int so_despacha(so_t *self)
@@ -540,12 +850,12 @@ static int so_despacha(so_t *self)
       int X = getX(p);
       int complemento = getComplemento(p);
       //nao chegou nesse print
-      console_printf("PC: %d - A: %d - X: %d - complemento: %d", PC, A, X, complemento);
+      log_depura(LOG_SO, "PC: %d - A: %d - X: %d - complemento: %d", PC, A, X, complemento);
 
-      mem_escreve(self->mem, IRQ_END_PC, PC);
-      mem_escreve(self->mem, IRQ_END_A, A);
-      mem_escreve(self->mem, IRQ_END_X, X);
-      mem_escreve(self->mem, IRQ_END_complemento, complemento);
+      so_escreve_salvo(self, IRQ_END_PC, PC);
+      so_escreve_salvo(self, IRQ_END_A, A);
+      so_escreve_salvo(self, IRQ_END_X, X);
+      so_escreve_salvo(self, IRQ_END_complemento, complemento);
       assert(getEstado(p)==PROCESSO_EXECUTANDO);
     }
     
@@ -581,6 +891,10 @@ static void so_trata_irq(so_t *self, int irq)
     case IRQ_RELOGIO:
       so_trata_irq_relogio(self);
       break;
+    case IRQ_IPI:
+      // outra CPU pediu para esta escalonar de novo
+      log_depura(LOG_SO, "SO: CPU %d acordada por outra CPU", self->cpu_atual);
+      break;
     default:
       so_trata_irq_desconhecida(self, irq);
   }
@@ -589,6 +903,9 @@ static void so_trata_irq(so_t *self, int irq)
 // interrupção gerada uma única vez, quando a CPU inicializa
 static void so_trata_irq_reset(so_t *self)
 {
+  // as outras CPUs começam paradas, esperando processo para executar
+  if (self->cpu_atual != 0) return;
+
   // t1: deveria criar um processo para o init, e inicializar o estado do
   //   processador para esse processo com os registradores zerados, exceto
   //   o PC e o modo.
@@ -604,21 +921,21 @@ static void so_trata_irq_reset(so_t *self)
   processo *p = processo_cria((self->tabela_processos.id)+1, PC);
   adiciona_processo(&self->tabela_processos, p); */
 
-  processo *p = so_cria_processo(self, "init.maq");
+  processo *p = so_cria_processo(self, self->programa_inicial);
   self->processo_corrente = p;
-  console_printf("so_trata_irq_reset: PID: %d - PC: %d - A: %d - X: %d - complemento: %d", getPID(p), getPC(p), getA(p), getX(p), getComplemento(p));
+  log_depura(LOG_SO, "so_trata_irq_reset: PID: %d - PC: %d - A: %d - X: %d - complemento: %d", getPID(p), getPC(p), getA(p), getX(p), getComplemento(p));
 
   int ender = getPC(p);
   if (ender != 100) {
-    console_printf("SO: problema na carga do programa inicial");
+    log_erro(LOG_SO, "SO: problema na carga do programa inicial");
     self->erro_interno = true;
     return;
   }
 
   // altera o PC para o endereço de carga
-  mem_escreve(self->mem, IRQ_END_PC, ender);
+  so_escreve_salvo(self, IRQ_END_PC, ender);
   // passa o processador para modo usuário
-  mem_escreve(self->mem, IRQ_END_modo, usuario);
+  so_escreve_salvo(self, IRQ_END_modo, usuario);
 }
 
 // interrupção gerada quando a CPU identifica um erro
@@ -632,39 +949,47 @@ static void so_trata_irq_err_cpu(so_t *self)
   // t1: com suporte a processos, deveria pegar o valor do registrador erro
   //   no descritor do processo corrente, e reagir de acordo com esse erro
   //   (em geral, matando o processo)
-  mem_le(self->mem, IRQ_END_erro, &err_int);
+  so_le_salvo(self, IRQ_END_erro, &err_int);
   err_t err = err_int;
-  console_printf("SO: IRQ não tratada -- erro na CPU: %s", err_nome(err));
+  log_erro(LOG_SO, "SO: IRQ não tratada -- erro na CPU: %s", err_nome(err));
   self->erro_interno = true;
 }
 
+// retorna true se algum processo ainda não terminou
+static bool so_tem_processo_vivo(so_t *self)
+{
+  return self->tabela_processos.n_vivos > 0;
+}
+
 // interrupção gerada quando o timer expira
 static void so_trata_irq_relogio(so_t *self)
 {
   // rearma o interruptor do relógio e reinicializa o timer para a próxima interrupção
-  err_t e1, e2;
-  e1 = es_escreve(self->es, D_RELOGIO_INTERRUPCAO, 0); // desliga o sinalizador de interrupção
-  e2 = es_escreve(self->es, D_RELOGIO_TIMER, INTERVALO_INTERRUPCAO);
+  // se não tem mais nenhum processo vivo, o timer não é reprogramado: a CPU
+  //   fica parada, e a máquina desliga
+  err_t e1, e2 = ERR_OK;
+  int cpu = self->cpu_atual;
+  e1 = es_escreve(self->es, D_TIMER_INTERRUPCAO(cpu), 0); // desliga o sinalizador de interrupção
+  if (so_tem_processo_vivo(self)) {
+    e2 = es_escreve(self->es, D_TIMER(cpu), self->intervalo_interrupcao);
+  } else {
+    log_info(LOG_SO, "SO: nenhum processo vivo, o timer não será reprogramado");
+  }
   if (e1 != ERR_OK || e2 != ERR_OK) {
-    console_printf("SO: problema da reinicialização do timer");
+    log_erro(LOG_SO, "SO: problema da reinicialização do timer");
     self->erro_interno = true;
   }
-  // t1: deveria tratar a interrupção
-  //   por exemplo, decrementa o quantum do processo corrente, quando se tem
-  //   um escalonador com quantum
-  processo *p = self->processo_corrente;
-  if (p!=NULL)
-  {
-    setQuantum(p, (getQuantum(p)-1));
-  }
+  // o escalonador conta o tempo do processo corrente (gasta uma unidade do
+  //   quantum dele, por exemplo), e decide se troca de processo
+  self->esc_ops->tique(self->esc, self->processo_corrente);
 
-  console_printf("SO: interrupção do relógio (não tratada)");
+  log_depura(LOG_SO, "SO: interrupção do relógio");
 }
 
 // foi gerada uma interrupção para a qual o SO não está preparado
 static void so_trata_irq_desconhecida(so_t *self, int irq)
 {
-  console_printf("SO: não sei tratar IRQ %d (%s)", irq, irq_nome(irq));
+  log_erro(LOG_SO, "SO: não sei tratar IRQ %d (%s)", irq, irq_nome(irq));
   self->erro_interno = true;
 }
 
@@ -676,18 +1001,19 @@ static void so_chamada_escr(so_t *self);
 static void so_chamada_cria_proc(so_t *self);
 static void so_chamada_mata_proc(so_t *self);
 static void so_chamada_espera_proc(so_t *self);
+static void so_chamada_define_peso(so_t *self);
 
 static void so_trata_irq_chamada_sistema(so_t *self)
 {
   // a identificação da chamada está no registrador A
   // t1: com processos, o reg A tá no descritor do processo corrente
   int id_chamada;
-  if (mem_le(self->mem, IRQ_END_A, &id_chamada) != ERR_OK) {
-    console_printf("SO: erro no acesso ao id da chamada de sistema");
+  if (so_le_salvo(self, IRQ_END_A, &id_chamada) != ERR_OK) {
+    log_erro(LOG_SO, "SO: erro no acesso ao id da chamada de sistema");
     self->erro_interno = true;
     return;
   }
-  console_printf("SO: chamada de sistema %d", id_chamada);
+  log_depura(LOG_SO, "SO: chamada de sistema %d", id_chamada);
   switch (id_chamada) {
     case SO_LE:
       so_chamada_le(self);
@@ -705,9 +1031,12 @@ static void so_trata_irq_chamada_sistema(so_t *self)
       
       so_chamada_espera_proc(self);
       
+      break;
+    case SO_DEFINE_PESO:
+      so_chamada_define_peso(self);
       break;
     default:
-      console_printf("SO: chamada de sistema desconhecida (%d)", id_chamada);
+      log_erro(LOG_SO, "SO: chamada de sistema desconhecida (%d)", id_chamada);
       // t1: deveria matar o processo
       self->erro_interno = true;
   }
@@ -745,13 +1074,14 @@ static void so_chamada_le(so_t *self)
   //   T1: deveria usar dispositivo de entrada corrente do processo
   int estado;
   if (es_le(self->es, so_pega_terminal(self->processo_corrente, PROC_TERM_TECLADO_OK), &estado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao estado do teclado");
+    log_erro(LOG_SO, "SO: problema no acesso ao estado do teclado");
     self->erro_interno = true;
     return;
   }
   if (estado == 0)
   {
-    so_bloqueia_processo(self, ESPERANDO_ENTRADA, -1);
+    so_bloqueia_processo(self, ESPERANDO_ENTRADA, -1,
+        &self->espera_entrada[so_terminal_do_processo(self->processo_corrente)]);
     return;
   }    // como não está saindo do SO, a unidade de controle não está executando seu laço.
   // esta gambiarra faz pelo menos a console ser atualizada
@@ -760,7 +1090,7 @@ static void so_chamada_le(so_t *self)
 
   int dado;
   if (es_le(self->es, so_pega_terminal(self->processo_corrente, PROC_TERM_TECLADO), &dado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao teclado");
+    log_erro(LOG_SO, "SO: problema no acesso ao teclado");
     self->erro_interno = true;
     return;
   }
@@ -784,13 +1114,14 @@ static void so_chamada_escr(so_t *self)
   int estado;
   /////////////////////////console_printf("PID processo_atual: %d", self->processo_corrente->pid);
   if (es_le(self->es, so_pega_terminal(self->processo_corrente, PROC_TERM_TELA_OK), &estado) != ERR_OK) {
-    console_printf("SO: problema no acesso ao estado da tela");
+    log_erro(LOG_SO, "SO: problema no acesso ao estado da tela");
     self->erro_interno = true;
     return;
   }
   if (estado == 0)
   {
-    so_bloqueia_processo(self, ESPERANDO_SAIDA, -1);
+    so_bloqueia_processo(self, ESPERANDO_SAIDA, -1,
+        &self->espera_saida[so_terminal_do_processo(self->processo_corrente)]);
     return;
   }
   // como não está saindo do SO, a unidade de controle não está executando seu laço.
@@ -803,9 +1134,9 @@ static void so_chamada_escr(so_t *self)
   // T1: deveria usar os registradores do processo que está realizando a E/S
   // T1: caso o processo tenha sido bloqueado, esse acesso deve ser realizado em outra execução
   //   do SO, quando ele verificar que esse acesso já pode ser feito.
-  mem_le(self->mem, IRQ_END_X, &dado);
+  so_le_salvo(self, IRQ_END_X, &dado);
   if (es_escreve(self->es, so_pega_terminal(self->processo_corrente, PROC_TERM_TELA), dado) != ERR_OK) {
-    console_printf("SO: problema no acesso à tela");
+    log_erro(LOG_SO, "SO: problema no acesso à tela");
     self->erro_interno = true;
     return;
   }
@@ -846,11 +1177,6 @@ static void so_chamada_cria_proc(so_t *self)
 // mata o processo com pid X (ou o processo corrente se X é 0)
 static void so_chamada_mata_proc(so_t *self)
 {
-  // T1: deveria matar um processo
-  // ainda sem suporte a processos, retorna erro -1
-  console_printf("SO: SO_MATA_PROC não implementada");
-  
-
   processo *p_corrente = self->processo_corrente;
 
   if (p_corrente != NULL) {
@@ -864,16 +1190,24 @@ static void so_chamada_mata_proc(so_t *self)
      p_eliminar = busca_processo(&self->tabela_processos,  pid);
     }
 
-    if (p_eliminar!=NULL)
+    if (p_eliminar!=NULL && getEstado(p_eliminar) != TERMINADO)
     {
       //mem_escreve(self->mem, IRQ_END_A, 0);
       setA(p_eliminar, 0);
-      setEstado(p_eliminar, TERMINADO);
+      // se estava pronto, não pode mais ser escolhido; se estava bloqueado,
+      //   sai da fila de espera
+      so_remove_pronto(self, p_eliminar);
+      if (getEstado(p_eliminar) == PROCESSO_BLOQUEADO) {
+        fila_remove_processo(p_eliminar->fila, p_eliminar);
+      }
+      processo_termina(&self->tabela_processos, p_eliminar);
+      so_trata_fim_processo(self, p_eliminar);
+      so_libera_processo(self, p_eliminar);
     }
     else{
       //mem_escreve(self->mem, IRQ_END_A, -1);
-      setA(p_eliminar, -1);
-      console_printf("SO: nao encontrado PID corresponde ao processo a ser eliminado");
+      setA(p_corrente, -1);
+      log_aviso(LOG_SO, "SO: nao encontrado PID corresponde ao processo a ser eliminado");
     }
     
   }
@@ -895,9 +1229,18 @@ static void so_chamada_espera_proc(so_t *self)
   
   
 
+  // um pid já usado que não está na tabela é de um processo que terminou e
+  //   foi liberado
+  if (processo_esperado == NULL && pid > 0 && pid != pid_atual
+      && pid <= self->tabela_processos.id)
+  {
+    setA(self->processo_corrente, 0);
+    return;
+  }
+
   if(processo_esperado == NULL || pid == pid_atual)
   {
-    console_printf("Caiu no NULL %d", pid);
+    log_aviso(LOG_SO, "Caiu no NULL %d", pid);
     setA(self->processo_corrente, -1);
     return;
   }
@@ -907,11 +1250,31 @@ static void so_chamada_espera_proc(so_t *self)
     setA(self->processo_corrente, 0);
   }
   else{
-    so_bloqueia_processo(self, ESPERANDO_PROCESSO, pid);
+    so_bloqueia_processo(self, ESPERANDO_PROCESSO, pid,
+                         &processo_esperado->esperam_fim);
   }
   
 }
 
+// implementação da chamada se sistema SO_DEFINE_PESO
+// muda o peso do processo corrente para X
+static void so_chamada_define_peso(so_t *self)
+{
+  processo *p = self->processo_corrente;
+  int peso = getX(p);
+  if (peso < PESO_MIN || peso > PESO_MAX) {
+    log_aviso(LOG_SO, "SO: peso %d inválido para o processo %d", peso,
+              getPID(p));
+    setA(p, -1);
+    return;
+  }
+  // o processo corrente não está no escalonador, o peso vale a partir do
+  //   próximo tique
+  log_depura(LOG_SO, "SO: processo %d com peso %d", getPID(p), peso);
+  setPeso(p, peso);
+  setA(p, 0);
+}
+
 // CARGA DE PROGRAMA {{{1
 
 // carrega o programa na memória
@@ -921,7 +1284,7 @@ static int so_carrega_programa(so_t *self, char *nome_do_executavel)
   // programa para executar na nossa CPU
   programa_t *prog = prog_cria(nome_do_executavel);
   if (prog == NULL) {
-    console_printf("Erro na leitura do programa '%s'\n", nome_do_executavel);
+    log_erro(LOG_SO, "Erro na leitura do programa '%s'\n", nome_do_executavel);
     return -1;
   }
 
@@ -930,16 +1293,38 @@ static int so_carrega_programa(so_t *self, char *nome_do_executavel)
 
   for (int end = end_ini; end < end_fim; end++) {
     if (mem_escreve(self->mem, end, prog_dado(prog, end)) != ERR_OK) {
-      console_printf("Erro na carga da memória, endereco %d\n", end);
+      log_erro(LOG_SO, "Erro na carga da memória, endereco %d\n", end);
       return -1;
     }
   }
 
   prog_destroi(prog);
-  console_printf("SO: carga de '%s' em %d-%d", nome_do_executavel, end_ini, end_fim);
+  log_info(LOG_SO, "SO: carga de '%s' em %d-%d", nome_do_executavel, end_ini, end_fim);
+  so_carrega_codigo_nativo(self, nome_do_executavel);
   return end_ini;
 }
 
+// se existir o programa traduzido para código nativo (pelo tradutor, em um
+//   arquivo com o mesmo nome e extensão '.so'), pede para a CPU usar
+static void so_carrega_codigo_nativo(so_t *self, char *nome_do_executavel)
+{
+  if (!self->codigo_nativo) return;
+  char nome[100];
+  char *ext = strrchr(nome_do_executavel, '.');
+  int tam_base = ext == NULL ? strlen(nome_do_executavel) : ext - nome_do_executavel;
+  // sem '/', o dlopen procuraria nos diretórios de bibliotecas do sistema
+  char *dir = strchr(nome_do_executavel, '/') == NULL ? "./" : "";
+  if (snprintf(nome, sizeof(nome), "%s%.*s.so", dir, tam_base, nome_do_executavel)
+      >= sizeof(nome)) {
+    return;
+  }
+  // com mais de uma CPU, só o interpretador (ver so_adiciona_cpu)
+  if (self->n_cpus > 1) return;
+  if (cpu_carrega_nativo(self->cpu, nome)) {
+    log_info(LOG_SO, "SO: código nativo de '%s' em %s", nome_do_executavel, nome);
+  }
+}
+
 // ACESSO À MEMÓRIA DOS PROCESSOS {{{1
 
 // copia uma string da memória do simulador para o vetor str.
@@ -13,9 +13,72 @@ typedef struct so_t so_t;
 #include "es.h"
 #include "console.h" // só para uma gambiarra
 
-so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console);
+// cria o SO; o primeiro processo executa o programa no arquivo
+//   'programa_inicial' (que deve ser carregado no endereço 100)
+so_t *so_cria(cpu_t *cpu, mem_t *mem, es_t *es, console_t *console,
+              char *programa_inicial);
 void so_destroi(so_t *self);
 
+// altera o intervalo entre as interrupções do relógio (em instruções; o
+//   padrão é 50), reprogramando o timer; para ser chamada antes de começar
+//   a execução
+void so_define_intervalo_interrupcao(so_t *self, int intervalo);
+
+// altera o quantum do escalonador, em interrupções do relógio (o padrão é
+//   10): no round-robin, o processo que executa por esse tempo sem bloquear
+//   vai para o fim da fila de prontos; para ser chamada antes de começar a
+//   execução
+void so_define_quantum(so_t *self, int quantum);
+
+// os escalonadores de processos
+//   SO_ESCALONADOR_RR: round-robin, com uma fila de prontos
+//   SO_ESCALONADOR_MLFQ: filas multinível com realimentação; o processo novo
+//     começa no nível mais prioritário, desce um nível (com quantum maior)
+//     quando usa todo o quantum, sobe um quando bloqueia por E/S, e todos
+//     voltam para o nível mais prioritário de tempos em tempos
+//   SO_ESCALONADOR_CFS: justo; executa o processo pronto que executou menos
+//     tempo (ponderado pelo peso do processo), depois que o corrente executou
+//     pelo menos um quantum
+// (as políticas estão em escalonador_*.c, ver escalonador.h)
+typedef enum {
+  SO_ESCALONADOR_RR,
+  SO_ESCALONADOR_MLFQ,
+  SO_ESCALONADOR_CFS
+} so_escalonador_t;
+
+// escolhe o escalonador (o padrão é SO_ESCALONADOR_RR); para ser chamada
+//   antes de começar a execução
+void so_define_escalonador(so_t *self, so_escalonador_t escalonador);
+
+// acrescenta mais uma CPU (que compartilha a memória e a E/S da primeira)
+//   para o SO usar; retorna o número dela (a primeira, de so_cria, é a 0)
+// cada CPU tem o seu processo corrente e o seu timer; o SO é executado por
+//   uma CPU de cada vez (trava do núcleo), e pede interrupção (D_IPI) para
+//   as CPUs paradas quando tem processo pronto para executar
+// com mais de uma CPU, não é usado código nativo (só o interpretador)
+// para ser chamada antes de começar a execução
+int so_adiciona_cpu(so_t *self, cpu_t *cpu);
+
+// liga ou desliga o tratamento direto das interrupções (ver
+//   cpu_define_tratador) em todas as CPUs: o SO é chamado pela CPU sem a
+//   execução do tratador em assembly, e acessa o estado salvo da CPU sem
+//   passar pela memória
+void so_define_tratamento_direto(so_t *self, bool ativo);
+
+// liga ou desliga o uso do código nativo gerado antes pelo tradutor: na carga
+//   de um programa 'x.maq', o SO carrega 'x.so', se existir (ver
+//   cpu_carrega_nativo); o padrão é desligado, porque a biblioteca é
+//   executada pelo simulador (o nome vem do programa que cria o processo)
+void so_define_codigo_nativo(so_t *self, bool ativo);
+
+// liga a medição do tempo (real) gasto no tratamento de interrupções
+void so_mede_tempo(so_t *self, bool ativo);
+// retorna o número de interrupções tratadas pelo SO
+long so_interrupcoes(so_t *self);
+// retorna o tempo gasto no tratamento de interrupções enquanto a medição
+//   estava ligada, em segundos
+double so_tempo_tratando(so_t *self);
+
 // Chamadas de sistema
 // Uma chamada de sistema é realizada colocando a identificação da
 //   chamada (um dos valores abaixo) no registrador A e executando a
@@ -75,4 +138,12 @@ void so_destroi(so_t *self);
 // retorna sem bloquear, com erro, se não existir processo com esse pid
 #define SO_ESPERA_PROC 9
 
+// define o peso do processo chamador no escalonador justo (cfs): um processo
+//   com o dobro do peso de outro recebe o dobro do tempo de CPU
+// recebe em X o peso, entre PESO_MIN e PESO_MAX (ver processo.h); o peso
+//   inicial é PESO_NORMAL
+// retorna em A: 0 se OK ou um código de erro negativo (peso inválido)
+// os outros escalonadores não usam o peso
+#define SO_DEFINE_PESO 10
+
 #endif // SO_H
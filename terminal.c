@@ -5,6 +5,7 @@
 
 #include "terminal.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -30,32 +31,52 @@ struct terminal_t {
   //   entra nesse estado quando recebe um '\n'.
   //   não aceita novos caracteres
   enum { normal, rolando, limpando } estado_saida;
-  // posicao do caractere que está sendo movido durante uma rolagem
-  int pos_rolagem;
+  // a rolagem e a limpeza terminam com um evento, agendado para quando
+  //   todos os caracteres tiverem sido movidos; o que aparece na tela
+  //   antes disso é calculado a partir do tempo que já passou
+  eventos_t *eventos;
+  // o evento de fim da rolagem ou limpeza (-1 se não está agendado)
+  int evento_saida;
+  // quando começou a rolagem ou limpeza
+  int inicio_saida;
+  // a saída como aparece na tela durante a rolagem ou limpeza
+  char *vista;
+  // arquivo onde é copiado cada caractere escrito na saída (ou NULL)
+  FILE *copia;
+  // true se a entrada ou a saída mudou desde a última chamada a
+  //   terminal_alterado
+  bool alterado;
 };
 
 
-terminal_t *terminal_cria(int tam_linha)
+terminal_t *terminal_cria(int tam_linha, eventos_t *eventos)
 {
   terminal_t *self = malloc(sizeof(*self));
   assert(self != NULL);
 
   self->saida = malloc(tam_linha + 1);
   self->entrada = malloc(tam_linha + 1);
-  assert(self->saida != NULL && self->entrada != NULL);
+  self->vista = malloc(tam_linha + 2);
+  assert(self->saida != NULL && self->entrada != NULL && self->vista != NULL);
 
   self->tam_linha = tam_linha;
   strcpy(self->entrada, "");
   strcpy(self->saida, "");
   self->estado_saida = normal;
+  self->eventos = eventos;
+  self->evento_saida = -1;
+  self->copia = NULL;
+  self->alterado = true;
 
   return self;
 }
 
 void terminal_destroi(terminal_t *self)
 {
+  eventos_cancela(self->eventos, self->evento_saida);
   free(self->entrada);
   free(self->saida);
+  free(self->vista);
   free(self);
 }
 
@@ -70,6 +91,7 @@ static char terminal_le_char(terminal_t *self)
   char ch = p[0];
   if (ch != '\0') {
     memmove(&p[0], &p[1], strlen(p));
+    self->alterado = true;
   }
   return ch;
 }
@@ -82,6 +104,7 @@ void terminal_insere_char(terminal_t *self, char ch)
   if (tam >= self->tam_linha-2) return;
   p[tam] = ch;
   p[tam+1] = '\0';
+  self->alterado = true;
 }
 
 static bool terminal_pode_imprimir(terminal_t *self)
@@ -89,11 +112,42 @@ static bool terminal_pode_imprimir(terminal_t *self)
   return self->estado_saida == normal;
 }
 
+// evento de fim da rolagem ou da limpeza
+static void terminal_termina_saida(void *arg, int dado)
+{
+  terminal_t *self = arg;
+  self->evento_saida = -1;
+  if (self->estado_saida == rolando) {
+    // o primeiro caractere saiu, os outros andaram uma posição
+    char *p = self->saida;
+    memmove(p, p+1, strlen(p));
+  } else {
+    self->saida[0] = '\0';
+  }
+  self->estado_saida = normal;
+  self->alterado = true;
+}
+
+// começa a rolagem ou a limpeza da saída, movendo um caractere por unidade
+//   de tempo (uma linha vazia leva uma unidade para limpar)
+static void terminal_inicia_saida(terminal_t *self, int estado)
+{
+  self->estado_saida = estado;
+  self->inicio_saida = eventos_agora(self->eventos);
+  int duracao = strlen(self->saida);
+  if (duracao == 0) duracao = 1;
+  self->evento_saida = eventos_agenda(self->eventos,
+                                      self->inicio_saida + duracao,
+                                      terminal_termina_saida, self, 0);
+}
+
 static void terminal_imprime(terminal_t *self, char ch)
 {
   if (terminal_pode_imprimir(self)) {
+    if (self->copia != NULL) fputc(ch, self->copia);
+    self->alterado = true;
     if (ch == '\n') {
-      self->estado_saida = limpando;
+      terminal_inicia_saida(self, limpando);
       return;
     }
     int tam = strlen(self->saida);
@@ -101,56 +155,42 @@ static void terminal_imprime(terminal_t *self, char ch)
     tam++;
     self->saida[tam] = '\0';
     if (tam >= self->tam_linha - 1) {
-      self->estado_saida = rolando;
-      self->pos_rolagem = 0;
+      terminal_inicia_saida(self, rolando);
     }
   }
 }
 
 void terminal_limpa_saida(terminal_t *self)
 {
+  eventos_cancela(self->eventos, self->evento_saida);
+  self->evento_saida = -1;
   self->saida[0] = '\0';
   self->estado_saida = normal;
+  self->alterado = true;
 }
 
-static void terminal_atualiza_rolagem(terminal_t *self)
+// evento de chegada de um caractere na entrada
+static void terminal_chega_char(void *arg, int dado)
 {
-  // remove o caractere na posição de rolagem e avança
-  // se chegou no final da string, terminou a rolagem
-  char *p = self->saida;
-  p[self->pos_rolagem] = p[self->pos_rolagem + 1];
-  if (p[self->pos_rolagem] != '\0') {
-    self->pos_rolagem++;
-    p[self->pos_rolagem] = ' ';
-  } else {
-    self->estado_saida = normal;
-  }
+  terminal_insere_char(arg, dado);
 }
 
-static void terminal_atualiza_limpeza(terminal_t *self)
+void terminal_agenda_char(terminal_t *self, int quando, char ch)
 {
-  // remove um caractere do início da string; volta ao estado normal se era o último
-  char *p = self->saida;
-  int tam = strlen(p);
-  memmove(p, p+1, tam);
-  if (tam <= 1) {
-    self->estado_saida = normal;
-  }
+  eventos_agenda(self->eventos, quando, terminal_chega_char, self, ch);
 }
 
-// altera a string de saída em 1 caractere, se estiver rolando ou limpando
-void terminal_tictac(terminal_t *self)
+void terminal_define_copia(terminal_t *self, FILE *arq)
 {
-  switch (self->estado_saida) {
-    case normal: 
-      break;
-    case rolando:
-      terminal_atualiza_rolagem(self);
-      break;
-    case limpando:
-      terminal_atualiza_limpeza(self);
-      break;
-  }
+  self->copia = arq;
+}
+
+bool terminal_alterado(terminal_t *self)
+{
+  // rolando ou limpando, a saída que aparece muda com o tempo
+  bool alterado = self->alterado || self->estado_saida != normal;
+  self->alterado = false;
+  return alterado;
 }
 
 char *terminal_txt_entrada(terminal_t *self)
@@ -160,7 +200,17 @@ char *terminal_txt_entrada(terminal_t *self)
 
 char *terminal_txt_saida(terminal_t *self)
 {
-  return self->saida;
+  if (self->estado_saida == normal) return self->saida;
+  int passou = eventos_agora(self->eventos) - self->inicio_saida;
+  if (passou == 0) return self->saida;
+  if (self->estado_saida == limpando) return self->saida + passou;
+  // na rolagem, o caractere na posição 'passou' está sendo movido para a
+  //   esquerda: os anteriores já andaram, e ele deixa um espaço no lugar
+  char *v = self->vista;
+  strncpy(v, self->saida + 1, passou);
+  v[passou] = ' ';
+  strcpy(v + passou + 1, self->saida + passou + 1);
+  return v;
 }
 
 // Operações de leitura e escrita no terminal, chamadas pelo controlador de E/S
@@ -24,20 +24,24 @@
 //   adicional causa a "rolagem", que remove o primeiro caractere da linha para
 //   gerar espaço para o novo. a impressão de um \n causa a "limpeza" da linha.
 // a escrita não é possível se a saída estiver rolando ou sendo limpa, o que é
-//   feito um caractere por vez (a cada chamada a tictac).
+//   feito um caractere por unidade de tempo; o fim da rolagem ou da limpeza é
+//   um evento na fila de eventos.
 //
 // a E/S efetiva é realizada pela console. ela obtém acesso às linhas de entrada e
 //   saída chamando terminal_txt_entrada ou terminal_txt_saida. a console insere
 //   caracteres digitados no terminal chamando terminal_insere_char, e limpa a
 //   linha de saída com terminal_limpa_saida.
 
+#include <stdio.h>
 #include <stdbool.h>
 #include "es.h"
+#include "eventos.h"
 
 typedef struct terminal_t terminal_t;
 
-// aloca e inicializa um novo terminal
-terminal_t *terminal_cria(int tam_linha);
+// aloca e inicializa um novo terminal, que usa a fila de eventos para
+//   saber a hora e agendar o fim da rolagem ou limpeza da saída
+terminal_t *terminal_cria(int tam_linha, eventos_t *eventos);
 // libera a memória ocupada por um terminal
 void terminal_destroi(terminal_t *self);
 
@@ -47,15 +51,24 @@ char *terminal_txt_entrada(terminal_t *self);
 // retorna a linha de saida do terminal (para uso pela console)
 char *terminal_txt_saida(terminal_t *self);
 
+// retorna true se as linhas de entrada ou saída podem ter mudado desde a
+//   última chamada (para a console só redesenhar o que mudou)
+bool terminal_alterado(terminal_t *self);
+
 // insere um novo caractere na entrada do terminal
 // (para uso pela console, para simular um caractere digitado no teclado)
 void terminal_insere_char(terminal_t *self, char ch);
 
+// agenda a chegada de um caractere na entrada do terminal para a hora
+//   'quando' (como terminal_insere_char, mas no tempo simulado)
+void terminal_agenda_char(terminal_t *self, int quando, char ch);
+
 // limpa a linha de saída (para uso pela console)
 void terminal_limpa_saida(terminal_t *self);
 
-// esta função deve ser chamada periodicamente
-void terminal_tictac(terminal_t *self);
+// define um arquivo onde copiar cada caractere escrito na saída (NULL para
+//   não copiar); a console fecha o arquivo
+void terminal_define_copia(terminal_t *self, FILE *arq);
 
 // Funções para implementar o protocolo de acesso a um dispositivo pelo
 //   controlador de E/S
@@ -0,0 +1,341 @@
+// tradutor.c
+// tradutor de código maq para C, para execução nativa
+// simulador de computador
+// so24b
+
+// O tradutor lê um programa em linguagem de máquina (.maq) e gera um arquivo
+//   C com uma função para cada bloco básico do programa. Esse arquivo é
+//   compilado em uma biblioteca dinâmica (.so), que o simulador carrega
+//   quando o programa é colocado na memória (ver jit.h).
+// Os blocos são encontrados seguindo o fluxo de execução a partir do início
+//   do programa, para não traduzir dados como se fossem instruções.
+// O código gerado para cada instrução tem a mesma semântica da CPU; as
+//   instruções que ele não sabe executar terminam o bloco antes delas, e
+//   ficam para o interpretador. Um bloco também sai antes de uma instrução que
+//   causaria erro ou que escreveria em memória observada.
+
+// INCLUDES {{{1
+#include "instrucao.h"
+#include "programa.h"
+#include "jit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+// AUXILIARES {{{1
+// aborta o programa com uma mensagem de erro
+void erro_brabo(char *msg)
+{
+  fprintf(stderr, "ERRO FATAL: %s\n", msg);
+  exit(1);
+}
+
+// PROGRAMA {{{1
+
+char *nome_maq;        // nome do arquivo a traduzir
+programa_t *prog;      // o programa
+int carga;             // endereço de carga do programa
+int tam;               // número de palavras do programa
+
+// retorna em *pval o valor no endereço, se ele pertence ao programa
+bool pega_dado(int end, int *pval)
+{
+  if (end < carga || end >= carga + tam) return false;
+  *pval = prog_dado(prog, end);
+  return true;
+}
+
+// BLOCOS {{{1
+
+// endereços já traduzidos como início de bloco
+bool *inicio_traduzido;
+// endereços que devem ser traduzidos como início de bloco
+int *pendentes;
+int n_pendentes;
+// blocos traduzidos (início, fim e número de instruções), na ordem em que
+//   foram gerados
+typedef struct {
+  int inicio;
+  int fim;
+  int n_instr;
+} bloco_t;
+bloco_t *blocos;
+int n_blocos;
+
+// coloca um endereço na lista de inícios de bloco a traduzir
+void marca_inicio(int end)
+{
+  if (end < carga || end >= carga + tam) return;
+  if (inicio_traduzido[end - carga]) return;
+  inicio_traduzido[end - carga] = true;
+  pendentes[n_pendentes++] = end;
+}
+
+// verifica se o opcode é de uma instrução que o código gerado sabe executar
+//   (as sem privilégio que não causam interrupção)
+bool traduzivel(int opcode)
+{
+  return opcode >= NOP && opcode <= RET && opcode != PARA;
+}
+
+// verifica se a instrução usa A1 como endereço de memória fixo
+bool acessa_endereco_fixo(int opcode)
+{
+  switch (opcode) {
+    case CARGM: case ARMM: case SOMA: case SUB: case MULT: case DIV:
+    case RESTO: case CHAMA: case RET:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// GERAÇÃO DE CÓDIGO {{{1
+
+// gera o código de uma instrução que não termina o bloco
+// 'pc' é o endereço da instrução, 'n' o número de instruções antes dela
+void gera_instrucao(int opcode, int A1, int pc, int n)
+{
+  printf("  // %d: %s", pc, instrucao_nome(opcode));
+  if (instrucao_num_args(opcode) > 0) printf(" %d", A1);
+  printf("\n");
+  switch (opcode) {
+    case NOP:
+      break;
+    case CARGI:
+      printf("  A = %d;\n", A1);
+      break;
+    case CARGM:
+      printf("  A = m[%d];\n", A1);
+      break;
+    case CARGX:
+      printf("  e = (unsigned)X + (unsigned)(%d);\n", A1);
+      printf("  if (e >= (unsigned)r->tam) SAI(%d, %d);\n", pc, n);
+      printf("  A = m[e];\n");
+      break;
+    case ARMM:
+      printf("  if (o[%d]) SAI(%d, %d);\n", A1, pc, n);
+      printf("  m[%d] = A;\n", A1);
+      break;
+    case ARMX:
+      printf("  e = (unsigned)X + (unsigned)(%d);\n", A1);
+      printf("  if (e >= (unsigned)r->tam || o[e]) SAI(%d, %d);\n", pc, n);
+      printf("  m[e] = A;\n");
+      break;
+    case TRAX:
+      printf("  t = A; A = X; X = t;\n");
+      break;
+    case CPXA:
+      printf("  A = X;\n");
+      break;
+    case INCX:
+      printf("  X = (int)((unsigned)X + 1u);\n");
+      break;
+    case SOMA:
+      printf("  A = (int)((unsigned)A + (unsigned)m[%d]);\n", A1);
+      break;
+    case SUB:
+      printf("  A = (int)((unsigned)A - (unsigned)m[%d]);\n", A1);
+      break;
+    case MULT:
+      printf("  A = (int)((unsigned)A * (unsigned)m[%d]);\n", A1);
+      break;
+    case DIV:
+    case RESTO:
+      printf("  if (m[%d] == 0 || (m[%d] == -1 && A == INT_MIN)) SAI(%d, %d);\n",
+             A1, A1, pc, n);
+      printf("  A %s= m[%d];\n", opcode == DIV ? "/" : "%", A1);
+      break;
+    case NEG:
+      printf("  A = (int)(0u - (unsigned)A);\n");
+      break;
+  }
+}
+
+// gera o código da instrução que termina o bloco (desvio, chamada ou
+//   retorno), que coloca o novo PC nos registradores
+void gera_desvio(int opcode, int A1, int pc, int n)
+{
+  printf("  // %d: %s %d\n", pc, instrucao_nome(opcode), A1);
+  char *cond = NULL;
+  switch (opcode) {
+    case DESV:   printf("  r->PC = %d;\n", A1); break;
+    case DESVZ:  cond = "A == 0"; break;
+    case DESVNZ: cond = "A != 0"; break;
+    case DESVN:  cond = "A < 0";  break;
+    case DESVP:  cond = "A > 0";  break;
+    case CHAMA:
+      printf("  if (o[%d]) SAI(%d, %d);\n", A1, pc, n);
+      printf("  m[%d] = %d;\n", A1, pc + 2);
+      printf("  r->PC = %d;\n", A1 + 1);
+      break;
+    case RET:
+      printf("  r->PC = m[%d];\n", A1);
+      break;
+  }
+  if (cond != NULL) {
+    printf("  r->PC = %s ? %d : %d;\n", cond, A1, pc + 2);
+  }
+}
+
+// traduz o bloco que começa em 'inicio', e marca os blocos que podem
+//   executar depois dele
+void traduz_bloco(int inicio)
+{
+  // primeiro descobre até onde vai o bloco, e o maior endereço fixo acessado
+  int pc = inicio;
+  int n = 0;
+  int maior_end = 0;
+  bool desviou = false;
+  while (n < JIT_MAX_INSTR) {
+    int opcode, A1 = 0;
+    if (!pega_dado(pc, &opcode)) break;
+    if (!traduzivel(opcode)) {
+      // depois de uma chamada de sistema, a execução continua na seguinte
+      if (opcode == CHAMAS) marca_inicio(pc + 1);
+      break;
+    }
+    int tam_instr = 1 + instrucao_num_args(opcode);
+    if (tam_instr > 1 && !pega_dado(pc + 1, &A1)) break;
+    if (acessa_endereco_fixo(opcode)) {
+      // endereço inválido fica para o interpretador, para causar o erro
+      if (A1 < 0) break;
+      if (A1 > maior_end) maior_end = A1;
+    }
+    pc += tam_instr;
+    n++;
+    if (opcode >= DESV) {
+      desviou = true;
+      if (opcode != RET) marca_inicio(opcode == CHAMA ? A1 + 1 : A1);
+      if (opcode != DESV) marca_inicio(pc);
+      break;
+    }
+  }
+  if (n == 0) return;
+  // um bloco que não terminou com desvio continua no seguinte
+  if (!desviou) marca_inicio(pc);
+  int fim = pc;
+
+  // agora gera o código
+  printf("\n// bloco %d-%d (%d instruções)\n", inicio, fim - 1, n);
+  printf("static void b%d(jit_regs_t *r)\n{\n", inicio);
+  printf("  int A = r->A, X = r->X, t;\n");
+  printf("  int *m = r->mem;\n");
+  printf("  unsigned char *o = r->observado;\n");
+  printf("  unsigned e;\n");
+  printf("  (void)t; (void)m; (void)o; (void)e;\n");
+  printf("  if (r->tam <= %d) SAI(%d, 0);\n", maior_end, inicio);
+  pc = inicio;
+  for (int i = 0; i < n; i++) {
+    // as instruções do bloco já foram lidas na primeira passada
+    int opcode = 0, A1 = 0;
+    bool ok = pega_dado(pc, &opcode);
+    if (ok && instrucao_num_args(opcode) > 0) ok = pega_dado(pc + 1, &A1);
+    assert(ok);
+    (void)ok;
+    if (opcode >= DESV) {
+      gera_desvio(opcode, A1, pc, i);
+    } else {
+      gera_instrucao(opcode, A1, pc, i);
+    }
+    pc += 1 + instrucao_num_args(opcode);
+  }
+  if (!desviou) printf("  r->PC = %d;\n", fim);
+  printf("  r->executadas = %d;\n", n);
+  printf("sai:\n");
+  printf("  r->A = A;\n");
+  printf("  r->X = X;\n");
+  printf("}\n");
+
+  blocos[n_blocos++] = (bloco_t){ inicio, fim, n };
+}
+
+// gera o início do arquivo, com a imagem do programa
+void gera_cabecalho(void)
+{
+  printf("// gerado pelo tradutor a partir de '%s' -- não altere\n", nome_maq);
+  printf("#include \"jit.h\"\n");
+  printf("#include <limits.h>\n");
+  printf("#include <stddef.h>\n\n");
+  printf("// sai do bloco antes da instrução em pc, tendo executado n\n");
+  printf("#define SAI(pc, n) do { r->PC = (pc); r->executadas = (n); goto sai; }"
+         " while (0)\n\n");
+  printf("static const int imagem[%d] = {", tam);
+  for (int i = 0; i < tam; i++) {
+    if (i % 10 == 0) printf("\n ");
+    printf(" %d,", prog_dado(prog, carga + i));
+  }
+  printf("\n};\n");
+}
+
+// gera o final do arquivo, com a descrição dos blocos
+void gera_descricao(void)
+{
+  printf("\n");
+  if (n_blocos > 0) {
+    printf("static const jit_bloco_aot_t blocos[%d] = {\n", n_blocos);
+    for (int i = 0; i < n_blocos; i++) {
+      bloco_t *b = &blocos[i];
+      printf("  { %d, %d, %d, b%d },\n", b->inicio, b->fim, b->n_instr, b->inicio);
+    }
+    printf("};\n\n");
+  }
+  printf("const jit_aot_t jit_aot = {\n");
+  printf("  .versao = JIT_AOT_VERSAO,\n");
+  printf("  .carga = %d,\n", carga);
+  printf("  .tam = %d,\n", tam);
+  printf("  .imagem = imagem,\n");
+  printf("  .n_blocos = %d,\n", n_blocos);
+  printf("  .blocos = %s,\n", n_blocos > 0 ? "blocos" : "NULL");
+  printf("};\n");
+}
+
+void traduz_programa(void)
+{
+  prog = prog_cria(nome_maq);
+  if (prog == NULL) erro_brabo("não foi possível ler o programa");
+  carga = prog_end_carga(prog);
+  tam = prog_tamanho(prog);
+
+  inicio_traduzido = calloc(tam, sizeof(*inicio_traduzido));
+  pendentes = malloc(tam * sizeof(*pendentes));
+  blocos = malloc(tam * sizeof(*blocos));
+  if (inicio_traduzido == NULL || pendentes == NULL || blocos == NULL) {
+    erro_brabo("falta memória");
+  }
+
+  gera_cabecalho();
+  marca_inicio(prog_end_inicio(prog));
+  while (n_pendentes > 0) {
+    traduz_bloco(pendentes[--n_pendentes]);
+  }
+  gera_descricao();
+
+  free(blocos);
+  free(pendentes);
+  free(inicio_traduzido);
+  prog_destroi(prog);
+}
+
+// MAIN {{{1
+
+void verifica_args(int argc, char *argv[argc])
+{
+  if (argc != 2) {
+    fprintf(stderr, "ERRO: chame como '%s nome_do_arquivo.maq'\n", argv[0]);
+    exit(1);
+  }
+  nome_maq = argv[1];
+}
+
+int main(int argc, char *argv[argc])
+{
+  verifica_args(argc, argv);
+  traduz_programa();
+  return 0;
+}
+
+// vim: foldmethod=marker
@@ -0,0 +1,476 @@
+// varredura.c
+// executa o simulador várias vezes, com configurações diferentes, em paralelo
+// simulador de computador
+// so24b
+
+// A matriz de configurações é lida de um arquivo, com uma linha por
+//   parâmetro: o nome do parâmetro e os valores que ele deve assumir. Ex:
+//     programa bench/cpu.maq bench/misto.maq
+//     intervalo 25 50 100
+//   define 6 execuções, uma para cada combinação dos valores (o último
+//   parâmetro varia mais rápido). Os parâmetros que não estão na matriz
+//   ficam com o valor padrão (ver maquina_config_padrao).
+// Cada execução é uma máquina independente (ver maquina.h), sem tela, com
+//   os seus arquivos num diretório próprio (dir/000, dir/001 etc). As
+//   execuções são distribuídas entre threads, uma por núcleo do computador
+//   (ou quantas forem escolhidas com -j), e as estatísticas de todas são
+//   juntadas num relatório em JSON.
+// Cada máquina executa os comandos do arquivo "comandos" (parâmetro
+//   comandos), ou, se não tiver, "L1", "C", "S", "F": só com as mensagens
+//   de erro e de aviso no log, até desligar.
+
+#include "maquina.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <assert.h>
+
+// CONSTANTES E TIPOS {{{1
+
+// número máximo de valores de um parâmetro
+#define MAX_VALORES 64
+
+// tamanho máximo de uma linha da matriz, e de um nome de arquivo
+#define TAM_LINHA 1024
+
+// os parâmetros que podem ser variados, e como cada um altera a
+//   configuração da máquina; a função retorna false se o valor for inválido
+typedef struct {
+  char *nome;
+  bool (*aplica)(maquina_config_t *cfg, char *valor);
+} parametro_t;
+
+static bool aplica_programa(maquina_config_t *cfg, char *valor);
+static bool aplica_roteiro(maquina_config_t *cfg, char *valor);
+static bool aplica_comandos(maquina_config_t *cfg, char *valor);
+static bool aplica_intervalo(maquina_config_t *cfg, char *valor);
+static bool aplica_quantum(maquina_config_t *cfg, char *valor);
+static bool aplica_escalonador(maquina_config_t *cfg, char *valor);
+static bool aplica_memoria(maquina_config_t *cfg, char *valor);
+static bool aplica_motor(maquina_config_t *cfg, char *valor);
+static bool aplica_jit(maquina_config_t *cfg, char *valor);
+static bool aplica_aot(maquina_config_t *cfg, char *valor);
+static bool aplica_cpus(maquina_config_t *cfg, char *valor);
+static bool aplica_paralelo(maquina_config_t *cfg, char *valor);
+static bool aplica_direto(maquina_config_t *cfg, char *valor);
+
+static const parametro_t parametros[] = {
+  { "programa",    aplica_programa    },  // programa inicial
+  { "roteiro",     aplica_roteiro     },  // roteiro de entrada dos terminais
+  { "comandos",    aplica_comandos    },  // arquivo de comandos do operador
+  { "intervalo",   aplica_intervalo   },  // entre interrupções do relógio
+  { "quantum",     aplica_quantum     },  // do escalonador
+  { "escalonador", aplica_escalonador },  // rr, mlfq ou cfs
+  { "memoria",     aplica_memoria     },  // tamanho da memória
+  { "motor",       aplica_motor       },  // switch ou encadeado
+  { "jit",         aplica_jit         },  // sim ou nao
+  { "aot",         aplica_aot         },  // sim ou nao (código nativo, .so)
+  { "cpus",        aplica_cpus        },  // número de CPUs
+  { "paralelo",    aplica_paralelo    },  // sim (uma thread por CPU) ou nao
+  { "direto",      aplica_direto      },  // tratamento direto das interrupções
+};
+#define N_PARAMETROS (sizeof(parametros) / sizeof(parametros[0]))
+
+// uma execução: onde ficam os seus arquivos, e o que ela mediu
+typedef struct {
+  char dir[TAM_LINHA];
+  maquina_estatisticas_t est;
+} execucao_t;
+
+typedef struct {
+  // a matriz: os valores de cada parâmetro (nenhum se não estiver na matriz)
+  int n_valores[N_PARAMETROS];
+  char *valores[N_PARAMETROS][MAX_VALORES];
+  char *dir;
+  char comandos[TAM_LINHA];   // comandos usados se a matriz não tiver
+  int n_execucoes;
+  execucao_t *execucoes;
+  // a próxima execução a ser pega por uma thread
+  atomic_int proxima;
+  atomic_int terminadas;
+} varredura_t;
+
+// PARÂMETROS {{{1
+
+static bool aplica_programa(maquina_config_t *cfg, char *valor)
+{
+  cfg->programa_inicial = valor;
+  return true;
+}
+
+static bool aplica_roteiro(maquina_config_t *cfg, char *valor)
+{
+  cfg->roteiro = valor;
+  return true;
+}
+
+static bool aplica_comandos(maquina_config_t *cfg, char *valor)
+{
+  cfg->comandos = valor;
+  return true;
+}
+
+// converte 'valor' para um inteiro positivo em '*pn'
+static bool pega_positivo(char *valor, int *pn)
+{
+  char *fim;
+  long n = strtol(valor, &fim, 10);
+  if (*fim != '\0' || n <= 0 || n > 1000000000) return false;
+  *pn = n;
+  return true;
+}
+
+static bool aplica_intervalo(maquina_config_t *cfg, char *valor)
+{
+  return pega_positivo(valor, &cfg->intervalo_interrupcao);
+}
+
+static bool aplica_quantum(maquina_config_t *cfg, char *valor)
+{
+  return pega_positivo(valor, &cfg->quantum);
+}
+
+static bool aplica_escalonador(maquina_config_t *cfg, char *valor)
+{
+  if (strcmp(valor, "rr") == 0) {
+    cfg->escalonador = SO_ESCALONADOR_RR;
+  } else if (strcmp(valor, "mlfq") == 0) {
+    cfg->escalonador = SO_ESCALONADOR_MLFQ;
+  } else if (strcmp(valor, "cfs") == 0) {
+    cfg->escalonador = SO_ESCALONADOR_CFS;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool aplica_memoria(maquina_config_t *cfg, char *valor)
+{
+  return pega_positivo(valor, &cfg->tam_memoria);
+}
+
+static bool aplica_motor(maquina_config_t *cfg, char *valor)
+{
+  if (strcmp(valor, "switch") == 0) {
+    cfg->motor = CPU_MOTOR_SWITCH;
+  } else if (strcmp(valor, "encadeado") == 0) {
+    cfg->motor = CPU_MOTOR_ENCADEADO;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// converte 'valor' ("sim" ou "nao") para um booleano em '*pb'
+static bool pega_sim_nao(char *valor, bool *pb)
+{
+  if (strcmp(valor, "sim") == 0) {
+    *pb = true;
+  } else if (strcmp(valor, "nao") == 0) {
+    *pb = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool aplica_jit(maquina_config_t *cfg, char *valor)
+{
+  return pega_sim_nao(valor, &cfg->jit);
+}
+
+static bool aplica_aot(maquina_config_t *cfg, char *valor)
+{
+  return pega_sim_nao(valor, &cfg->aot);
+}
+
+static bool aplica_cpus(maquina_config_t *cfg, char *valor)
+{
+  return pega_positivo(valor, &cfg->n_cpus) && cfg->n_cpus <= MAX_CPUS;
+}
+
+static bool aplica_paralelo(maquina_config_t *cfg, char *valor)
+{
+  return pega_sim_nao(valor, &cfg->paralelo);
+}
+
+static bool aplica_direto(maquina_config_t *cfg, char *valor)
+{
+  return pega_sim_nao(valor, &cfg->tratamento_direto);
+}
+
+// MATRIZ {{{1
+
+static int acha_parametro(char *nome)
+{
+  for (int p = 0; p < N_PARAMETROS; p++) {
+    if (strcmp(parametros[p].nome, nome) == 0) return p;
+  }
+  return -1;
+}
+
+// lê a matriz do arquivo 'nome'; retorna false (depois de informar o
+//   problema) se tiver algum erro
+static bool le_matriz(varredura_t *self, char *nome)
+{
+  FILE *arq = fopen(nome, "r");
+  if (arq == NULL) {
+    fprintf(stderr, "ERRO: não consegui abrir '%s'\n", nome);
+    return false;
+  }
+  char linha[TAM_LINHA];
+  int num_linha = 0;
+  bool ok = true;
+  while (ok && fgets(linha, sizeof(linha), arq) != NULL) {
+    num_linha++;
+    char *resto;
+    char *nome_par = strtok_r(linha, " \t\n", &resto);
+    if (nome_par == NULL || nome_par[0] == '#') continue;
+    int p = acha_parametro(nome_par);
+    if (p < 0 || self->n_valores[p] != 0) {
+      fprintf(stderr, "ERRO: %s:%d: parâmetro '%s' %s\n", nome, num_linha,
+              nome_par, p < 0 ? "desconhecido" : "repetido");
+      ok = false;
+      break;
+    }
+    char *valor;
+    while ((valor = strtok_r(NULL, " \t\n", &resto)) != NULL) {
+      maquina_config_t cfg;
+      maquina_config_padrao(&cfg);
+      if (self->n_valores[p] >= MAX_VALORES || !parametros[p].aplica(&cfg, valor)) {
+        fprintf(stderr, "ERRO: %s:%d: valor '%s' inválido\n", nome, num_linha,
+                valor);
+        ok = false;
+        break;
+      }
+      self->valores[p][self->n_valores[p]++] = strdup(valor);
+    }
+    if (ok && self->n_valores[p] == 0) {
+      fprintf(stderr, "ERRO: %s:%d: '%s' sem valores\n", nome, num_linha,
+              nome_par);
+      ok = false;
+    }
+  }
+  fclose(arq);
+  return ok;
+}
+
+// retorna o índice do valor do parâmetro 'p' na execução 'e' (os índices
+//   dos parâmetros são os dígitos do número da execução, numa base mista)
+static int indice_do_valor(varredura_t *self, int e, int p)
+{
+  for (int q = N_PARAMETROS - 1; q > p; q--) {
+    if (self->n_valores[q] > 0) e /= self->n_valores[q];
+  }
+  return e % self->n_valores[p];
+}
+
+// EXECUÇÃO {{{1
+
+static void executa(varredura_t *self, int e)
+{
+  execucao_t *ex = &self->execucoes[e];
+  maquina_config_t cfg;
+  maquina_config_padrao(&cfg);
+  cfg.comandos = self->comandos;
+  cfg.dir = ex->dir;
+  cfg.mede_tempo = true;
+  for (int p = 0; p < N_PARAMETROS; p++) {
+    if (self->n_valores[p] == 0) continue;
+    parametros[p].aplica(&cfg, self->valores[p][indice_do_valor(self, e, p)]);
+  }
+  if (mkdir(ex->dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "ERRO: não consegui criar '%s'\n", ex->dir);
+  }
+  maquina_t *maq = maquina_cria(&cfg);
+  maquina_executa(maq);
+  maquina_estatisticas(maq, &ex->est);
+  maquina_destroi(maq);
+  int terminadas = atomic_fetch_add(&self->terminadas, 1) + 1;
+  printf("[%d/%d] %s: %.3f s, %.3f MIPS\n", terminadas, self->n_execucoes,
+         ex->dir, ex->est.segundos, ex->est.instrucoes / ex->est.segundos / 1e6);
+}
+
+static void *trabalhador(void *arg)
+{
+  varredura_t *self = arg;
+  for (;;) {
+    int e = atomic_fetch_add(&self->proxima, 1);
+    if (e >= self->n_execucoes) break;
+    executa(self, e);
+  }
+  return NULL;
+}
+
+// RELATÓRIO {{{1
+
+// escreve o valor em JSON: como número se for um inteiro, senão como string
+static void escreve_valor(FILE *arq, char *valor)
+{
+  char *p = valor;
+  if (*p == '-') p++;
+  bool numero = (*p != '\0');
+  for (; *p != '\0'; p++) {
+    if (!isdigit(*p)) numero = false;
+  }
+  if (numero) {
+    fprintf(arq, "%s", valor);
+    return;
+  }
+  fputc('"', arq);
+  for (p = valor; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') fputc('\\', arq);
+    fputc(*p, arq);
+  }
+  fputc('"', arq);
+}
+
+static void escreve_relatorio(varredura_t *self, char *nome, int n_threads,
+                              double segundos)
+{
+  FILE *arq = fopen(nome, "w");
+  if (arq == NULL) {
+    fprintf(stderr, "ERRO: não consegui criar '%s'\n", nome);
+    return;
+  }
+  struct rusage uso;
+  getrusage(RUSAGE_SELF, &uso);
+  fprintf(arq, "{\n");
+  fprintf(arq, "  \"threads\": %d,\n", n_threads);
+  fprintf(arq, "  \"segundos\": %.6f,\n", segundos);
+  fprintf(arq, "  \"rss_max_kb\": %ld,\n", uso.ru_maxrss);
+  fprintf(arq, "  \"execucoes\": [\n");
+  for (int e = 0; e < self->n_execucoes; e++) {
+    execucao_t *ex = &self->execucoes[e];
+    fprintf(arq, "    {\n");
+    fprintf(arq, "      \"dir\": ");
+    escreve_valor(arq, ex->dir);
+    fprintf(arq, ",\n");
+    for (int p = 0; p < N_PARAMETROS; p++) {
+      if (self->n_valores[p] == 0) continue;
+      fprintf(arq, "      \"%s\": ", parametros[p].nome);
+      escreve_valor(arq, self->valores[p][indice_do_valor(self, e, p)]);
+      fprintf(arq, ",\n");
+    }
+    maquina_escreve_estatisticas(arq, &ex->est, "      ");
+    fprintf(arq, "\n    }%s\n", e < self->n_execucoes - 1 ? "," : "");
+  }
+  fprintf(arq, "  ]\n");
+  fprintf(arq, "}\n");
+  fclose(arq);
+}
+
+// PRINCIPAL {{{1
+
+static void uso(char *nome)
+{
+  fprintf(stderr, "uso: %s [-j threads] [-d dir] [-o relatorio] matriz\n", nome);
+  fprintf(stderr, "  -j  número de execuções simultâneas (padrão: uma por núcleo)\n");
+  fprintf(stderr, "  -d  diretório onde fica um subdiretório por execução\n"
+                  "      (padrão: varredura)\n");
+  fprintf(stderr, "  -o  arquivo do relatório (padrão: dir/relatorio.json)\n");
+  fprintf(stderr, "  parâmetros da matriz:");
+  for (int p = 0; p < N_PARAMETROS; p++) {
+    fprintf(stderr, " %s", parametros[p].nome);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+static double agora_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[argc])
+{
+  varredura_t self = { 0 };
+  int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  self.dir = "varredura";
+  char *relatorio = NULL;
+  char *matriz = NULL;
+  for (int argi = 1; argi < argc; argi++) {
+    if (strcmp(argv[argi], "-j") == 0 && argi + 1 < argc) {
+      n_threads = atoi(argv[++argi]);
+      if (n_threads < 1) uso(argv[0]);
+    } else if (strcmp(argv[argi], "-d") == 0 && argi + 1 < argc) {
+      self.dir = argv[++argi];
+    } else if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+      relatorio = argv[++argi];
+    } else if (argv[argi][0] != '-' && matriz == NULL) {
+      matriz = argv[argi];
+    } else {
+      uso(argv[0]);
+    }
+  }
+  if (matriz == NULL) uso(argv[0]);
+  if (!le_matriz(&self, matriz)) exit(1);
+
+  if (mkdir(self.dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "ERRO: não consegui criar '%s'\n", self.dir);
+    exit(1);
+  }
+  // os comandos padrão, num arquivo para as consoles lerem
+  snprintf(self.comandos, sizeof(self.comandos), "%s/comandos", self.dir);
+  FILE *arq = fopen(self.comandos, "w");
+  if (arq == NULL) {
+    fprintf(stderr, "ERRO: não consegui criar '%s'\n", self.comandos);
+    exit(1);
+  }
+  fprintf(arq, "L1\nC\nS\nF\n");
+  fclose(arq);
+
+  self.n_execucoes = 1;
+  for (int p = 0; p < N_PARAMETROS; p++) {
+    if (self.n_valores[p] > 0) self.n_execucoes *= self.n_valores[p];
+  }
+  self.execucoes = calloc(self.n_execucoes, sizeof(execucao_t));
+  assert(self.execucoes != NULL);
+  for (int e = 0; e < self.n_execucoes; e++) {
+    snprintf(self.execucoes[e].dir, TAM_LINHA, "%s/%03d", self.dir, e);
+  }
+  atomic_init(&self.proxima, 0);
+  atomic_init(&self.terminadas, 0);
+  if (n_threads > self.n_execucoes) n_threads = self.n_execucoes;
+
+  // cada thread executa uma máquina de cada vez, até acabarem
+  double inicio = agora_s();
+  pthread_t threads[n_threads];
+  for (int t = 0; t < n_threads; t++) {
+    int err = pthread_create(&threads[t], NULL, trabalhador, &self);
+    assert(err == 0);
+  }
+  for (int t = 0; t < n_threads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  double segundos = agora_s() - inicio;
+
+  char nome[TAM_LINHA];
+  if (relatorio == NULL) {
+    snprintf(nome, sizeof(nome), "%s/relatorio.json", self.dir);
+    relatorio = nome;
+  }
+  escreve_relatorio(&self, relatorio, n_threads, segundos);
+  printf("%d execuções em %.3f s, com %d threads; relatório em %s\n",
+         self.n_execucoes, segundos, n_threads, relatorio);
+
+  for (int p = 0; p < N_PARAMETROS; p++) {
+    for (int v = 0; v < self.n_valores[p]; v++) free(self.valores[p][v]);
+  }
+  free(self.execucoes);
+  return 0;
+}
+
+// vim: foldmethod=marker